@@ -55,7 +55,7 @@ function run_memview_docker() {
         gcc:13 bash -c " \
             apt-get update -qq && \
             apt-get install -y procps > /dev/null && \
-            gcc -O2 -D_GNU_SOURCE -o memview memview.c && \
+            gcc -O2 -D_GNU_SOURCE -pthread -o memview memview.c && \
             echo 'Running memview...' && \
             $CMD"
 }
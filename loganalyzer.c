@@ -6,26 +6,108 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <pthread.h>
 #include <signal.h>
 #include <errno.h>
 #include <getopt.h>
 #include <ctype.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <glob.h>
+#include <dirent.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
 typedef struct {
     size_t total, info, warn, error, debug, trace, other;
 } stats_t;
 
+enum { LVL_TRACE, LVL_DEBUG, LVL_INFO, LVL_WARN, LVL_ERROR, LVL_UNKNOWN, LVL_COUNT };
+
+struct line_fx;
+typedef void (*scan_fn)(const char *p, const char *end, size_t *counts, struct line_fx *fx);
+
+/* The input is cut into fixed-size work units. A line belongs to the unit
+ * holding its first byte, so units can be scanned in any order, by any
+ * worker, and still add up to the same counts. Several jobs (files) can
+ * share one pool run; their units are numbered one after the other. */
+#define UNIT_MIN          (64u << 10)
+#define UNIT_MAX          (4u << 20)
+#define UNITS_PER_WORKER  16
+
 typedef struct {
-    const char *start;
-    const char *end; 
-    int min_level;
-    stats_t local;
+    const char *data;   /* NULL: read fd through per-unit windows */
+    int fd;
+    size_t size;
+    size_t begin;       /* units start here; bytes before it are context only */
+    size_t unit;        /* 0: sized by run_pool() */
+    uint32_t nunits;
+    uint32_t first;     /* pool-wide number of unit 0 */
+    size_t (*unit_counts)[LVL_COUNT];   /* optional per-unit results */
+    scan_fn scan;       /* NULL: the pool's; set per file by --format auto */
+    _Atomic size_t counts[LVL_COUNT];   /* this job's share of the totals */
+} job_t;
+
+#define CACHE_LINE  64
+#define WORKER_ALIGN 4096   /* a page on most systems */
+
+/* Each worker owns a deque of unit indices packed into one word (head in the
+ * low half, tail in the high half). The owner pops from the head, thieves
+ * take from the tail, both with a single CAS. Thieves touch only that word,
+ * so it has a cache line to itself; the rest is written by its owner alone
+ * and starts on the next line. Each slot is aligned to WORKER_ALIGN, so
+ * no two workers share a line, or a page a pinned worker could not move
+ * to its own node. */
+typedef struct __attribute__((aligned(WORKER_ALIGN))) {
+    _Atomic uint64_t queue __attribute__((aligned(CACHE_LINE)));
+    scan_fn scan __attribute__((aligned(CACHE_LINE)));
+    size_t counts[LVL_COUNT];
+    size_t units, steals, bytes;
+    double busy;        /* seconds from worker_start() to worker_stop() */
+    int cpu, node;      /* cpu -1: not pinned */
+    struct stream *stream;
+    struct gz_job *gz;
+    struct line_fx *fx;
 } thread_arg_t;
 
 static volatile sig_atomic_t stop_now = 0;
-static pthread_mutex_t aggregate_mutex = PTHREAD_MUTEX_INITIALIZER;
-static stats_t aggregate = {0};
+
+/* Command-line settings shared by every input path. */
+static struct {
+    int threads;
+    int min_level;
+    int kernel;
+    scan_fn scan;           /* see format_scan() */
+    int format;             /* FMT_*, FMT_AUTO: per input, see detect_format() */
+    unsigned formats_seen;  /* 1 << FMT_* of every input scanned */
+    int per_line;           /* some per-line feature is on, see line_fx_t */
+    size_t unit;
+    int report;
+    int64_t bucket;         /* histogram width in seconds, 0 = off */
+    int windowed;           /* --since / --until given */
+    int64_t since, until;
+    int syslog_year;
+    int top_k;              /* templates to print, 0 = off */
+    int pin;                /* pin workers to CPUs, see topo_init() */
+    size_t budget;          /* --memory in bytes, 0: map whole files */
+    int drop_cache;         /* --drop-cache */
+} cfg = { .threads = 1, .min_level = LVL_TRACE, .since = INT64_MIN, .until = INT64_MAX };
 
 static void on_signal(int signo) {
     (void)signo;
@@ -33,8 +115,6 @@ static void on_signal(int signo) {
 }
 
 
-enum { LVL_TRACE, LVL_DEBUG, LVL_INFO, LVL_WARN, LVL_ERROR, LVL_UNKNOWN };
-
 static int str_to_level(const char *s) {
     if (!s) return LVL_UNKNOWN;
     if (!strcasecmp(s, "trace")) return LVL_TRACE;
@@ -52,153 +132,3660 @@ static const char *level_to_str(int lvl) {
         case LVL_ERROR: return "ERROR"; default        : return "UNKNOWN"; }
 }
 
-static void add_stats(stats_t *a, const stats_t *b) {
-    a->total += b->total; a->info  += b->info;  a->warn  += b->warn;
-    a->error += b->error; a->debug += b->debug; a->trace += b->trace;
-    a->other += b->other;
+static void counts_to_stats(stats_t *s, const size_t *counts, int min_level) {
+    const size_t *c = counts;
+    memset(s, 0, sizeof(*s));
+    for (int lvl = min_level; lvl < LVL_COUNT; ++lvl) s->total += c[lvl];
+    if (min_level <= LVL_INFO ) s->info  = c[LVL_INFO];
+    if (min_level <= LVL_WARN ) s->warn  = c[LVL_WARN];
+    if (min_level <= LVL_ERROR) s->error = c[LVL_ERROR];
+    if (min_level <= LVL_DEBUG) s->debug = c[LVL_DEBUG];
+    if (min_level <= LVL_TRACE) s->trace = c[LVL_TRACE];
+    s->other = c[LVL_UNKNOWN];
 }
 
-static void *analyze_chunk(void *arg) {
-    thread_arg_t *ta = (thread_arg_t *)arg;
-    const char *p = ta->start;
+/* ---- line / level-tag scanning ------------------------------------------
+ * A line's level is decided by its first '[' and the first ']' after it: if
+ * they are at most 8 bytes apart and the text between them names a level
+ * (case-insensitively) that is the level, otherwise it is LVL_UNKNOWN.
+ * Every kernel below implements exactly that rule and must produce the
+ * same counts as scan_scalar().
+ */
 
-    while (p < ta->end && !stop_now) {
-        const char *line_start = p;
-        while (p < ta->end && *p != '\n') ++p;
-        const char *line_end = p;
-        if (p < ta->end) ++p; 
+#define TAG4(a,b,c,d)   ((uint64_t)(a) | (uint64_t)(b) << 8 | \
+                         (uint64_t)(c) << 16 | (uint64_t)(d) << 24)
+#define TAG5(a,b,c,d,e) (TAG4(a,b,c,d) | (uint64_t)(e) << 32)
+
+/* Packs the tag into one word and compares it against the level names. OR-ing
+ * in 0x20 folds ASCII upper case; since the names are all letters, no other
+ * byte can fold into a match. A NUL ends the tag, as it did for strcasecmp. */
+static inline int classify_tag(const char *tag, size_t len) {
+    uint64_t w = 0;
+    size_t n = 0;
+    while (n < len && tag[n]) {
+        w |= (uint64_t)((unsigned char)tag[n] | 0x20) << (8 * n);
+        ++n;
+    }
+    if (n == 4) {
+        if (w == TAG4('i','n','f','o')) return LVL_INFO;
+        if (w == TAG4('w','a','r','n')) return LVL_WARN;
+    } else if (n == 5) {
+        if (w == TAG5('e','r','r','o','r')) return LVL_ERROR;
+        if (w == TAG5('d','e','b','u','g')) return LVL_DEBUG;
+        if (w == TAG5('t','r','a','c','e')) return LVL_TRACE;
+    }
+    return LVL_UNKNOWN;
+}
+
+static inline int classify_brackets(const char *lb, const char *rb) {
+    size_t len = rb - lb - 1;
+    return len < 8 ? classify_tag(lb + 1, len) : LVL_UNKNOWN;
+}
 
+/* Reference kernel: one line at a time with memchr. */
+static void scan_scalar(const char *p, const char *end, size_t *counts, struct line_fx *fx) {
+    (void)fx;
+    while (p < end) {
+        if (stop_now) return;
+        const char *line_start = p;
+        const char *line_end = memchr(p, '\n', end - p);
+        if (!line_end) line_end = end;
+        p = line_end < end ? line_end + 1 : end;
 
         int lvl = LVL_UNKNOWN;
         const char *lb = memchr(line_start, '[', line_end - line_start);
         if (lb) {
             const char *rb = memchr(lb, ']', line_end - lb);
-            if (rb && rb - lb <= 8) {
-                char tmp[8] = {0};
-                size_t len = rb - lb - 1;
-                if (len < sizeof(tmp)) {
-                    memcpy(tmp, lb + 1, len);
-                    lvl = str_to_level(tmp);
+            if (rb && rb - lb <= 8) lvl = classify_brackets(lb, rb);
+        }
+        counts[lvl]++;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+/* The vector kernels turn each 64-byte block into three bitmasks ('\n', '[',
+ * ']') and walk them with a small per-line state machine, so every byte is
+ * loaded once and only the interesting positions are visited. */
+enum { SEEK_LB, SEEK_RB, SEEK_NL };
+
+typedef struct {
+    int state, lvl;
+    const char *lb;
+    const char *line_start;
+} scan_state_t;
+
+static inline __attribute__((always_inline))
+void scan_masks(const char *base, uint64_t nl, uint64_t lbm, uint64_t rbm,
+                scan_state_t *s, size_t *counts) {
+    for (;;) {
+        uint64_t m = s->state == SEEK_LB ? (nl | lbm)
+                   : s->state == SEEK_RB ? (nl | rbm) : nl;
+        if (!m) return;
+        int i = __builtin_ctzll(m);
+        uint64_t upto = (2ULL << i) - 1;
+        int is_nl = (nl >> i) & 1;
+        nl &= ~upto; lbm &= ~upto; rbm &= ~upto;
+
+        if (is_nl) {
+            counts[s->state == SEEK_NL ? s->lvl : LVL_UNKNOWN]++;
+            s->state = SEEK_LB;
+            s->line_start = base + i + 1;
+        } else if (s->state == SEEK_LB) {
+            s->lb = base + i;
+            s->state = SEEK_RB;
+        } else {
+            const char *rb = base + i;
+            s->lvl = rb - s->lb <= 8 ? classify_brackets(s->lb, rb) : LVL_UNKNOWN;
+            s->state = SEEK_NL;
+        }
+    }
+}
+
+static inline __attribute__((always_inline))
+void scan_finish(const char *end, scan_state_t *s, size_t *counts) {
+    if (s->line_start < end)
+        counts[s->state == SEEK_NL ? s->lvl : LVL_UNKNOWN]++;
+}
+
+/* Defines scan_<isa>(): MASKS(ptr, nl, lb, rb) fills the three masks for the
+ * 64 bytes at ptr. The tail is copied into a zeroed block so the same code
+ * handles it; NUL never matches any of the three bytes. */
+#define DEFINE_SIMD_SCAN(isa, tgt, MASKS)                                      \
+__attribute__((target(tgt)))                                                   \
+static void scan_##isa(const char *p, const char *end, size_t *counts,         \
+                       struct line_fx *fx) {                                   \
+    scan_state_t s = { SEEK_LB, LVL_UNKNOWN, NULL, p };                        \
+    (void)fx;                                                                  \
+    uint64_t nl, lb, rb;                                                       \
+    while (end - p >= 64) {                                                    \
+        if (stop_now) return;                                                  \
+        MASKS(p, nl, lb, rb);                                                  \
+        scan_masks(p, nl, lb, rb, &s, counts);                                 \
+        p += 64;                                                               \
+    }                                                                          \
+    if (p < end) {                                                             \
+        char tail[64] __attribute__((aligned(64))) = {0};                      \
+        size_t n = end - p;                                                    \
+        memcpy(tail, p, n);                                                    \
+        MASKS(tail, nl, lb, rb);                                               \
+        /* positions are reported relative to p, not to the copy */            \
+        scan_masks(p, nl, lb, rb, &s, counts);                                 \
+    }                                                                          \
+    scan_finish(end, &s, counts);                                              \
+}
+
+#define SSE2_MASK(v, c) ((uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8((v), (c))))
+#define SSE2_MASKS(ptr, nl, lb, rb) do {                                       \
+    const __m128i cn = _mm_set1_epi8('\n'), cl = _mm_set1_epi8('['),           \
+                  cr = _mm_set1_epi8(']');                                     \
+    nl = lb = rb = 0;                                                          \
+    for (int k = 0; k < 4; ++k) {                                              \
+        __m128i v = _mm_loadu_si128((const __m128i *)((ptr) + 16 * k));        \
+        nl |= SSE2_MASK(v, cn) << (16 * k);                                    \
+        lb |= SSE2_MASK(v, cl) << (16 * k);                                    \
+        rb |= SSE2_MASK(v, cr) << (16 * k);                                    \
+    }                                                                          \
+} while (0)
+
+#define AVX2_MASK(v, c) ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8((v), (c))))
+#define AVX2_MASKS(ptr, nl, lb, rb) do {                                       \
+    const __m256i cn = _mm256_set1_epi8('\n'), cl = _mm256_set1_epi8('['),     \
+                  cr = _mm256_set1_epi8(']');                                  \
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)(ptr));                   \
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)((ptr) + 32));            \
+    nl = AVX2_MASK(v0, cn) | AVX2_MASK(v1, cn) << 32;                          \
+    lb = AVX2_MASK(v0, cl) | AVX2_MASK(v1, cl) << 32;                          \
+    rb = AVX2_MASK(v0, cr) | AVX2_MASK(v1, cr) << 32;                          \
+} while (0)
+
+#define AVX512_MASKS(ptr, nl, lb, rb) do {                                     \
+    __m512i v = _mm512_loadu_si512((const void *)(ptr));                       \
+    nl = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n'));                    \
+    lb = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('['));                     \
+    rb = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(']'));                     \
+} while (0)
+
+DEFINE_SIMD_SCAN(sse2,   "sse2",     SSE2_MASKS)
+DEFINE_SIMD_SCAN(avx2,   "avx2",     AVX2_MASKS)
+DEFINE_SIMD_SCAN(avx512, "avx512bw", AVX512_MASKS)
+
+static int have_sse2(void)   { return 1; }
+static int have_avx2(void)   { return __builtin_cpu_supports("avx2"); }
+static int have_avx512(void) { return __builtin_cpu_supports("avx512bw"); }
+
+#endif /* HAVE_X86_SIMD */
+
+static int have_scalar(void) { return 1; }
+
+/* Fastest first; pick_kernel() takes the first one the CPU supports. */
+static const struct {
+    const char *name;
+    scan_fn fn;
+    int (*supported)(void);
+} kernels[] = {
+#ifdef HAVE_X86_SIMD
+    { "avx512", scan_avx512, have_avx512 },
+    { "avx2",   scan_avx2,   have_avx2   },
+    { "sse2",   scan_sse2,   have_sse2   },
+#endif
+    { "scalar", scan_scalar, have_scalar },
+};
+
+static int pick_kernel(const char *name) {
+    int n = sizeof(kernels) / sizeof(kernels[0]);
+    for (int i = 0; i < n; ++i) {
+        if (name && strcasecmp(name, "auto") && strcasecmp(name, kernels[i].name))
+            continue;
+        if (kernels[i].supported()) return i;
+        if (name && strcasecmp(name, "auto")) break;
+    }
+    return -1;
+}
+
+/* ---- timestamps ----------------------------------------------------------
+ * Fixed-format parsers for the two layouts we see at the start of a line
+ * (optionally after a syslog <PRI>, one '[' or leading blanks):
+ *   ISO-8601  2025-04-28T12:34:56[.123][Z|+02:00]   ('T' or ' ' separator)
+ *   syslog    Apr 28 12:34:56                        (year from cfg)
+ * Times without a zone are taken as UTC. Results are Unix seconds, or
+ * TS_NONE when the line has no timestamp. */
+
+#define TS_NONE INT64_MIN
+
+static inline int is_dig(char c) { return (unsigned char)(c - '0') < 10; }
+static inline int dig2(const char *p) { return (p[0] - '0') * 10 + (p[1] - '0'); }
+
+/* Days since 1970-01-01 of a proleptic Gregorian date. */
+static int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static int parse_hms(const char *p, int64_t *secs) {
+    if (!is_dig(p[0]) || !is_dig(p[1]) || p[2] != ':' || !is_dig(p[3]) || !is_dig(p[4])
+        || p[5] != ':' || !is_dig(p[6]) || !is_dig(p[7])) return 0;
+    *secs = dig2(p) * 3600 + dig2(p + 3) * 60 + dig2(p + 6);
+    return 1;
+}
+
+static int64_t parse_iso(const char *p, const char *end) {
+    if (end - p < 19 || p[4] != '-' || p[7] != '-' || (p[10] != 'T' && p[10] != ' ')) return TS_NONE;
+    for (int i = 0; i < 4; ++i) if (!is_dig(p[i])) return TS_NONE;
+    if (!is_dig(p[5]) || !is_dig(p[6]) || !is_dig(p[8]) || !is_dig(p[9])) return TS_NONE;
+    int64_t hms;
+    if (!parse_hms(p + 11, &hms)) return TS_NONE;
+
+    int y = dig2(p) * 100 + dig2(p + 2), m = dig2(p + 5), d = dig2(p + 8);
+    if (m < 1 || m > 12 || d < 1 || d > 31) return TS_NONE;
+    int64_t t = days_from_civil(y, m, d) * 86400 + hms;
+
+    p += 19;
+    if (p < end && (*p == '.' || *p == ',')) do ++p; while (p < end && is_dig(*p));
+    if (end - p >= 3 && (*p == '+' || *p == '-') && is_dig(p[1]) && is_dig(p[2])) {
+        int sign = *p == '-' ? -1 : 1;
+        int off = dig2(p + 1) * 3600;
+        p += 3;
+        if (p < end && *p == ':') ++p;
+        if (end - p >= 2 && is_dig(p[0]) && is_dig(p[1])) off += dig2(p) * 60;
+        t -= sign * off;
+    }
+    return t;
+}
+
+static int64_t parse_syslog(const char *p, const char *end, int year) {
+    static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+    if (end - p < 15 || p[3] != ' ' || p[6] != ' ' || !is_dig(p[5])) return TS_NONE;
+
+    char mon[3] = { p[0] | 0x20, p[1] | 0x20, p[2] | 0x20 };
+    int m = 0;
+    while (m < 12 && memcmp(months + 3 * m, mon, 3)) ++m;
+    if (m == 12) return TS_NONE;
+
+    int d = (p[4] == ' ' ? 0 : p[4] - '0') * 10 + (p[5] - '0');
+    int64_t hms;
+    if (d < 1 || d > 31 || !parse_hms(p + 7, &hms)) return TS_NONE;
+    return days_from_civil(year, m + 1, d) * 86400 + hms;
+}
+
+static inline int64_t line_timestamp(const char *p, const char *end, int syslog_year) {
+    if (p < end && *p == '<') {
+        /* syslog <PRI>, and the RFC 5424 version number after it */
+        const char *q = p + 1;
+        while (q < end && is_dig(*q)) ++q;
+        if (q < end && *q == '>') p = q + 1;
+        if (end - p >= 2 && is_dig(p[0]) && p[1] == ' ') p += 2;
+    }
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    if (p < end && *p == '[') ++p;
+    if (end - p >= 5 && p[4] == '-') return parse_iso(p, end);
+    return parse_syslog(p, end, syslog_year);
+}
+
+/* ---- multi-pattern matching ----------------------------------------------
+ * --patterns FILE counts the lines containing each of a list of literal
+ * strings. The patterns are compiled into an Aho-Corasick automaton and
+ * then into a DFA: one flat table of (state, byte class) -> state, where
+ * the byte classes are the distinct bytes used by any pattern plus one
+ * class for everything else. Matching costs one table load per byte no
+ * matter how many patterns there are, and the table stays small enough to
+ * live in cache for a few hundred patterns. Entries hold the target row
+ * offset (state * ncls) with AC_OUT set when that state ends a pattern. */
+
+#define AC_OUT       0x80000000u
+#define AC_MAX_CELLS (1u << 28)     /* states * classes */
+
+typedef struct {
+    uint32_t *next;         /* nstates * ncls entries */
+    uint8_t cls[256];
+    uint32_t ncls, nstates;
+    uint32_t *out_start;    /* by state: out_ids[out_start[s] .. + out_len[s]) */
+    uint32_t *out_len;
+    uint32_t *out_ids;
+    char **pats;
+    size_t npats;
+} ac_t;
+
+static ac_t ac;
+
+static void *xrealloc(void *p, size_t n) {
+    p = realloc(p, n);
+    if (!p) { perror("realloc"); exit(EXIT_FAILURE); }
+    return p;
+}
+
+/* Reads one pattern per line (empty lines are skipped) and builds the DFA. */
+static int ac_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return -1; }
+
+    char *line = NULL;
+    size_t cap = 0, pcap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &cap, f)) > 0) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (!n) continue;
+        if (ac.npats == pcap) {
+            pcap = pcap ? 2 * pcap : 64;
+            ac.pats = xrealloc(ac.pats, pcap * sizeof(*ac.pats));
+        }
+        ac.pats[ac.npats++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    if (!ac.npats) {
+        fprintf(stderr, "%s: no patterns\n", path);
+        return -1;
+    }
+
+    /* class 0 is every byte no pattern uses */
+    ac.ncls = 1;
+    for (size_t i = 0; i < ac.npats; ++i)
+        for (const unsigned char *q = (const unsigned char *)ac.pats[i]; *q; ++q)
+            if (!ac.cls[*q]) ac.cls[*q] = ac.ncls++;
+
+    /* trie; 0 means "no edge" since nothing points back at the root */
+    const uint32_t k = ac.ncls;
+    uint32_t scap = 256, *go = calloc((size_t)scap * k, sizeof(*go));
+    int32_t *term = malloc(scap * sizeof(*term));       /* first pattern ending here */
+    int32_t *pat_next = malloc(ac.npats * sizeof(*pat_next));
+    if (!go || !term || !pat_next) { perror("malloc"); exit(EXIT_FAILURE); }
+    term[0] = -1;
+    ac.nstates = 1;
+    for (size_t i = 0; i < ac.npats; ++i) {
+        uint32_t s = 0;
+        for (const unsigned char *q = (const unsigned char *)ac.pats[i]; *q; ++q) {
+            uint32_t *e = &go[(size_t)s * k + ac.cls[*q]];
+            if (!*e) {
+                if ((size_t)(ac.nstates + 1) * k > AC_MAX_CELLS) {
+                    fprintf(stderr, "%s: too many patterns\n", path);
+                    return -1;
                 }
+                if (ac.nstates == scap) {
+                    go = xrealloc(go, (size_t)2 * scap * k * sizeof(*go));
+                    memset(go + (size_t)scap * k, 0, (size_t)scap * k * sizeof(*go));
+                    term = xrealloc(term, 2 * scap * sizeof(*term));
+                    scap *= 2;
+                    e = &go[(size_t)s * k + ac.cls[*q]];
+                }
+                term[ac.nstates] = -1;
+                *e = ac.nstates++;
+            }
+            s = *e;
+        }
+        pat_next[i] = term[s];
+        term[s] = i;
+    }
+
+    /* breadth-first: fill in failure transitions so every (state, class)
+     * has an edge, and give each state its own outputs plus those of its
+     * failure state */
+    uint32_t *fail = calloc(ac.nstates, sizeof(*fail));
+    uint32_t *queue = malloc(ac.nstates * sizeof(*queue));
+    ac.out_start = calloc(ac.nstates, sizeof(*ac.out_start));
+    ac.out_len = calloc(ac.nstates, sizeof(*ac.out_len));
+    if (!fail || !queue || !ac.out_start || !ac.out_len) { perror("calloc"); exit(EXIT_FAILURE); }
+    size_t nout = 0, ocap = 0, qh = 0, qt = 0;
+    queue[qt++] = 0;
+    while (qh < qt) {
+        uint32_t s = queue[qh++];
+        ac.out_start[s] = nout;
+        for (int32_t i = term[s]; i >= 0; i = pat_next[i]) {
+            if (nout == ocap) ac.out_ids = xrealloc(ac.out_ids, (ocap = ocap ? 2 * ocap : 64) * sizeof(*ac.out_ids));
+            ac.out_ids[nout++] = i;
+        }
+        if (s) {
+            for (uint32_t j = 0; j < ac.out_len[fail[s]]; ++j) {
+                if (nout == ocap) ac.out_ids = xrealloc(ac.out_ids, (ocap = ocap ? 2 * ocap : 64) * sizeof(*ac.out_ids));
+                ac.out_ids[nout++] = ac.out_ids[ac.out_start[fail[s]] + j];
+            }
+        }
+        ac.out_len[s] = nout - ac.out_start[s];
+
+        for (uint32_t c = 0; c < k; ++c) {
+            uint32_t *e = &go[(size_t)s * k + c];
+            if (*e) {
+                fail[*e] = s ? go[(size_t)fail[s] * k + c] : 0;
+                queue[qt++] = *e;
+            } else {
+                *e = s ? go[(size_t)fail[s] * k + c] : 0;
+            }
+        }
+    }
+
+    /* final table: row offsets with the output flag folded in */
+    for (size_t i = 0; i < (size_t)ac.nstates * k; ++i)
+        go[i] = go[i] * k | (ac.out_len[go[i]] ? AC_OUT : 0);
+    ac.next = go;
+
+    free(term);
+    free(pat_next);
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+/* ---- message templates ---------------------------------------------------
+ * --templates K groups lines by shape: numbers, hex ids, IPv4 addresses and
+ * quoted strings are masked, and the masked text is counted per level in an
+ * open-addressing table whose strings live in a bump arena. Each worker
+ * has its own table; they are merged into one at the end.
+ *
+ * A table never holds more than TPL_SLOTS / 2 templates. When it fills up,
+ * only the TPL_SLOTS / 4 most frequent survive and the arena is rebuilt
+ * for them. A template dropped this way and seen again starts over, so
+ * its count can be low by at most the total of the pruning thresholds.
+ * That total is reported.
+ *
+ * --group-by counts by key in the same kind of table, marked exact: it
+ * doubles instead of pruning, so every key keeps its full count. */
+
+#define TPL_MAX     256             /* template bytes kept per line */
+#define TPL_SLOTS   (1u << 15)
+#define ARENA_BLOCK (256u << 10)
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t *head;
+    size_t bytes;
+} arena_t;
+
+static char *arena_alloc(arena_t *a, size_t n) {
+    if (!a->head || a->head->used + n > ARENA_BLOCK) {
+        arena_block_t *b = malloc(sizeof(*b) + ARENA_BLOCK);
+        if (!b) { perror("malloc"); exit(EXIT_FAILURE); }
+        b->next = a->head;
+        b->used = 0;
+        a->head = b;
+        a->bytes += sizeof(*b) + ARENA_BLOCK;
+    }
+    char *p = a->head->data + a->head->used;
+    a->head->used += n;
+    return p;
+}
+
+static void arena_free(arena_t *a) {
+    while (a->head) {
+        arena_block_t *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+    a->bytes = 0;
+}
+
+typedef struct {
+    uint64_t hash;
+    const char *text;           /* NULL marks an empty slot */
+    uint32_t len;
+    uint64_t counts[LVL_COUNT];
+} tpl_ent_t;
+
+typedef struct {
+    tpl_ent_t *slots;           /* cap of them, allocated on first use */
+    size_t cap, used;
+    int exact;                  /* grow when full instead of pruning */
+    arena_t arena;
+    uint64_t evicted;           /* lines whose template was pruned */
+    uint64_t error;             /* bound on how low any count may be */
+} tpl_table_t;
+
+static inline int is_hex(unsigned char c) {
+    return is_dig(c) || (unsigned char)((c | 0x20) - 'a') < 6;
+}
+
+static inline int is_alnum_ascii(unsigned char c) {
+    return is_dig(c) || (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+/* Length of a dotted quad at p, or 0. */
+static size_t match_ipv4(const char *p, const char *end) {
+    const char *q = p;
+    for (int part = 0; part < 4; ++part) {
+        if (part) {
+            if (q >= end || *q != '.') return 0;
+            ++q;
+        }
+        int digits = 0;
+        while (q < end && is_dig(*q) && digits < 3) { ++q; ++digits; }
+        if (!digits) return 0;
+    }
+    return q < end && (is_alnum_ascii(*q) || *q == '.') ? 0 : (size_t)(q - p);
+}
+
+/* Length of an 8-4-4-4-12 hex UUID at p, or 0. */
+static size_t match_uuid(const char *p, const char *end) {
+    if (end - p < 36) return 0;
+    for (int i = 0; i < 36; ++i) {
+        int dash = i == 8 || i == 13 || i == 18 || i == 23;
+        if (dash ? p[i] != '-' : !is_hex(p[i])) return 0;
+    }
+    return end - p > 36 && is_alnum_ascii(p[36]) ? 0 : 36;
+}
+
+/* Writes the masked form of the line [p, end) to out, at most TPL_MAX
+ * bytes, and returns its length. */
+static size_t tpl_normalize(const char *p, const char *end, char *out) {
+    size_t n = 0;
+#define TPL_PUT(str) for (const char *s_ = (str); *s_ && n < TPL_MAX; ++s_) out[n++] = *s_
+    while (p < end && n < TPL_MAX) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\'') {
+            const char *q = memchr(p + 1, c, end - p - 1);
+            if (q) {
+                TPL_PUT(c == '"' ? "\"*\"" : "'*'");
+                p = q + 1;
+                continue;
+            }
+        }
+        if (!is_alnum_ascii(c)) {
+            out[n++] = c;
+            ++p;
+            continue;
+        }
+
+        /* one alphanumeric token [p, q) */
+        const char *q = p;
+        int digits = 0, hex = 1;
+        while (q < end && is_alnum_ascii(*q)) {
+            digits |= is_dig(*q);
+            hex &= is_hex(*q);
+            ++q;
+        }
+        size_t len;
+        if ((len = match_ipv4(p, end)) || (len = match_uuid(p, end))) {
+            TPL_PUT(len == 36 ? "<HEX>" : "<IP>");
+            p += len;
+        } else if (q - p > 2 && c == '0' && (p[1] | 0x20) == 'x') {
+            TPL_PUT("<HEX>");
+            p = q;
+        } else if (hex && digits && q - p >= 8) {
+            TPL_PUT("<HEX>");
+            p = q;
+        } else {
+            /* words keep their letters; digit runs in them become <N> */
+            while (p < q && n < TPL_MAX) {
+                if (!is_dig(*p)) { out[n++] = *p++; continue; }
+                while (p < q && is_dig(*p)) ++p;
+                TPL_PUT("<N>");
             }
         }
+    }
+#undef TPL_PUT
+    return n;
+}
+
+static inline uint64_t tpl_hash(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;         /* FNV-1a */
+    for (size_t i = 0; i < n; ++i) h = (h ^ (unsigned char)s[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+static tpl_ent_t *tpl_find(tpl_ent_t *slots, size_t cap, uint64_t h, const char *s, uint32_t len) {
+    for (size_t i = h & (cap - 1);; i = (i + 1) & (cap - 1)) {
+        tpl_ent_t *e = &slots[i];
+        if (!e->text || (e->hash == h && e->len == len && !memcmp(e->text, s, len))) return e;
+    }
+}
 
-        
-        if (lvl < ta->min_level) continue;
+static inline uint64_t tpl_total(const tpl_ent_t *e) {
+    uint64_t t = 0;
+    for (int l = 0; l < LVL_COUNT; ++l) t += e->counts[l];
+    return t;
+}
+
+static int cmp_u64_desc(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x < y) - (x > y);
+}
+
+/* Keeps the cap / 4 most frequent templates (fewer on ties) in a fresh
+ * table and arena. */
+static void tpl_prune(tpl_table_t *t) {
+    uint64_t *tot = malloc(t->used * sizeof(*tot));
+    tpl_ent_t *slots = calloc(t->cap, sizeof(*slots));
+    if (!tot || !slots) { perror("malloc"); exit(EXIT_FAILURE); }
+    size_t n = 0;
+    for (size_t i = 0; i < t->cap; ++i)
+        if (t->slots[i].text) tot[n++] = tpl_total(&t->slots[i]);
+    qsort(tot, n, sizeof(*tot), cmp_u64_desc);
+    uint64_t cut = tot[t->cap / 4];
+    free(tot);
 
-        
-        ta->local.total++;
-        switch (lvl) {
-            case LVL_INFO : ta->local.info++;  break;
-            case LVL_WARN : ta->local.warn++;  break;
-            case LVL_ERROR: ta->local.error++; break;
-            case LVL_DEBUG: ta->local.debug++; break;
-            case LVL_TRACE: ta->local.trace++; break;
-            default:        ta->local.other++; break;
+    arena_t arena = {0};
+    size_t used = 0;
+    for (size_t i = 0; i < t->cap; ++i) {
+        const tpl_ent_t *e = &t->slots[i];
+        if (!e->text) continue;
+        if (tpl_total(e) <= cut) {
+            t->evicted += tpl_total(e);
+            continue;
         }
+        tpl_ent_t *d = tpl_find(slots, t->cap, e->hash, e->text, e->len);
+        *d = *e;
+        d->text = memcpy(arena_alloc(&arena, e->len), e->text, e->len);
+        ++used;
+    }
+    free(t->slots);
+    arena_free(&t->arena);
+    t->slots = slots;
+    t->arena = arena;
+    t->used = used;
+    t->error += cut;
+}
+
+/* Doubles an exact table; the strings stay where they are in the arena. */
+static void tpl_grow(tpl_table_t *t) {
+    size_t cap = t->cap * 2;
+    tpl_ent_t *slots = calloc(cap, sizeof(*slots));
+    if (!slots) { perror("calloc"); exit(EXIT_FAILURE); }
+    for (size_t i = 0; i < t->cap; ++i) {
+        const tpl_ent_t *e = &t->slots[i];
+        if (e->text) *tpl_find(slots, cap, e->hash, e->text, e->len) = *e;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->cap = cap;
+}
+
+/* Entry for template s, created (and the table pruned or grown first) if
+ * needed. */
+static tpl_ent_t *tpl_get(tpl_table_t *t, uint64_t h, const char *s, uint32_t len) {
+    if (!t->slots) {
+        t->cap = TPL_SLOTS;
+        if (!(t->slots = calloc(t->cap, sizeof(*t->slots)))) { perror("calloc"); exit(EXIT_FAILURE); }
+    }
+    tpl_ent_t *e = tpl_find(t->slots, t->cap, h, s, len);
+    if (e->text) return e;
+    if (t->used >= t->cap / 2) {
+        if (t->exact) tpl_grow(t); else tpl_prune(t);
+        e = tpl_find(t->slots, t->cap, h, s, len);
+    }
+    e->hash = h;
+    e->len = len;
+    e->text = memcpy(arena_alloc(&t->arena, len), s, len);
+    ++t->used;
+    return e;
+}
+
+static void tpl_merge(tpl_table_t *dst, tpl_table_t *src) {
+    dst->evicted += src->evicted;
+    dst->error += src->error;
+    for (size_t i = 0; src->slots && i < src->cap; ++i) {
+        const tpl_ent_t *e = &src->slots[i];
+        if (!e->text) continue;
+        tpl_ent_t *d = tpl_get(dst, e->hash, e->text, e->len);
+        for (int l = 0; l < LVL_COUNT; ++l) d->counts[l] += e->counts[l];
     }
+    free(src->slots);
+    arena_free(&src->arena);
+}
+
+static int cmp_tpl_desc(const void *a, const void *b) {
+    const tpl_ent_t *x = *(const tpl_ent_t *const *)a, *y = *(const tpl_ent_t *const *)b;
+    uint64_t tx = tpl_total(x), ty = tpl_total(y);
+    if (tx != ty) return (tx < ty) - (tx > ty);
+    int c = memcmp(x->text, y->text, x->len < y->len ? x->len : y->len);
+    return c ? c : (x->len > y->len) - (x->len < y->len);
+}
+
+/* ---- fields and group-by -------------------------------------------------
+ * --group-by FIELD counts lines per value of one field (--distinct and
+ * --heavy, below, estimate over one); --where narrows the lines they
+ * see. A field is a key (logfmt key=value or JSON "key": value) or [N],
+ * the Nth [...] token of the line. Values are views into the line,
+ * compared and hashed in place; a key is copied into the table's arena
+ * only the first time it is seen. Each worker groups into its own exact
+ * table, and the tables are merged like the templates. */
+
+typedef struct {
+    const char *name;       /* as given */
+    int bracket;            /* N of [N], or 0 for a key */
+    char *eq, *quoted;      /* "key=" and "\"key\"" */
+    size_t eq_len, quoted_len;
+} field_t;
 
-    
-    pthread_mutex_lock(&aggregate_mutex);
-    add_stats(&aggregate, &ta->local);
-    pthread_mutex_unlock(&aggregate_mutex);
+typedef struct {
+    field_t field;
+    const char *value;
+    size_t len;
+    int negate;             /* FIELD!=VALUE */
+} where_t;
+
+static struct {
+    int on;                 /* any of the three below */
+    field_t key;            /* --group-by */
+    field_t distinct;       /* --distinct */
+    field_t heavy;          /* --heavy */
+    unsigned levels;        /* 1 << LVL_* of the levels --where lets through */
+    where_t *conds;         /* all must hold */
+    size_t nconds;
+} query = { .levels = ~0u };
+
+/* Value of a JSON "key" (quotes included in key): the text inside the
+ * quotes of a string, or a bare number or literal. */
+static inline const char *json_value(const char *ls, const char *le, const char *key,
+                                     size_t klen, size_t *len) {
+    const char *k = memmem(ls, le - ls, key, klen);
+    if (!k) return NULL;
+    const char *p = k + klen, *q;
+    while (p < le && (*p == ' ' || *p == '\t')) ++p;
+    if (p == le || *p++ != ':') return NULL;
+    while (p < le && (*p == ' ' || *p == '\t')) ++p;
+    if (p < le && *p == '"') {
+        ++p;
+        if (!(q = memchr(p, '"', le - p))) return NULL;
+    } else {
+        for (q = p; q < le && *q != ',' && *q != '}' && *q != ' ' && *q != '\t'; ++q) ;
+    }
+    *len = q - p;
+    return p;
+}
 
+/* Value of key= (= included in key) where the key starts the line or
+ * follows a blank; quotes around the value are dropped. */
+static inline const char *logfmt_value(const char *ls, const char *le, const char *key,
+                                       size_t klen, size_t *len) {
+    for (const char *p = ls, *k; (k = memmem(p, le - p, key, klen)); p = k + 1) {
+        if (k > ls && k[-1] != ' ' && k[-1] != '\t') continue;
+        const char *v = k + klen, *q;
+        if (v < le && *v == '"') {
+            ++v;
+            if (!(q = memchr(v, '"', le - v))) return NULL;
+        } else {
+            for (q = v; q < le && *q != ' ' && *q != '\t'; ++q) ;
+        }
+        *len = q - v;
+        return v;
+    }
     return NULL;
 }
 
-static void usage(const char *prog) {
-    fprintf(stderr,
-"Usage: %s -f <logfile> [OPTIONS]\n\n"
-"Options:\n"
-"  -f, --file FILE       Path to log file (required)\n"
-"  -t, --threads N       Number of worker threads (default: 1)\n"
-"  -l, --level LEVEL     Minimum severity to count (INFO, WARN, ERROR, ...)\n"
-"  -h, --help            Show this help and exit\n", prog);
+/* Text inside the nth (from 1) [...] of the line. */
+static inline const char *bracket_value(const char *ls, const char *le, int nth, size_t *len) {
+    for (const char *p = ls; ; --nth) {
+        const char *lb = memchr(p, '[', le - p);
+        const char *rb = lb ? memchr(lb, ']', le - lb) : NULL;
+        if (!rb) return NULL;
+        if (nth == 1) { *len = rb - lb - 1; return lb + 1; }
+        p = rb + 1;
+    }
 }
 
-int main(int argc, char *argv[]) {
-    const char *file_path = NULL;
-    int threads = 1;
-    int min_level = LVL_TRACE;  
+static inline const char *field_value(const field_t *f, const char *ls, const char *le,
+                                      size_t *len) {
+    if (f->bracket) return bracket_value(ls, le, f->bracket, len);
+    const char *v = logfmt_value(ls, le, f->eq, f->eq_len, len);
+    return v ? v : json_value(ls, le, f->quoted, f->quoted_len, len);
+}
 
-    static struct option long_opts[] = {
-        {"file",    required_argument, 0, 'f'},
-        {"threads", required_argument, 0, 't'},
-        {"level",   required_argument, 0, 'l'},
-        {"help",    no_argument,       0, 'h'},
-        {0,0,0,0}
-    };
+static int parse_field(const char *spec, field_t *f) {
+    memset(f, 0, sizeof(*f));
+    f->name = spec;
+    size_t n = strlen(spec);
+    if (n > 2 && spec[0] == '[' && spec[n - 1] == ']') {
+        char *end;
+        long v = strtol(spec + 1, &end, 10);
+        if (end != spec + n - 1 || v < 1 || v > 64) return -1;
+        f->bracket = v;
+        return 0;
+    }
+    if (!n) return -1;
+    for (size_t i = 0; i < n; ++i)
+        if (!is_dig(spec[i]) && !isalpha((unsigned char)spec[i]) && !strchr("_.-@", spec[i]))
+            return -1;
+    f->eq = malloc(n + 2);
+    f->quoted = malloc(n + 3);
+    if (!f->eq || !f->quoted) { perror("malloc"); exit(EXIT_FAILURE); }
+    f->eq_len = sprintf(f->eq, "%s=", spec);
+    f->quoted_len = sprintf(f->quoted, "\"%s\"", spec);
+    return 0;
+}
 
-    int c;
-    while ((c = getopt_long(argc, argv, "f:t:l:h", long_opts, NULL)) != -1) {
-        switch (c) {
-            case 'f': file_path = optarg; break;
-            case 't': threads = atoi(optarg); if (threads < 1) threads = 1; break;
-            case 'l': min_level = str_to_level(optarg); break;
-            case 'h': usage(argv[0]); return EXIT_SUCCESS;
-            default : usage(argv[0]); return EXIT_FAILURE;
+/* level OP NAME (OP one of >= <= > < = == !=), FIELD=VALUE or FIELD!=VALUE. */
+static int parse_where(const char *s) {
+    if (!strncasecmp(s, "level", 5) && s[5] && strchr("<>=!", s[5])) {
+        const char *op = s + 5, *name = op + 1 + (op[1] == '=');
+        int lvl = str_to_level(name);
+        if (lvl == LVL_UNKNOWN) return -1;
+        unsigned mask = 0;
+        for (int l = 0; l < LVL_UNKNOWN; ++l) {
+            int keep = op[0] == '>' ? (op[1] == '=' ? l >= lvl : l > lvl)
+                     : op[0] == '<' ? (op[1] == '=' ? l <= lvl : l < lvl)
+                     : op[0] == '!' ? l != lvl : l == lvl;
+            mask |= (unsigned)keep << l;
         }
+        if (op[0] == '!') mask |= 1u << LVL_UNKNOWN;
+        if (op[0] == '!' && op[1] != '=') return -1;
+        query.levels &= mask;
+        return 0;
     }
 
-    if (!file_path) { usage(argv[0]); return EXIT_FAILURE; }
+    const char *eq = strchr(s, '=');
+    if (!eq || eq == s) return -1;
+    int negate = eq[-1] == '!';
+    char *name = strndup(s, eq - s - negate);
+    if (!name) { perror("strndup"); exit(EXIT_FAILURE); }
+    where_t w = { .value = eq + 1, .len = strlen(eq + 1), .negate = negate };
+    if (parse_field(name, &w.field) != 0) { free(name); return -1; }
+    query.conds = xrealloc(query.conds, (query.nconds + 1) * sizeof(*query.conds));
+    query.conds[query.nconds++] = w;
+    return 0;
+}
 
-    struct sigaction sa = { .sa_handler = on_signal };
-    sigemptyset(&sa.sa_mask);
-    sigaction(SIGINT, &sa, NULL);
+/* ---- sketches ------------------------------------------------------------
+ * --distinct and --heavy answer in fixed memory however many values there
+ * are. --distinct estimates how many distinct values a field takes with
+ * HyperLogLog: 2^hll_bits registers, each holding the longest run of
+ * leading zeros among the hashes routed to it. --heavy finds the most
+ * frequent values with a count-min sketch, CMS_DEPTH rows of width
+ * counters, where a value's estimate is the least of its counters: never
+ * low, and high by at most e / width of the values added with probability
+ * 1 - e^-CMS_DEPTH. A min-heap per worker keeps the values with the
+ * largest estimates, with a hash index from value to heap slot so a
+ * counted line costs O(1) lookups whatever --heavy-top is. Both sketches
+ * are sized from --sketch-error. Every worker fills its own sketch;
+ * merging takes register maxima and counter sums, then pools the heaps
+ * and re-ranks them against the merged counters. */
 
-    int fd = open(file_path, O_RDONLY);
-    if (fd == -1) { perror("open"); return EXIT_FAILURE; }
+#define HLL_BITS_MIN  4
+#define HLL_BITS_MAX  18
+#define CMS_DEPTH     5
+#define CMS_WIDTH_MAX (1u << 24)
+#define HEAVY_TOP_MAX (1 << 20)
 
-    struct stat st;
-    if (fstat(fd, &st) == -1) { perror("fstat"); return EXIT_FAILURE; }
-    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
-        fprintf(stderr, "Invalid file or empty: %s\n", file_path);
-        return EXIT_FAILURE;
+static struct {
+    double error;           /* --sketch-error */
+    int hll_bits;
+    uint32_t width;         /* count-min counters per row, a power of two */
+    int top;                /* --heavy-top */
+    size_t cap;             /* heap entries per worker */
+    size_t slots;           /* heap index cells, a power of two >= 2 * cap */
+} sk = { .error = 0.01, .top = 10 };
+
+typedef struct {
+    uint64_t hash, est;
+    char *key;
+    uint32_t len;
+} hh_ent_t;
+
+typedef struct sketch {
+    uint8_t *hll;           /* NULL without --distinct */
+    uint64_t *cms;          /* NULL without --heavy */
+    uint64_t added;         /* values counted in cms */
+    hh_ent_t *heap;         /* min-heap on est, at most sk.cap */
+    size_t nheap;
+    uint32_t *slot;         /* sk.slots cells, linear probing on hash:
+                             * heap position + 1, 0 when empty */
+} sketch_t;
+
+/* Sizes both sketches so that their error is about sk.error. */
+static void sketch_size(void) {
+    double m = 1.04 / sk.error;
+    sk.hll_bits = HLL_BITS_MIN;
+    while (sk.hll_bits < HLL_BITS_MAX && (double)(1u << sk.hll_bits) < m * m) ++sk.hll_bits;
+    sk.width = 1;
+    while (sk.width < CMS_WIDTH_MAX && sk.width < 2.718281828 / sk.error) sk.width <<= 1;
+    sk.cap = 2 * (size_t)sk.top;
+    sk.slots = 4;
+    while (sk.slots < 2 * sk.cap) sk.slots <<= 1;
+}
+
+static sketch_t *sketch_new(int distinct, int heavy) {
+    sketch_t *s = calloc(1, sizeof(*s));
+    if (!s) { perror("calloc"); exit(EXIT_FAILURE); }
+    if ((distinct && !(s->hll = calloc((size_t)1 << sk.hll_bits, 1))) ||
+        (heavy && (!(s->cms = calloc((size_t)CMS_DEPTH * sk.width, sizeof(*s->cms))) ||
+                   !(s->heap = calloc(sk.cap, sizeof(*s->heap))) ||
+                   !(s->slot = calloc(sk.slots, sizeof(*s->slot)))))) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    return s;
+}
+
+static void sketch_free(sketch_t *s) {
+    if (!s) return;
+    for (size_t i = 0; i < s->nheap; ++i) free(s->heap[i].key);
+    free(s->hll);
+    free(s->cms);
+    free(s->heap);
+    free(s->slot);
+    free(s);
+}
+
+/* FNV-1a mixes its high bits poorly for short keys; HyperLogLog reads them. */
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline void hll_add(uint8_t *hll, uint64_t h) {
+    uint64_t rest = h << sk.hll_bits;
+    uint8_t rank = rest ? __builtin_clzll(rest) + 1 : 64 - sk.hll_bits + 1;
+    uint8_t *r = &hll[h >> (64 - sk.hll_bits)];
+    if (rank > *r) *r = rank;
+}
+
+/* ln(x) for x >= 1 without libm: halve into [1, 2), then the atanh series. */
+static double ln_ge1(double x) {
+    int k = 0;
+    while (x >= 2) { x /= 2; ++k; }
+    double y = (x - 1) / (x + 1), y2 = y * y, t = y, s = 0;
+    for (int i = 1; i < 40; i += 2, t *= y2) s += t / i;
+    return 2 * s + k * 0.69314718055994531;
+}
+
+static double hll_estimate(const uint8_t *hll) {
+    size_t m = (size_t)1 << sk.hll_bits, zeros = 0;
+    double sum = 0;
+    for (size_t i = 0; i < m; ++i) {
+        sum += 1.0 / (double)((uint64_t)1 << hll[i]);
+        zeros += !hll[i];
     }
+    double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    if (e <= 2.5 * m && zeros) e = m * ln_ge1((double)m / zeros);   /* linear counting */
+    return e;
+}
 
-    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (data == MAP_FAILED) { perror("mmap"); return EXIT_FAILURE; }
+/* Counter d of value hash h: double hashing over the two halves of h. */
+static inline size_t cms_cell(uint64_t h, int d) {
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    return (size_t)d * sk.width + ((h1 + (uint32_t)d * h2) & (sk.width - 1));
+}
+
+static uint64_t cms_estimate(const uint64_t *cms, uint64_t h) {
+    uint64_t est = UINT64_MAX;
+    for (int d = 0; d < CMS_DEPTH; ++d)
+        if (cms[cms_cell(h, d)] < est) est = cms[cms_cell(h, d)];
+    return est;
+}
 
-    if (threads > st.st_size / (1 << 20)) threads = st.st_size / (1 << 20) ?: 1; 
+static inline int hh_is(const hh_ent_t *e, uint64_t h, const char *key, size_t len) {
+    return e->hash == h && e->len == len && !memcmp(e->key, key, len);
+}
 
-    pthread_t *tids = calloc(threads, sizeof(*tids));
-    thread_arg_t *args = calloc(threads, sizeof(*args));
-    if (!tids || !args) { perror("calloc"); return EXIT_FAILURE; }
+/* Heap position of a value, or SIZE_MAX if it is not in the heap. */
+static inline size_t hh_find(const sketch_t *s, uint64_t h, const char *key, size_t len) {
+    for (size_t i = h & (sk.slots - 1); s->slot[i]; i = (i + 1) & (sk.slots - 1))
+        if (hh_is(&s->heap[s->slot[i] - 1], h, key, len)) return s->slot[i] - 1;
+    return SIZE_MAX;
+}
 
-    size_t chunk = st.st_size / threads;
-    for (int i = 0; i < threads; ++i) {
-        const char *start = data + i * chunk;
-        const char *end   = (i == threads -1) ? data + st.st_size
-                                             : data + (i + 1) * chunk;
-        if (i != 0) while (start < end && *start != '\n') ++start;
+/* Index cell that points at heap position pos, whose value hashes to h. */
+static inline size_t hh_cell(const sketch_t *s, uint64_t h, size_t pos) {
+    size_t i = h & (sk.slots - 1);
+    while (s->slot[i] != pos + 1) i = (i + 1) & (sk.slots - 1);
+    return i;
+}
 
-        args[i].start = start;
-        args[i].end = end;
-        args[i].min_level = min_level;
-        memset(&args[i].local, 0, sizeof(stats_t));
+static inline void hh_index(sketch_t *s, size_t pos) {
+    size_t i = s->heap[pos].hash & (sk.slots - 1);
+    while (s->slot[i]) i = (i + 1) & (sk.slots - 1);
+    s->slot[i] = pos + 1;
+}
 
-        if (pthread_create(&tids[i], NULL, analyze_chunk, &args[i]) != 0) {
-            perror("pthread_create"); return EXIT_FAILURE; }
+/* Empties cell i, shifting later cells of the same probe run back so no
+ * lookup stops short at the hole. */
+static void hh_unindex(sketch_t *s, size_t i) {
+    size_t mask = sk.slots - 1;
+    for (size_t j = (i + 1) & mask; s->slot[j]; j = (j + 1) & mask) {
+        size_t home = s->heap[s->slot[j] - 1].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            s->slot[i] = s->slot[j];
+            i = j;
+        }
     }
+    s->slot[i] = 0;
+}
 
-    for (int i = 0; i < threads; ++i) pthread_join(tids[i], NULL);
+static void hh_swap(sketch_t *s, size_t a, size_t b) {
+    size_t ca = hh_cell(s, s->heap[a].hash, a), cb = hh_cell(s, s->heap[b].hash, b);
+    s->slot[ca] = b + 1;
+    s->slot[cb] = a + 1;
+    hh_ent_t t = s->heap[a]; s->heap[a] = s->heap[b]; s->heap[b] = t;
+}
 
-    munmap(data, st.st_size);
-    close(fd);
+static void heap_down(sketch_t *s, size_t i) {
+    hh_ent_t *h = s->heap;
+    for (;;) {
+        size_t l = 2 * i + 1, m = i;
+        if (l < s->nheap && h[l].est < h[m].est) m = l;
+        if (l + 1 < s->nheap && h[l + 1].est < h[m].est) m = l + 1;
+        if (m == i) return;
+        hh_swap(s, i, m);
+        i = m;
+    }
+}
 
+static void heap_up(sketch_t *s, size_t i) {
+    while (i && s->heap[(i - 1) / 2].est > s->heap[i].est) {
+        hh_swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
 
-    printf("\n===== loganalyzer SUMMARY =====\n");
-    printf("Total lines analyzed : %zu\n", aggregate.total);
-    printf("  INFO  : %zu\n", aggregate.info);
-    printf("  WARN  : %zu\n", aggregate.warn);
-    printf("  ERROR : %zu\n", aggregate.error);
-    printf("  DEBUG : %zu\n", aggregate.debug);
-    printf("  TRACE : %zu\n", aggregate.trace);
-    printf("  OTHER : %zu\n", aggregate.other);
+static hh_ent_t hh_make(uint64_t h, uint64_t est, const char *key, size_t len) {
+    hh_ent_t e = { .hash = h, .est = est, .len = len, .key = malloc(len ? len : 1) };
+    if (!e.key) { perror("malloc"); exit(EXIT_FAILURE); }
+    memcpy(e.key, key, len);
+    return e;
+}
+
+/* Counts one value; it joins the heap if its estimate beats the smallest. */
+static inline void heavy_add(sketch_t *s, const char *key, size_t len) {
+    uint64_t h = mix64(tpl_hash(key, len)), est = UINT64_MAX;
+    for (int d = 0; d < CMS_DEPTH; ++d) {
+        uint64_t *c = &s->cms[cms_cell(h, d)];
+        if (++*c < est) est = *c;
+    }
+    s->added++;
+    size_t i = hh_find(s, h, key, len);
+    if (i != SIZE_MAX) {
+        s->heap[i].est = est;
+        heap_down(s, i);
+    } else if (s->nheap < sk.cap) {
+        s->heap[s->nheap] = hh_make(h, est, key, len);
+        hh_index(s, s->nheap);
+        heap_up(s, s->nheap++);
+    } else if (est > s->heap[0].est) {
+        hh_unindex(s, hh_cell(s, s->heap[0].hash, 0));
+        free(s->heap[0].key);
+        s->heap[0] = hh_make(h, est, key, len);
+        hh_index(s, 0);
+        heap_down(s, 0);
+    }
+}
+
+static int cmp_hh_asc(const void *a, const void *b) {
+    const hh_ent_t *x = a, *y = b;
+    return (x->est > y->est) - (x->est < y->est);
+}
+
+/* Folds src into dst and frees src. */
+static void sketch_merge(sketch_t *dst, sketch_t *src) {
+    if (!src) return;
+    if (dst->hll)
+        for (size_t i = 0; i < (size_t)1 << sk.hll_bits; ++i)
+            if (src->hll[i] > dst->hll[i]) dst->hll[i] = src->hll[i];
+    if (dst->cms) {
+        for (size_t i = 0; i < (size_t)CMS_DEPTH * sk.width; ++i) dst->cms[i] += src->cms[i];
+        dst->added += src->added;
+
+        /* pool both heaps, re-rank by the merged counters, keep the best;
+         * sorted ascending, the survivors are a valid min-heap */
+        hh_ent_t *all = malloc((dst->nheap + src->nheap + 1) * sizeof(*all));
+        if (!all) { perror("malloc"); exit(EXIT_FAILURE); }
+        size_t n = dst->nheap;
+        memcpy(all, dst->heap, n * sizeof(*all));
+        for (size_t i = 0; i < src->nheap; ++i) {
+            hh_ent_t *e = &src->heap[i];
+            if (hh_find(dst, e->hash, e->key, e->len) != SIZE_MAX) free(e->key);
+            else all[n++] = *e;
+        }
+        src->nheap = 0;
+        for (size_t i = 0; i < n; ++i) all[i].est = cms_estimate(dst->cms, all[i].hash);
+        qsort(all, n, sizeof(*all), cmp_hh_asc);
+        size_t drop = n > sk.cap ? n - sk.cap : 0;
+        for (size_t i = 0; i < drop; ++i) free(all[i].key);
+        dst->nheap = n - drop;
+        memcpy(dst->heap, all + drop, dst->nheap * sizeof(*all));
+        free(all);
+        memset(dst->slot, 0, sk.slots * sizeof(*dst->slot));
+        for (size_t i = 0; i < dst->nheap; ++i) hh_index(dst, i);
+    }
+    sketch_free(src);
+}
+
+/* ---- per-line features ---------------------------------------------------
+ * Anything that needs to look at every line (time filters, histograms,
+ * pattern counts, templates, groups) runs in the scan_lines_fx_*() loops
+ * instead of the counting kernels. Each worker has its own line_fx_t; they
+ * are merged once the workers are done. */
+
+#define HIST_MAX_BUCKETS  (16u << 20)
+
+/* Per-bucket counts over [base, base + len) in units of cfg.bucket. */
+typedef struct {
+    int64_t base;
+    size_t len;
+    uint32_t (*b)[LVL_COUNT];
+    size_t dropped;     /* stamps too far from the rest to keep a bucket */
+} hist_t;
+
+typedef struct line_fx {
+    hist_t hist;
+    size_t untimed;     /* lines skipped by a time window for lack of a stamp */
+    size_t *hits;       /* by pattern: lines containing it */
+    size_t *last;       /* by pattern: line_no of the last hit */
+    size_t line_no;
+    tpl_table_t tpl;
+    tpl_table_t groups; /* --group-by */
+    sketch_t *sketch;   /* --distinct, --heavy */
+} line_fx_t;
+
+static int hist_grow(hist_t *h, int64_t idx) {
+    int64_t lo = idx, hi = idx + 1;
+    if (h->len) {
+        if (h->base < lo) lo = h->base;
+        if (h->base + (int64_t)h->len > hi) hi = h->base + h->len;
+    }
+    if (hi - lo > HIST_MAX_BUCKETS) return -1;
+
+    /* leave slack on the side we are growing towards */
+    size_t want = hi - lo;
+    size_t cap = want + want / 2 + 64;
+    if (cap > HIST_MAX_BUCKETS) cap = HIST_MAX_BUCKETS;
+    int64_t nbase = h->len && idx < h->base ? hi - (int64_t)cap : lo;
+
+    uint32_t (*nb)[LVL_COUNT] = calloc(cap, sizeof(*nb));
+    if (!nb) { perror("calloc"); exit(EXIT_FAILURE); }
+    if (h->len) memcpy(nb + (h->base - nbase), h->b, h->len * sizeof(*nb));
+    free(h->b);
+    h->b = nb;
+    h->base = nbase;
+    h->len = cap;
+    return 0;
+}
+
+static inline int hist_has(const hist_t *h, int64_t idx) {
+    return idx >= h->base && idx < h->base + (int64_t)h->len;
+}
+
+static inline void hist_add(hist_t *h, int64_t t, int lvl, int64_t width) {
+    int64_t idx = (t >= 0 ? t : t - width + 1) / width;
+    if (!hist_has(h, idx) && hist_grow(h, idx) != 0) {
+        h->dropped++;
+        return;
+    }
+    h->b[idx - h->base][lvl]++;
+}
+
+static void hist_merge(hist_t *dst, const hist_t *src) {
+    dst->dropped += src->dropped;
+    if (!src->len) return;
+    int64_t last = src->base + src->len - 1;
+    if ((!hist_has(dst, src->base) && hist_grow(dst, src->base) != 0)
+        || (!hist_has(dst, last) && hist_grow(dst, last) != 0)) {
+        for (size_t i = 0; i < src->len; ++i)
+            for (int l = 0; l < LVL_COUNT; ++l) dst->dropped += src->b[i][l];
+        return;
+    }
+    for (size_t i = 0; i < src->len; ++i)
+        for (int l = 0; l < LVL_COUNT; ++l)
+            dst->b[src->base - dst->base + i][l] += src->b[i][l];
+}
+
+static void fx_init(line_fx_t *fx) {
+    memset(fx, 0, sizeof(*fx));
+    fx->groups.exact = 1;
+    if (query.distinct.name || query.heavy.name)
+        fx->sketch = sketch_new(query.distinct.name != NULL, query.heavy.name != NULL);
+    if (ac.npats) {
+        fx->hits = calloc(ac.npats, sizeof(*fx->hits));
+        fx->last = calloc(ac.npats, sizeof(*fx->last));
+        if (!fx->hits || !fx->last) { perror("calloc"); exit(EXIT_FAILURE); }
+    }
+}
+
+static line_fx_t *fx_new(void) {
+    line_fx_t *fx = malloc(sizeof(*fx));
+    if (!fx) { perror("malloc"); exit(EXIT_FAILURE); }
+    fx_init(fx);
+    return fx;
+}
+
+static void fx_merge(line_fx_t *dst, line_fx_t *src) {
+    if (!src) return;
+    hist_merge(&dst->hist, &src->hist);
+    dst->untimed += src->untimed;
+    for (size_t i = 0; i < ac.npats; ++i) dst->hits[i] += src->hits[i];
+    tpl_merge(&dst->tpl, &src->tpl);
+    tpl_merge(&dst->groups, &src->groups);
+    sketch_merge(dst->sketch, src->sketch);
+    free(src->hist.b);
+    free(src->hits);
+    free(src->last);
+    free(src);
+}
+
+/* What the workers of every scan have merged so far; fx_init()ed in main. */
+static line_fx_t fx_total;
+
+/* Runs the pattern DFA over one line, counting each pattern once per line. */
+static inline void ac_match_line(const char *ls, const char *le, line_fx_t *fx) {
+    const uint32_t *next = ac.next;
+    const uint8_t *cls = ac.cls;
+    uint32_t s = 0;
+    ++fx->line_no;
+    for (const unsigned char *q = (const unsigned char *)ls; q < (const unsigned char *)le; ++q) {
+        uint32_t e = next[s + cls[*q]];
+        s = e & ~AC_OUT;
+        if (e & AC_OUT) {
+            uint32_t st = s / ac.ncls;
+            const uint32_t *id = ac.out_ids + ac.out_start[st];
+            for (uint32_t j = 0; j < ac.out_len[st]; ++j) {
+                if (fx->last[id[j]] == fx->line_no) continue;
+                fx->last[id[j]] = fx->line_no;
+                fx->hits[id[j]]++;
+            }
+        }
+    }
+}
+
+/* Feeds one line to --group-by, --distinct and --heavy if --where lets it
+ * through. */
+static inline void query_line(const char *ls, const char *le, int lvl, line_fx_t *fx) {
+    if (!(query.levels >> lvl & 1)) return;
+    size_t n;
+    for (size_t i = 0; i < query.nconds; ++i) {
+        const where_t *w = &query.conds[i];
+        const char *v = field_value(&w->field, ls, le, &n);
+        if ((v && n == w->len && !memcmp(v, w->value, n)) == w->negate) return;
+    }
+    const char *v;
+    if (query.key.name) {
+        if (!(v = field_value(&query.key, ls, le, &n))) { v = ""; n = 0; }
+        tpl_get(&fx->groups, tpl_hash(v, n), v, n)->counts[lvl]++;
+    }
+    if (query.distinct.name && (v = field_value(&query.distinct, ls, le, &n)))
+        hll_add(fx->sketch->hll, mix64(tpl_hash(v, n)));
+    if (query.heavy.name && (v = field_value(&query.heavy, ls, le, &n)))
+        heavy_add(fx->sketch, v, n);
+}
+
+/* ---- log formats ---------------------------------------------------------
+ * --format picks where a line's level comes from:
+ *   bracket  [INFO] ...                     first [...] tag, as above
+ *   json     {"level":"info", ...}          "level" (or "severity") string
+ *   logfmt   ts=... level=info msg=...      level= or lvl= key, maybe quoted
+ *   syslog   <134>Apr 28 12:00:00 ...       severity from the <PRI> prefix
+ * Each format is an inline line -> level function. DEFINE_FORMAT() expands
+ * the counting loop and the per-line feature loop around it, so the level
+ * code is specialized into each loop at compile time; the format is chosen
+ * once per input and never looked at per line. Bracket input keeps the SIMD
+ * kernels for plain counting. */
+
+enum { FMT_AUTO, FMT_BRACKET, FMT_JSON, FMT_LOGFMT, FMT_SYSLOG, FMT_COUNT };
+
+#define FORMAT_SNIFF  4096      /* bytes looked at by detect_format() */
+#define LEVEL_WORD_MAX  16      /* longer values are never a level name */
+
+/* Level names other formats use besides ours. */
+static const struct {
+    const char *name;
+    int lvl;
+} level_synonyms[] = {
+    { "warning", LVL_WARN }, { "err", LVL_ERROR }, { "fatal", LVL_ERROR },
+    { "crit", LVL_ERROR }, { "critical", LVL_ERROR }, { "panic", LVL_ERROR },
+    { "notice", LVL_INFO }, { "dbg", LVL_DEBUG },
+};
+
+static inline int classify_word(const char *p, size_t len) {
+    int lvl = classify_tag(p, len);
+    if (lvl != LVL_UNKNOWN || len > LEVEL_WORD_MAX) return lvl;
+    for (size_t i = 0; i < sizeof(level_synonyms) / sizeof(level_synonyms[0]); ++i)
+        if (strlen(level_synonyms[i].name) == len && !strncasecmp(p, level_synonyms[i].name, len))
+            return level_synonyms[i].lvl;
+    return LVL_UNKNOWN;
+}
+
+/* Level of one line by the bracket rule, as in scan_scalar(). */
+static inline int bracket_level(const char *ls, const char *le) {
+    const char *lb = memchr(ls, '[', le - ls);
+    if (lb) {
+        const char *rb = memchr(lb, ']', le - lb);
+        if (rb && rb - lb <= 8) return classify_brackets(lb, rb);
+    }
+    return LVL_UNKNOWN;
+}
+
+static inline int json_level(const char *ls, const char *le) {
+    size_t n;
+    const char *v = json_value(ls, le, "\"level\"", 7, &n);
+    if (!v) v = json_value(ls, le, "\"severity\"", 10, &n);
+    return v ? classify_word(v, n) : LVL_UNKNOWN;
+}
+
+static inline int logfmt_level(const char *ls, const char *le) {
+    size_t n;
+    const char *v = logfmt_value(ls, le, "level=", 6, &n);
+    if (!v) v = logfmt_value(ls, le, "lvl=", 4, &n);
+    return v ? classify_word(v, n) : LVL_UNKNOWN;
+}
+
+/* <PRI> is facility * 8 + severity (RFC 3164 / 5424); emerg..err count as
+ * ERROR, notice as INFO. */
+static inline int syslog_level(const char *ls, const char *le) {
+    static const signed char sev[8] = { LVL_ERROR, LVL_ERROR, LVL_ERROR, LVL_ERROR,
+                                        LVL_WARN, LVL_INFO, LVL_INFO, LVL_DEBUG };
+    if (le - ls < 3 || ls[0] != '<') return LVL_UNKNOWN;
+    unsigned pri = 0;
+    const char *p = ls + 1;
+    while (p < le && p - ls <= 3 && is_dig(*p)) pri = pri * 10 + (*p++ - '0');
+    if (p == ls + 1 || p == le || *p != '>' || pri > 191) return LVL_UNKNOWN;
+    return sev[pri & 7];
+}
+
+/* Plain counting with a line loop, for formats without a SIMD kernel. */
+static inline __attribute__((always_inline))
+void count_lines_by(const char *p, const char *end, size_t *counts,
+                    int (*level)(const char *, const char *)) {
+    while (p < end) {
+        if (stop_now) return;
+        const char *ls = p;
+        const char *le = memchr(p, '\n', end - p);
+        if (!le) le = end;
+        p = le < end ? le + 1 : end;
+        counts[level(ls, le)]++;
+    }
+}
+
+static inline __attribute__((always_inline))
+void scan_lines_fx_by(const char *p, const char *end, size_t *counts, line_fx_t *fx,
+                      int (*level)(const char *, const char *)) {
+    const int need_ts = cfg.bucket || cfg.windowed;
+    while (p < end) {
+        if (stop_now) return;
+        const char *ls = p;
+        const char *le = memchr(p, '\n', end - p);
+        if (!le) le = end;
+        p = le < end ? le + 1 : end;
+
+        int lvl = level(ls, le);
+        int64_t t = need_ts ? line_timestamp(ls, le, cfg.syslog_year) : TS_NONE;
+        if (cfg.windowed) {
+            if (t == TS_NONE) { fx->untimed++; continue; }
+            if (t < cfg.since || t >= cfg.until) continue;
+        }
+        counts[lvl]++;
+        if (cfg.bucket && t != TS_NONE) hist_add(&fx->hist, t, lvl, cfg.bucket);
+        if (lvl < cfg.min_level) continue;
+        if (query.on) query_line(ls, le, lvl, fx);
+        if (ac.npats) ac_match_line(ls, le, fx);
+        if (cfg.top_k) {
+            char buf[TPL_MAX];
+            size_t n = tpl_normalize(ls, le, buf);
+            tpl_get(&fx->tpl, tpl_hash(buf, n), buf, n)->counts[lvl]++;
+        }
+    }
+}
+
+#define DEFINE_FORMAT(fmt)                                                     \
+static void scan_##fmt(const char *p, const char *end, size_t *counts,         \
+                       struct line_fx *fx) {                                   \
+    (void)fx;                                                                  \
+    count_lines_by(p, end, counts, fmt##_level);                               \
+}                                                                              \
+static void scan_lines_fx_##fmt(const char *p, const char *end, size_t *counts,\
+                                struct line_fx *fx) {                          \
+    scan_lines_fx_by(p, end, counts, fx, fmt##_level);                         \
+}
+
+DEFINE_FORMAT(bracket)
+DEFINE_FORMAT(json)
+DEFINE_FORMAT(logfmt)
+DEFINE_FORMAT(syslog)
+
+/* Indexed by FMT_*. scan_bracket is unused: bracket counting goes through
+ * kernels[cfg.kernel]. */
+static const struct {
+    const char *name;
+    scan_fn count, lines_fx;
+    int (*level)(const char *, const char *);
+} formats[FMT_COUNT] = {
+    [FMT_AUTO]    = { "auto",    NULL,        NULL,                NULL          },
+    [FMT_BRACKET] = { "bracket", scan_bracket, scan_lines_fx_bracket, bracket_level },
+    [FMT_JSON]    = { "json",    scan_json,   scan_lines_fx_json,   json_level    },
+    [FMT_LOGFMT]  = { "logfmt",  scan_logfmt, scan_lines_fx_logfmt, logfmt_level  },
+    [FMT_SYSLOG]  = { "syslog",  scan_syslog, scan_lines_fx_syslog, syslog_level  },
+};
+
+static int pick_format(const char *name) {
+    for (int f = 0; f < FMT_COUNT; ++f)
+        if (!strcasecmp(name, formats[f].name)) return f;
+    return -1;
+}
+
+/* The format that finds a level on the most complete lines of the first
+ * FORMAT_SNIFF bytes; bracket on a tie or when nothing matches. */
+static int detect_format(const char *p, size_t n) {
+    const char *end = p + (n < FORMAT_SNIFF ? n : FORMAT_SNIFF);
+    size_t hits[FMT_COUNT] = {0};
+    while (p < end) {
+        const char *le = memchr(p, '\n', end - p);
+        if (!le && n >= FORMAT_SNIFF) break;    /* may be cut off */
+        if (!le) le = end;
+        for (int f = FMT_BRACKET; f < FMT_COUNT; ++f)
+            hits[f] += formats[f].level(p, le) != LVL_UNKNOWN;
+        p = le + 1;
+    }
+    int best = FMT_BRACKET;
+    for (int f = FMT_BRACKET + 1; f < FMT_COUNT; ++f)
+        if (hits[f] > hits[best]) best = f;
+    return best;
+}
+
+/* The scan function for one input of format fmt. */
+static scan_fn format_scan(int fmt) {
+    if (cfg.per_line) return formats[fmt].lines_fx;
+    return fmt == FMT_BRACKET ? kernels[cfg.kernel].fn : formats[fmt].count;
+}
+
+/* Makes fmt the format of the inputs scanned with cfg.scan from now on. */
+static void use_format(int fmt) {
+    cfg.scan = format_scan(fmt);
+    cfg.formats_seen |= 1u << fmt;
+}
+
+/* The entries of t, most lines first. */
+static const tpl_ent_t **tpl_sorted(const tpl_table_t *t) {
+    const tpl_ent_t **e = malloc((t->used ? t->used : 1) * sizeof(*e));
+    if (!e) { perror("malloc"); exit(EXIT_FAILURE); }
+    size_t n = 0;
+    for (size_t i = 0; t->slots && i < t->cap; ++i)
+        if (t->slots[i].text) e[n++] = &t->slots[i];
+    qsort(e, n, sizeof(*e), cmp_tpl_desc);
+    return e;
+}
+
+static void print_tpl_header(const char *what) {
+    printf("%10s", "total");
+    for (int l = cfg.min_level; l < LVL_COUNT; ++l) printf(" %8s", level_to_str(l));
+    printf("  %s\n", what);
+}
+
+static void print_tpl_counts(const tpl_ent_t *e) {
+    printf("%10llu", (unsigned long long)tpl_total(e));
+    for (int l = cfg.min_level; l < LVL_COUNT; ++l)
+        printf(" %8llu", (unsigned long long)e->counts[l]);
+}
+
+static void print_templates(const tpl_table_t *t) {
+    const tpl_ent_t **top = tpl_sorted(t);
+    size_t n = t->used < (size_t)cfg.top_k ? t->used : (size_t)cfg.top_k;
+
+    printf("\n===== top %zu templates =====\n", n);
+    print_tpl_header("template");
+    for (size_t i = 0; i < n; ++i) {
+        print_tpl_counts(top[i]);
+        printf("  %.*s%s\n", (int)top[i]->len, top[i]->text, top[i]->len == TPL_MAX ? "..." : "");
+    }
+    printf("(%zu distinct templates kept", t->used);
+    if (t->evicted)
+        printf("; %llu lines of rare templates pruned, counts may be low by up to %llu",
+               (unsigned long long)t->evicted, (unsigned long long)t->error);
+    printf(")\n");
+    free(top);
+}
+
+static void print_groups(const tpl_table_t *t) {
+    const tpl_ent_t **e = tpl_sorted(t);
+    printf("\n===== lines by %s =====\n", query.key.name);
+    print_tpl_header(query.key.name);
+    for (size_t i = 0; i < t->used; ++i) {
+        print_tpl_counts(e[i]);
+        if (e[i]->len) printf("  %.*s\n", (int)e[i]->len, e[i]->text);
+        else printf("  (none)\n");
+    }
+    printf("(%zu distinct values)\n", t->used);
+    free(e);
+}
+
+static int cmp_hh_desc(const void *a, const void *b) {
+    return cmp_hh_asc(b, a);
+}
+
+static void print_sketches(sketch_t *s) {
+    if (s->hll) {
+        /* standard error 1.04 / sqrt(m), m = 2^hll_bits */
+        double root = (double)(1u << sk.hll_bits / 2) * (sk.hll_bits & 1 ? 1.4142135623730951 : 1);
+        printf("\n===== distinct values of %s =====\n", query.distinct.name);
+        printf("~%.0f\n", hll_estimate(s->hll));
+        printf("(HyperLogLog: 2^%d registers, %.1f KB per worker, standard error %.2f%%)\n",
+               sk.hll_bits, (double)(1u << sk.hll_bits) / 1024, 104.0 / root);
+    }
+    if (s->cms) {
+        qsort(s->heap, s->nheap, sizeof(*s->heap), cmp_hh_desc);
+        size_t n = s->nheap < (size_t)sk.top ? s->nheap : (size_t)sk.top;
+        size_t bytes = (size_t)CMS_DEPTH * sk.width * sizeof(*s->cms);
+        printf("\n===== top %zu values of %s =====\n", n, query.heavy.name);
+        printf("%10s  %s\n", "~lines", query.heavy.name);
+        for (size_t i = 0; i < n; ++i)
+            printf("%10llu  %.*s\n", (unsigned long long)s->heap[i].est,
+                   (int)s->heap[i].len, s->heap[i].key);
+        printf("(count-min: %d x %u counters, %.1f KB per worker; estimates are never low "
+               "and at most %.0f high with 99.3%% probability)\n",
+               CMS_DEPTH, sk.width, bytes / 1024.0, 2.718281828 / sk.width * s->added);
+    }
+}
+
+static void print_histogram(const hist_t *h) {
+    const char *unit = cfg.bucket == 1 ? "second" : cfg.bucket == 60 ? "minute"
+                     : cfg.bucket == 3600 ? "hour" : NULL;
+    if (unit) printf("\n===== per-%s histogram =====\n", unit);
+    else      printf("\n===== per-%llds histogram =====\n", (long long)cfg.bucket);
+
+    printf("%-20s", "bucket (UTC)");
+    for (int l = cfg.min_level; l < LVL_COUNT; ++l) printf(" %8s", level_to_str(l));
+    printf("\n");
+
+    for (size_t i = 0; i < h->len; ++i) {
+        uint64_t any = 0;
+        for (int l = cfg.min_level; l < LVL_COUNT; ++l) any |= h->b[i][l];
+        if (!any) continue;
+
+        time_t t = (time_t)((h->base + (int64_t)i) * cfg.bucket);
+        struct tm tm;
+        char when[32];
+        gmtime_r(&t, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        printf("%-20s", when);
+        for (int l = cfg.min_level; l < LVL_COUNT; ++l) printf(" %8u", h->b[i][l]);
+        printf("\n");
+    }
+    if (h->dropped)
+        printf("(%zu lines with outlying timestamps not bucketed)\n", h->dropped);
+}
+
+/* ---- CPU placement -------------------------------------------------------
+ * With --pin, worker i runs on the i-th CPU of an order that alternates
+ * between NUMA nodes, so even a few threads use every socket's memory
+ * bandwidth. Workers allocate their own scratch state once pinned, so it
+ * is first touched, and therefore placed, on their node; their slot, which
+ * the main thread has already written, is migrated there. The layout
+ * comes from /sys; without it (or off Linux) everything is node 0. */
+
+#define MAX_CPUS   1024
+#define MAX_NODES  64
+
+static struct {
+    int ncpus;
+    int cpu[MAX_CPUS];      /* pinning order */
+    int node[MAX_CPUS];     /* node of cpu[i] */
+    int nnodes;
+} topo;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef __linux__
+/* Marks the CPUs of a "0-3,8-11" list as belonging to node. */
+static void parse_cpulist(const char *s, int node, int *node_of) {
+    while (*s) {
+        char *e;
+        long a = strtol(s, &e, 10), b = a;
+        if (e == s) break;
+        if (*e == '-') b = strtol(e + 1, &e, 10);
+        for (long c = a; c <= b && c < MAX_CPUS; ++c) if (c >= 0) node_of[c] = node;
+        s = *e == ',' ? e + 1 : e;
+        if (*s == '\n') break;
+    }
+}
+#endif
+
+/* Fills topo from the CPUs this process may run on. Returns -1 if pinning
+ * is not available here. */
+static int topo_init(void) {
+#ifdef __linux__
+    int node_of[MAX_CPUS] = {0};
+    for (int n = 0; n < MAX_NODES; ++n) {
+        char path[64], buf[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        if (fgets(buf, sizeof(buf), f)) parse_cpulist(buf, n, node_of);
+        fclose(f);
+        if (n >= topo.nnodes) topo.nnodes = n + 1;
+    }
+    if (!topo.nnodes) topo.nnodes = 1;
+
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    int allowed = 0;
+    for (int c = 0; c < MAX_CPUS && c < CPU_SETSIZE; ++c) allowed += CPU_ISSET(c, &set) != 0;
+
+    /* round r takes the r-th allowed CPU of every node in turn */
+    for (int r = 0; topo.ncpus < allowed; ++r) {
+        for (int n = 0; n < topo.nnodes; ++n) {
+            int seen = 0;
+            for (int c = 0; c < MAX_CPUS && c < CPU_SETSIZE; ++c) {
+                if (!CPU_ISSET(c, &set) || node_of[c] != n || seen++ != r) continue;
+                topo.cpu[topo.ncpus] = c;
+                topo.node[topo.ncpus++] = n;
+                break;
+            }
+        }
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/* Gives worker i its CPU and node, before its thread starts. */
+static void place_workers(thread_arg_t *args, int n) {
+    for (int i = 0; i < n; ++i) {
+        args[i].cpu = cfg.pin ? topo.cpu[i % topo.ncpus] : -1;
+        args[i].node = cfg.pin ? topo.node[i % topo.ncpus] : 0;
+    }
+}
+
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE  (1 << 1)
+#endif
+
+/* First thing every worker does: move to its CPU, bring its slot to that
+ * CPU's node, then allocate. */
+static void worker_start(thread_arg_t *ta) {
+#ifdef __linux__
+    if (ta->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(ta->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#ifdef SYS_move_pages
+        if (topo.nnodes > 1) {
+            void *page = ta;
+            int node = ta->node, status;
+            syscall(SYS_move_pages, 0, 1UL, &page, &node, &status, MPOL_MF_MOVE);
+        }
+#endif
+    }
+#endif
+    if (cfg.per_line) ta->fx = fx_new();
+    ta->busy = now_sec();
+}
+
+static void worker_stop(thread_arg_t *ta) {
+    ta->busy = now_sec() - ta->busy;
+}
+
+/* Zeroed worker slots, one page each (see worker_start()). */
+static thread_arg_t *alloc_workers(int n) {
+    void *p;
+    if (posix_memalign(&p, WORKER_ALIGN, (size_t)n * sizeof(thread_arg_t)) != 0) {
+        perror("posix_memalign");
+        exit(EXIT_FAILURE);
+    }
+    memset(p, 0, (size_t)n * sizeof(thread_arg_t));
+    return p;
+}
+
+#define Q_PACK(h, t)  ((uint64_t)(t) << 32 | (uint32_t)(h))
+#define Q_HEAD(q)     ((uint32_t)(q))
+#define Q_TAIL(q)     ((uint32_t)((q) >> 32))
+
+static int queue_pop(thread_arg_t *ta, uint32_t *unit) {
+    uint64_t q = atomic_load(&ta->queue);
+    while (Q_HEAD(q) < Q_TAIL(q)) {
+        if (atomic_compare_exchange_weak(&ta->queue, &q, Q_PACK(Q_HEAD(q) + 1, Q_TAIL(q)))) {
+            *unit = Q_HEAD(q);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Takes the back half of a victim's remaining units. Our own deque is empty
+ * at this point, so nobody else can be touching it. */
+static int queue_steal(thread_arg_t *self, thread_arg_t *victim) {
+    uint64_t q = atomic_load(&victim->queue);
+    while (Q_HEAD(q) < Q_TAIL(q)) {
+        uint32_t h = Q_HEAD(q), t = Q_TAIL(q);
+        uint32_t mid = t - (t - h + 1) / 2;
+        if (atomic_compare_exchange_weak(&victim->queue, &q, Q_PACK(h, mid))) {
+            atomic_store(&self->queue, Q_PACK(mid, t));
+            self->steals++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* First line start at or after off: off itself if it follows a newline. */
+static size_t align_to_line(const char *data, size_t size, size_t off) {
+    if (off == 0 || off >= size) return off < size ? off : size;
+    if (data[off - 1] == '\n') return off;
+    const char *nl = memchr(data + off, '\n', size - off);
+    return nl ? (size_t)(nl - data) + 1 : size;
+}
+
+/* ---- windowed input ------------------------------------------------------
+ * With --memory a file is never mapped whole. A worker maps just the unit
+ * it is about to scan, from its first line start to the first line start
+ * after it, and unmaps it when done, so each worker has at most one unit
+ * mapped and run_pool() sizes the units to fit the budget. The edges are
+ * found with pread, which reads only the bytes around them. --drop-cache
+ * also evicts each finished unit from the page cache. */
+
+/* align_to_line() on an unmapped file. */
+static size_t fd_align_to_line(int fd, size_t size, size_t off) {
+    if (off == 0 || off >= size) return off < size ? off : size;
+    char buf[4096];
+    for (size_t pos = off - 1; pos < size; ) {
+        size_t n = size - pos < sizeof(buf) ? size - pos : sizeof(buf);
+        ssize_t r = pread(fd, buf, n, pos);
+        if (r <= 0) return size;
+        const char *nl = memchr(buf, '\n', r);
+        if (nl) return pos + (nl - buf) + 1;
+        pos += r;
+    }
+    return size;
+}
+
+/* Scans the lines starting in [s, e) of a windowed job; returns the bytes. */
+static size_t scan_window(thread_arg_t *ta, const job_t *job, size_t s, size_t e, size_t *uc) {
+    s = fd_align_to_line(job->fd, job->size, s);
+    e = fd_align_to_line(job->fd, job->size, e);
+    if (s >= e) return 0;
+    size_t base = s & ~(size_t)(sysconf(_SC_PAGESIZE) - 1);
+    char *map = mmap(NULL, e - base, PROT_READ, MAP_PRIVATE, job->fd, base);
+    if (map == MAP_FAILED) { perror("mmap"); exit(EXIT_FAILURE); }
+    madvise(map, e - base, MADV_SEQUENTIAL);
+    job->scan(map + (s - base), map + (e - base), uc, ta->fx);
+    munmap(map, e - base);
+#ifdef POSIX_FADV_DONTNEED
+    if (cfg.drop_cache) posix_fadvise(job->fd, s, e - s, POSIX_FADV_DONTNEED);
+#endif
+    return e - s;
+}
+
+static thread_arg_t *pool_workers;
+static int pool_size;
+static job_t *pool_jobs;
+static size_t pool_njobs;
+static uint32_t *pool_order;    /* deque position -> unit, or NULL for identity */
+
+/* Largest readahead requested for the next job when one starts. */
+#define PREFETCH_MAX  (32u << 20)
+
+static void scan_unit(thread_arg_t *ta, uint32_t g) {
+    if (pool_order) g = pool_order[g];
+
+    /* last job whose first unit is <= g */
+    size_t lo = 0, hi = pool_njobs;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (pool_jobs[mid].first <= g) lo = mid; else hi = mid;
+    }
+    job_t *job = &pool_jobs[lo];
+    uint32_t u = g - job->first;
+
+    /* units are dealt out in file order, so starting a file is a good time
+     * to have the kernel read ahead into the next one */
+    if (u == 0 && lo + 1 < pool_njobs && pool_jobs[lo + 1].data && pool_jobs[lo + 1].size) {
+        const job_t *next = &pool_jobs[lo + 1];
+        size_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t a = (uintptr_t)next->data & ~(uintptr_t)(page - 1);
+        size_t n = next->size < PREFETCH_MAX ? next->size : PREFETCH_MAX;
+        madvise((void *)a, n + ((uintptr_t)next->data - a), MADV_WILLNEED);
+    }
+
+    size_t s = job->begin + (size_t)u * job->unit;
+    size_t e = s + job->unit < job->size ? s + job->unit : job->size;
+    size_t uc[LVL_COUNT] = {0}, bytes;
+    if (job->data) {
+        s = align_to_line(job->data, job->size, s);
+        e = align_to_line(job->data, job->size, e);
+        if (s < e) job->scan(job->data + s, job->data + e, uc, ta->fx);
+        bytes = e - s;
+    } else {
+        bytes = scan_window(ta, job, s, e, uc);
+    }
+    for (int l = 0; l < LVL_COUNT; ++l) {
+        ta->counts[l] += uc[l];
+        atomic_fetch_add_explicit(&job->counts[l], uc[l], memory_order_relaxed);
+    }
+    if (job->unit_counts) memcpy(job->unit_counts[u], uc, sizeof(uc));
+    ta->units++;
+    ta->bytes += bytes;
+}
+
+static void *analyze_chunk(void *arg) {
+    thread_arg_t *ta = (thread_arg_t *)arg;
+    int self = ta - pool_workers;
+    uint32_t u;
+
+    worker_start(ta);
+    for (;;) {
+        while (!stop_now && queue_pop(ta, &u)) scan_unit(ta, u);
+        if (stop_now) break;
+
+        /* prefer victims on our own node */
+        int stolen = 0;
+        for (int pass = 0; pass < (topo.nnodes > 1 ? 2 : 1) && !stolen; ++pass)
+            for (int k = 1; k < pool_size && !stolen; ++k) {
+                thread_arg_t *v = &pool_workers[(self + k) % pool_size];
+                if (pass == 0 && topo.nnodes > 1 && v->node != ta->node) continue;
+                stolen = queue_steal(ta, v);
+            }
+        if (!stolen) break;
+    }
+    worker_stop(ta);
+    return NULL;
+}
+
+#ifdef SYS_move_pages
+/* With workers pinned on more than one node: deals each worker the units
+ * whose first page is already cached on its node, plus an even, in-order
+ * share of those not in memory yet (which it will then fault in on its own
+ * node). Returns the unit order and fills worker i's range of it into
+ * bounds[2i], bounds[2i + 1]; NULL if the kernel cannot tell us. */
+static uint32_t *order_units(const job_t *jobs, size_t njobs, uint32_t nunits,
+                             const thread_arg_t *w, int nw, uint32_t *bounds) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    void **pages = malloc(nunits * sizeof(*pages));
+    int *status = malloc(nunits * sizeof(*status));
+    uint32_t *sorted = malloc(nunits * sizeof(*sorted));
+    uint32_t *order = malloc(nunits * sizeof(*order));
+    if (!pages || !status || !sorted || !order) { perror("malloc"); exit(EXIT_FAILURE); }
+    for (size_t j = 0; j < njobs; ++j)
+        for (uint32_t u = 0; u < jobs[j].nunits; ++u) {
+            uintptr_t a = (uintptr_t)(jobs[j].data + jobs[j].begin + (size_t)u * jobs[j].unit);
+            pages[jobs[j].first + u] = (void *)(a & ~(uintptr_t)(page - 1));
+        }
+    long rc = syscall(SYS_move_pages, 0, (unsigned long)nunits, pages, NULL, status, 0);
+    free(pages);
+    if (rc != 0) {
+        free(status); free(sorted); free(order);
+        return NULL;
+    }
+
+    /* key = node if some worker runs there, else nn ("anyone") */
+    const int nn = topo.nnodes;
+    uint32_t wcount[MAX_NODES + 1] = {0}, start[MAX_NODES + 2] = {0};
+    for (int i = 0; i < nw; ++i) wcount[w[i].node]++;
+    for (uint32_t g = 0; g < nunits; ++g) {
+        int k = status[g] >= 0 && status[g] < nn && wcount[status[g]] ? status[g] : nn;
+        status[g] = k;
+        start[k + 1]++;
+    }
+    for (int k = 0; k <= nn; ++k) start[k + 1] += start[k];
+    uint32_t fill[MAX_NODES + 1];
+    memcpy(fill, start, sizeof(fill));
+    for (uint32_t g = 0; g < nunits; ++g) sorted[fill[status[g]]++] = g;
+    free(status);
+
+    uint32_t pos = 0, rank[MAX_NODES] = {0};
+    for (int i = 0; i < nw; ++i) {
+        int n = w[i].node;
+        uint32_t len = start[n + 1] - start[n], r = rank[n]++;
+        uint32_t any = start[nn + 1] - start[nn];
+        uint32_t a0 = start[n] + (uint64_t)len * r / wcount[n];
+        uint32_t a1 = start[n] + (uint64_t)len * (r + 1) / wcount[n];
+        uint32_t b0 = start[nn] + (uint64_t)any * i / nw;
+        uint32_t b1 = start[nn] + (uint64_t)any * (i + 1) / nw;
+        bounds[2 * i] = pos;
+        memcpy(order + pos, sorted + a0, (a1 - a0) * sizeof(*order));
+        pos += a1 - a0;
+        memcpy(order + pos, sorted + b0, (b1 - b0) * sizeof(*order));
+        pos += b1 - b0;
+        bounds[2 * i + 1] = pos;
+    }
+    free(sorted);
+    return order;
+}
+#endif
+
+/* Splits the jobs into units, deals them out in contiguous runs and waits
+ * for the pool to drain them. Jobs without a unit size share one sized from
+ * their combined length, so a small file is a single unit and a large one
+ * is spread over the pool. Returns the number of workers used. */
+static int run_pool(job_t *jobs, size_t njobs, thread_arg_t *workers, int nworkers,
+                    scan_fn scan) {
+    size_t total = 0;
+    for (size_t j = 0; j < njobs; ++j) total += jobs[j].size - jobs[j].begin;
+    size_t auto_unit = total / ((size_t)nworkers * UNITS_PER_WORKER);
+    if (auto_unit < UNIT_MIN) auto_unit = UNIT_MIN;
+    if (auto_unit > UNIT_MAX) auto_unit = UNIT_MAX;
+    /* windowed units: one mapped per worker must fit the budget */
+    size_t win_unit = cfg.budget / nworkers & ~(size_t)4095;
+    if (win_unit < 4096) win_unit = 4096;
+
+    uint32_t nunits = 0;
+    for (size_t j = 0; j < njobs; ++j) {
+        job_t *job = &jobs[j];
+        size_t unit = job->unit ? job->unit : auto_unit;
+        if (!job->data && !job->unit_counts && cfg.budget && unit > win_unit) unit = win_unit;
+        unit = (unit + 4095) & ~(size_t)4095;
+        job->unit = unit;
+        job->nunits = (job->size - job->begin + unit - 1) / unit;
+        job->first = nunits;
+        nunits += job->nunits;
+        if (!job->scan) job->scan = scan;
+    }
+    if ((uint32_t)nworkers > nunits) nworkers = nunits ? nunits : 1;
+
+    pthread_t *tids = calloc(nworkers, sizeof(*tids));
+    if (!tids) { perror("calloc"); exit(EXIT_FAILURE); }
+
+    pool_workers = workers;
+    pool_size = nworkers;
+    pool_jobs = jobs;
+    pool_njobs = njobs;
+    place_workers(workers, nworkers);
+
+    uint32_t *bounds = calloc(2 * (size_t)nworkers, sizeof(*bounds));
+    if (!bounds) { perror("calloc"); exit(EXIT_FAILURE); }
+    pool_order = NULL;
+#ifdef SYS_move_pages
+    if (cfg.pin && topo.nnodes > 1 && nunits && !cfg.budget)
+        pool_order = order_units(jobs, njobs, nunits, workers, nworkers, bounds);
+#endif
+    for (int i = 0; i < nworkers; ++i) {
+        uint32_t h = pool_order ? bounds[2 * i] : (uint64_t)nunits * i / nworkers;
+        uint32_t t = pool_order ? bounds[2 * i + 1] : (uint64_t)nunits * (i + 1) / nworkers;
+        atomic_init(&workers[i].queue, Q_PACK(h, t));
+        workers[i].scan = scan;
+    }
+    free(bounds);
+    for (int i = 0; i < nworkers; ++i)
+        if (pthread_create(&tids[i], NULL, analyze_chunk, &workers[i]) != 0) {
+            perror("pthread_create"); exit(EXIT_FAILURE); }
+    for (int i = 0; i < nworkers; ++i) pthread_join(tids[i], NULL);
+
+    free(pool_order);
+    pool_order = NULL;
+    free(tids);
+    return nworkers;
+}
+
+typedef struct {
+    int cpu, node;
+    size_t units, steals, bytes;
+    double busy;
+} worker_stat_t;
+
+/* Running totals across every scan pass of one invocation. */
+typedef struct {
+    size_t counts[LVL_COUNT];
+    size_t bytes, units, steals;
+    size_t reused;      /* bytes answered from the sidecar index */
+    int workers;
+    double elapsed;
+    worker_stat_t *per_worker;  /* by worker index, summed over passes */
+    int nper;
+} totals_t;
+
+static void fold_workers(totals_t *tot, const thread_arg_t *args, int n) {
+    if (n > tot->nper) {
+        tot->per_worker = xrealloc(tot->per_worker, n * sizeof(*tot->per_worker));
+        memset(tot->per_worker + tot->nper, 0, (n - tot->nper) * sizeof(*tot->per_worker));
+        tot->nper = n;
+    }
+    for (int i = 0; i < n; ++i) {
+        worker_stat_t *w = &tot->per_worker[i];
+        w->cpu = args[i].cpu;
+        w->node = args[i].node;
+        w->units += args[i].units;
+        w->steals += args[i].steals;
+        w->bytes += args[i].bytes;
+        w->busy += args[i].busy;
+    }
+}
+
+/* Runs prepared jobs on the pool and folds the result into tot.
+ * Returns -1 if the pass was cut short by a signal. */
+static int scan_jobs(job_t *jobs, size_t njobs, totals_t *tot) {
+    thread_arg_t *args = alloc_workers(cfg.threads);
+
+    double t0 = now_sec();
+    int used = run_pool(jobs, njobs, args, cfg.threads, cfg.scan);
+    tot->elapsed += now_sec() - t0;
+
+    for (int i = 0; i < used; ++i) {
+        for (int l = 0; l < LVL_COUNT; ++l) tot->counts[l] += args[i].counts[l];
+        tot->steals += args[i].steals;
+    }
+    fold_workers(tot, args, used);
+    for (int i = 0; i < cfg.threads; ++i) fx_merge(&fx_total, args[i].fx);
+    for (size_t j = 0; j < njobs; ++j) {
+        tot->bytes += jobs[j].size - jobs[j].begin;
+        tot->units += jobs[j].nunits;
+    }
+    if (used > tot->workers) tot->workers = used;
+
+    free(args);
+    return stop_now ? -1 : 0;
+}
+
+/* ---- time-window narrowing -----------------------------------------------
+ * With --since/--until on a mapped file, binary-search the line starts for
+ * the part of the file that can hold matching lines, so a small window of a
+ * large, time-ordered log does not read the rest. The result only has to
+ * contain every match; the per-line loop still checks each line, so anything
+ * doubtful (unstamped regions, unsorted files) is kept. */
+
+#define WINDOW_PROBE_LINES  8
+#define WINDOW_SAMPLES      64
+#define WINDOW_MIN_SPAN     (64u << 10)
+
+/* Timestamp of the first stamped line among the few starting at or after off. */
+static int64_t probe_time(const char *data, size_t size, size_t off) {
+    off = align_to_line(data, size, off);
+    for (int i = 0; i < WINDOW_PROBE_LINES && off < size; ++i) {
+        const char *ls = data + off;
+        const char *le = memchr(ls, '\n', size - off);
+        if (!le) le = data + size;
+        int64_t t = line_timestamp(ls, le, cfg.syslog_year);
+        if (t != TS_NONE) return t;
+        off = le - data + 1;
+    }
+    return TS_NONE;
+}
+
+static void narrow_time_window(const char **data, size_t *size) {
+    const char *d = *data;
+    size_t n = *size;
+    if (n < 4 * WINDOW_MIN_SPAN) return;
+
+    /* only search files whose sampled stamps never go backwards */
+    int64_t prev = INT64_MIN;
+    for (int i = 0; i <= WINDOW_SAMPLES; ++i) {
+        int64_t t = probe_time(d, n, i ? n / WINDOW_SAMPLES * i - 1 : 0);
+        if (t == TS_NONE) continue;
+        if (t < prev) return;
+        prev = t;
+    }
+
+    /* lines before a probe stamped earlier than --since cannot match */
+    size_t lo = 0, hi = n;
+    while (hi - lo > WINDOW_MIN_SPAN) {
+        size_t mid = lo + (hi - lo) / 2;
+        int64_t t = probe_time(d, n, mid);
+        if (t != TS_NONE && t < cfg.since) lo = mid; else hi = mid;
+    }
+    size_t start = align_to_line(d, n, lo);
+
+    /* nor can lines from a probe stamped at or after --until */
+    lo = start;
+    hi = n;
+    while (hi - lo > WINDOW_MIN_SPAN) {
+        size_t mid = lo + (hi - lo) / 2;
+        int64_t t = probe_time(d, n, mid);
+        if (t != TS_NONE && t >= cfg.until) hi = mid; else lo = mid;
+    }
+    size_t end = hi < n ? align_to_line(d, n, hi) : n;
+
+    *data = d + start;
+    *size = end > start ? end - start : 0;
+}
+
+/* Sets job up to scan [off, end) of fd through windows; off must be a
+ * line start. */
+static void window_job(job_t *job, int fd, size_t off, size_t end) {
+    job->fd = fd;
+    job->begin = off;
+    job->size = end;
+    job->unit = cfg.unit;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, off, end - off, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (!cfg.windowed) return;
+
+    /* the search reads a few pages only, so a whole mapping is fine here;
+     * without the address space for one, the window is checked per line */
+    char *map = mmap(NULL, end, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return;
+    const char *data = map + off;
+    size_t size = end - off;
+    narrow_time_window(&data, &size);
+    job->begin = data - map;
+    job->size = job->begin + size;
+    munmap(map, end);
+}
+
+static int scan_mapped(const char *data, size_t size, totals_t *tot) {
+    if (cfg.windowed) narrow_time_window(&data, &size);
+    if (!size) return 0;
+    job_t job = { .data = data, .size = size, .unit = cfg.unit };
+    return scan_jobs(&job, 1, tot);
+}
+
+/* Every unit is read front to back, so ask for aggressive readahead. */
+static void readahead_hint(int fd, void *map, size_t len) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)fd;
+#endif
+    madvise(map, len, MADV_SEQUENTIAL);
+}
+
+/* Maps [off, end) of fd and scans it; off must be a line start. */
+static int scan_fd_range(int fd, off_t off, off_t end, totals_t *tot) {
+    if (end <= off) return 0;
+    if (cfg.budget) {
+        job_t job = {0};
+        window_job(&job, fd, off, end);
+        return job.size > job.begin ? scan_jobs(&job, 1, tot) : 0;
+    }
+    off_t base = off & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+    size_t len = end - base;
+    char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, base);
+    if (map == MAP_FAILED) { perror("mmap"); return -1; }
+    readahead_hint(fd, map, len);
+    int rc = scan_mapped(map + (off - base), end - off, tot);
+    munmap(map, len);
+    return rc;
+}
+
+/* ---- streaming input -----------------------------------------------------
+ * Pipes and other non-seekable inputs cannot be mapped. The calling thread
+ * becomes a reader that fills a fixed ring of large buffers, cuts each one
+ * after its last newline (the remainder is carried into the next buffer)
+ * and queues it; the workers scan whole buffers. Memory stays at
+ * (threads + 2) buffers unless a single line is longer than a buffer. */
+
+#define STREAM_BUF  (8u << 20)
+
+typedef struct stream_buf {
+    char *data;
+    size_t cap, len;
+    struct stream_buf *next;
+} stream_buf_t;
+
+typedef struct stream_src {
+    ssize_t (*read)(struct stream_src *src, char *buf, size_t n);
+    int fd;
+    const char *peek;   /* bytes already read from fd while sniffing */
+    size_t npeek;
+} stream_src_t;
+
+typedef struct stream {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    stream_buf_t *free_list;
+    stream_buf_t *full_head, *full_tail;
+    int eof;
+} stream_t;
+
+static ssize_t fd_read(stream_src_t *src, char *buf, size_t n) {
+    if (src->npeek) {
+        size_t k = src->npeek < n ? src->npeek : n;
+        memcpy(buf, src->peek, k);
+        src->peek += k;
+        src->npeek -= k;
+        return k;
+    }
+    ssize_t r;
+    do r = read(src->fd, buf, n); while (r == -1 && errno == EINTR && !stop_now);
+    return r;
+}
+
+static stream_buf_t *stream_get_free(stream_t *s) {
+    pthread_mutex_lock(&s->lock);
+    while (!s->free_list) pthread_cond_wait(&s->cond, &s->lock);
+    stream_buf_t *b = s->free_list;
+    s->free_list = b->next;
+    pthread_mutex_unlock(&s->lock);
+    b->len = 0;
+    return b;
+}
+
+static void stream_push_full(stream_t *s, stream_buf_t *b) {
+    b->next = NULL;
+    pthread_mutex_lock(&s->lock);
+    if (s->full_tail) s->full_tail->next = b; else s->full_head = b;
+    s->full_tail = b;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void *stream_worker(void *arg) {
+    thread_arg_t *ta = (thread_arg_t *)arg;
+    stream_t *s = ta->stream;
+
+    worker_start(ta);
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->full_head && !s->eof) pthread_cond_wait(&s->cond, &s->lock);
+        stream_buf_t *b = s->full_head;
+        if (b && !(s->full_head = b->next)) s->full_tail = NULL;
+        pthread_mutex_unlock(&s->lock);
+        if (!b) break;
+
+        ta->scan(b->data, b->data + b->len, ta->counts, ta->fx);
+        ta->units++;
+        ta->bytes += b->len;
+
+        pthread_mutex_lock(&s->lock);
+        b->next = s->free_list;
+        s->free_list = b;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    worker_stop(ta);
+    return NULL;
+}
+
+static int scan_stream(stream_src_t *src, totals_t *tot) {
+    int nworkers = cfg.threads;
+    int nbufs = nworkers + 2;
+    stream_t s = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+    stream_buf_t *bufs = calloc(nbufs, sizeof(*bufs));
+    thread_arg_t *args = alloc_workers(nworkers);
+    pthread_t *tids = calloc(nworkers, sizeof(*tids));
+    if (!bufs || !tids) { perror("calloc"); exit(EXIT_FAILURE); }
+    for (int i = 0; i < nbufs; ++i) {
+        bufs[i].cap = STREAM_BUF;
+        if (!(bufs[i].data = malloc(STREAM_BUF))) { perror("malloc"); exit(EXIT_FAILURE); }
+        bufs[i].next = s.free_list;
+        s.free_list = &bufs[i];
+    }
+
+    double t0 = now_sec();
+    int rc = 0, done = 0;
+    stream_buf_t *cur = stream_get_free(&s);
+    if (cfg.format == FMT_AUTO) {
+        /* the workers need the format, so read its sample before they start */
+        while (cur->len < FORMAT_SNIFF) {
+            ssize_t n = src->read(src, cur->data + cur->len, FORMAT_SNIFF - cur->len);
+            if (n < 0) { if (!stop_now) perror("read"); rc = -1; }
+            if (n <= 0) { done = 1; break; }
+            cur->len += n;
+            tot->bytes += n;
+        }
+        use_format(detect_format(cur->data, cur->len));
+    }
+
+    place_workers(args, nworkers);
+    for (int i = 0; i < nworkers; ++i) {
+        args[i].scan = cfg.scan;
+        args[i].stream = &s;
+        if (pthread_create(&tids[i], NULL, stream_worker, &args[i]) != 0) {
+            perror("pthread_create"); exit(EXIT_FAILURE); }
+    }
+
+    while (!done) {
+        ssize_t n = src->read(src, cur->data + cur->len, cur->cap - cur->len);
+        if (n < 0) { if (!stop_now) perror("read"); rc = -1; break; }
+        if (n == 0) break;
+        cur->len += n;
+        tot->bytes += n;
+        if (cur->len < cur->cap) continue;
+
+        size_t cut = cur->len;
+        while (cut > 0 && cur->data[cut - 1] != '\n') --cut;
+        if (cut == 0) {
+            /* one line fills the whole buffer: grow this buffer for it */
+            char *bigger = realloc(cur->data, cur->cap * 2);
+            if (!bigger) { perror("realloc"); exit(EXIT_FAILURE); }
+            cur->data = bigger;
+            cur->cap *= 2;
+            continue;
+        }
+
+        stream_buf_t *next = stream_get_free(&s);
+        size_t carry = cur->len - cut;
+        if (carry > next->cap) {
+            free(next->data);
+            next->cap = cur->cap;
+            if (!(next->data = malloc(next->cap))) { perror("malloc"); exit(EXIT_FAILURE); }
+        }
+        memcpy(next->data, cur->data + cut, carry);
+        next->len = carry;
+        cur->len = cut;
+        stream_push_full(&s, cur);
+        cur = next;
+    }
+    if (cur->len > 0) stream_push_full(&s, cur);
+
+    pthread_mutex_lock(&s.lock);
+    s.eof = 1;
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.lock);
+    for (int i = 0; i < nworkers; ++i) pthread_join(tids[i], NULL);
+    tot->elapsed += now_sec() - t0;
+
+    for (int i = 0; i < nworkers; ++i) {
+        for (int l = 0; l < LVL_COUNT; ++l) tot->counts[l] += args[i].counts[l];
+        tot->units += args[i].units;
+        fx_merge(&fx_total, args[i].fx);
+    }
+    fold_workers(tot, args, nworkers);
+    if (nworkers > tot->workers) tot->workers = nworkers;
+
+    for (int i = 0; i < nbufs; ++i) free(bufs[i].data);
+    free(bufs); free(args); free(tids);
+    return rc || stop_now ? -1 : 0;
+}
+
+static int is_gzip(const unsigned char *p, size_t n) {
+    return n >= 2 && p[0] == 0x1f && p[1] == 0x8b;
+}
+
+#ifdef HAVE_ZLIB
+/* ---- gzip input ----------------------------------------------------------
+ * Compressed logs are inflated in memory and never touch the disk.
+ * A single-member file (or a pipe) is inflated by the stream reader and
+ * scanned by the workers as it is produced. A multi-member file
+ * (concatenated gzip files, pigz --independent, ...) is split at its
+ * members, which are inflated in parallel. */
+
+#define GZ_IN_BUF   (1u << 20)
+#define GZ_OUT_BUF  (4u << 20)
+
+/* Could a gzip member start at p? Magic, deflate method, reserved flag
+ * bits clear. Compressed data can still match by chance. */
+static int gz_header_at(const unsigned char *p, const unsigned char *end) {
+    return end - p >= 10 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && !(p[3] & 0xe0);
+}
+
+typedef struct {
+    stream_src_t base;
+    z_stream z;
+    unsigned char *in;
+    int in_eof;
+    int member_start;   /* between members: bad data is trailing garbage */
+} gz_src_t;
+
+static ssize_t gz_read(stream_src_t *src, char *buf, size_t n) {
+    gz_src_t *g = (gz_src_t *)src;
+    g->z.next_out = (unsigned char *)buf;
+    g->z.avail_out = n;
+
+    while (g->z.avail_out == n) {
+        if (g->z.avail_in == 0 && !g->in_eof) {
+            ssize_t r = fd_read(src, (char *)g->in, GZ_IN_BUF);
+            if (r < 0) return -1;
+            if (r == 0) g->in_eof = 1;
+            g->z.next_in = g->in;
+            g->z.avail_in = r;
+        }
+        if (g->z.avail_in == 0 && g->in_eof) {
+            if (!g->member_start) {
+                fprintf(stderr, "gzip: unexpected end of file\n");
+                return -1;
+            }
+            break;
+        }
+
+        int ret = inflate(&g->z, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            inflateReset(&g->z);
+            g->member_start = 1;
+        } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+            g->member_start = 0;
+        } else if (g->member_start) {
+            fprintf(stderr, "Ignoring trailing garbage after last gzip member\n");
+            g->in_eof = 1;
+            g->z.avail_in = 0;
+        } else {
+            fprintf(stderr, "gzip: %s\n", g->z.msg ? g->z.msg : "corrupt data");
+            return -1;
+        }
+    }
+    return n - g->z.avail_out;
+}
+
+/* Inflates fd as a gzip stream; the first npeek bytes were already read. */
+static int scan_gzip_stream(int fd, const char *peek, size_t npeek, totals_t *tot) {
+    gz_src_t g = { .base = { .read = gz_read, .fd = fd } };
+    if (!(g.in = malloc(GZ_IN_BUF))) { perror("malloc"); exit(EXIT_FAILURE); }
+    if (npeek) memcpy(g.in, peek, npeek);
+    g.z.next_in = g.in;
+    g.z.avail_in = npeek;
+    if (inflateInit2(&g.z, 16 + MAX_WBITS) != Z_OK) {
+        fprintf(stderr, "inflateInit2 failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* src->read now returns inflated bytes, which is all scan_stream sees */
+    int rc = scan_stream(&g.base, tot);
+
+    inflateEnd(&g.z);
+    free(g.in);
+    return rc;
+}
+
+/* A line fragment left over at a member edge. */
+typedef struct {
+    char *data;
+    size_t len, cap;
+} frag_t;
+
+static void frag_append(frag_t *f, const char *p, size_t n) {
+    if (f->len + n > f->cap) {
+        size_t cap = f->cap ? f->cap : 256;
+        while (cap < f->len + n) cap *= 2;
+        if (!(f->data = realloc(f->data, cap))) { perror("realloc"); exit(EXIT_FAILURE); }
+        f->cap = cap;
+    }
+    memcpy(f->data + f->len, p, n);
+    f->len += n;
+}
+
+/* Result of inflating from one candidate member start. Lines wholly
+ * inside the member are counted here; the text before its first newline
+ * (head) and after its last (tail) are stitched to the neighbours later. */
+typedef struct {
+    size_t off, end;
+    int ok, has_nl;
+    size_t counts[LVL_COUNT];
+    size_t out_bytes;
+    frag_t head, tail;
+} gz_member_t;
+
+typedef struct gz_job {
+    const unsigned char *data;
+    size_t size;
+    gz_member_t *members;
+    uint32_t nmembers;
+    _Atomic uint32_t next;
+} gz_job_t;
+
+static void gz_inflate_member(const gz_job_t *job, gz_member_t *m, thread_arg_t *ta, char *out) {
+    z_stream z = {0};
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) return;
+    z.next_in = (unsigned char *)job->data + m->off;
+    z.avail_in = job->size - m->off;
+
+    size_t have = 0;   /* partial last line carried at the front of out */
+    int ret;
+    do {
+        z.next_out = (unsigned char *)out + have;
+        z.avail_out = GZ_OUT_BUF - have;
+        ret = inflate(&z, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) break;
+
+        size_t len = GZ_OUT_BUF - z.avail_out;
+        m->out_bytes += len - have;
+        char *p = out, *end = out + len;
+
+        if (!m->has_nl || m->tail.len) {
+            /* still in the head, or in a line longer than the buffer */
+            frag_t *f = m->has_nl ? &m->tail : &m->head;
+            char *nl = memchr(p, '\n', len);
+            frag_append(f, p, nl ? (size_t)(nl - p) : len);
+            have = 0;
+            if (!nl) continue;
+            if (m->has_nl) ta->scan(f->data, f->data + f->len, m->counts, ta->fx);
+            m->tail.len = 0;
+            m->has_nl = 1;
+            p = nl + 1;
+        }
+
+        char *cut = end;
+        while (cut > p && cut[-1] != '\n') --cut;
+        if (p < cut) ta->scan(p, cut, m->counts, ta->fx);
+        have = end - cut;
+        if (have == GZ_OUT_BUF) {
+            frag_append(&m->tail, out, have);
+            have = 0;
+        } else {
+            memmove(out, cut, have);
+        }
+    } while (ret != Z_STREAM_END && !stop_now);
+
+    if (ret == Z_STREAM_END) {
+        if (m->has_nl) frag_append(&m->tail, out, have);
+        m->end = job->size - z.avail_in;
+        m->ok = 1;
+    }
+    inflateEnd(&z);
+}
+
+static void *gz_worker(void *arg) {
+    thread_arg_t *ta = (thread_arg_t *)arg;
+    gz_job_t *job = ta->gz;
+    worker_start(ta);
+    char *out = malloc(GZ_OUT_BUF);
+    if (!out) { perror("malloc"); exit(EXIT_FAILURE); }
+
+    uint32_t i;
+    while (!stop_now && (i = atomic_fetch_add(&job->next, 1)) < job->nmembers) {
+        gz_inflate_member(job, &job->members[i], ta, out);
+        ta->units++;
+        ta->bytes += job->members[i].out_bytes;
+    }
+    free(out);
+    worker_stop(ta);
+    return NULL;
+}
+
+/* Counts one stitched line; an empty one still counts, as in the kernels. */
+static void count_line(const frag_t *f, size_t *counts) {
+    if (f->len) cfg.scan(f->data, f->data + f->len, counts, &fx_total);
+    else counts[LVL_UNKNOWN]++;
+}
+
+static int scan_gzip_members(const unsigned char *data, size_t size, totals_t *tot) {
+    gz_job_t job = { .data = data, .size = size };
+
+    /* every member start is a candidate; the occasional false hit inside
+     * compressed data fails to inflate or falls off the chain below */
+    uint32_t cap = 64;
+    if (!(job.members = calloc(cap, sizeof(*job.members)))) { perror("calloc"); exit(EXIT_FAILURE); }
+    for (const unsigned char *p = data; (p = memchr(p, 0x1f, size - (p - data))); ++p) {
+        if (!gz_header_at(p, data + size)) continue;
+        if (job.nmembers == cap) {
+            job.members = realloc(job.members, (cap *= 2) * sizeof(*job.members));
+            if (!job.members) { perror("realloc"); exit(EXIT_FAILURE); }
+            memset(job.members + job.nmembers, 0, (cap - job.nmembers) * sizeof(*job.members));
+        }
+        job.members[job.nmembers++].off = p - data;
+    }
+    if (job.nmembers == 0 || job.members[0].off != 0) {
+        fprintf(stderr, "gzip: bad header\n");
+        free(job.members);
+        return -1;
+    }
+
+    if (cfg.format == FMT_AUTO) {
+        char head[FORMAT_SNIFF];
+        z_stream z = {0};
+        size_t n = 0;
+        if (inflateInit2(&z, 16 + MAX_WBITS) == Z_OK) {
+            z.next_in = (unsigned char *)data;
+            z.avail_in = size;
+            z.next_out = (unsigned char *)head;
+            z.avail_out = sizeof(head);
+            inflate(&z, Z_SYNC_FLUSH);
+            n = sizeof(head) - z.avail_out;
+            inflateEnd(&z);
+        }
+        use_format(detect_format(head, n));
+    }
+
+    int nworkers = cfg.threads < (int)job.nmembers ? cfg.threads : (int)job.nmembers;
+    thread_arg_t *args = alloc_workers(nworkers);
+    pthread_t *tids = calloc(nworkers, sizeof(*tids));
+    if (!tids) { perror("calloc"); exit(EXIT_FAILURE); }
+
+    double t0 = now_sec();
+    place_workers(args, nworkers);
+    for (int i = 0; i < nworkers; ++i) {
+        args[i].scan = cfg.scan;
+        args[i].gz = &job;
+        if (pthread_create(&tids[i], NULL, gz_worker, &args[i]) != 0) {
+            perror("pthread_create"); exit(EXIT_FAILURE); }
+    }
+    for (int i = 0; i < nworkers; ++i) pthread_join(tids[i], NULL);
+    for (int i = 0; i < nworkers; ++i) fx_merge(&fx_total, args[i].fx);
+    fold_workers(tot, args, nworkers);
+
+    /* walk the chain of members from offset 0 and stitch their edges */
+    int rc = 0;
+    frag_t pending = {0};
+    for (uint32_t i = 0; !stop_now; ) {
+        gz_member_t *m = &job.members[i];
+        if (!m->ok) {
+            fprintf(stderr, "gzip: corrupt member at offset %zu\n", m->off);
+            rc = -1;
+            break;
+        }
+        for (int l = 0; l < LVL_COUNT; ++l) tot->counts[l] += m->counts[l];
+        tot->bytes += m->out_bytes;
+        tot->units++;
+        frag_append(&pending, m->head.data, m->head.len);
+        if (m->has_nl) {
+            count_line(&pending, tot->counts);
+            pending.len = 0;
+            frag_append(&pending, m->tail.data, m->tail.len);
+        }
+        if (m->end >= size) break;
+
+        uint32_t lo = i + 1, hi = job.nmembers;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (job.members[mid].off < m->end) lo = mid + 1; else hi = mid;
+        }
+        if (lo == job.nmembers || job.members[lo].off != m->end) {
+            fprintf(stderr, "Ignoring trailing garbage after last gzip member\n");
+            break;
+        }
+        i = lo;
+    }
+    if (pending.len) count_line(&pending, tot->counts);
+    tot->elapsed += now_sec() - t0;
+    if (nworkers > tot->workers) tot->workers = nworkers;
+
+    for (uint32_t k = 0; k < job.nmembers; ++k) {
+        free(job.members[k].head.data);
+        free(job.members[k].tail.data);
+    }
+    free(pending.data);
+    free(job.members); free(args); free(tids);
+    return rc || stop_now ? -1 : 0;
+}
+
+/* Chooses between the parallel per-member path and the streaming one. */
+static int scan_gzip_file(int fd, off_t size, totals_t *tot) {
+    if (cfg.threads > 1) {
+        unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) { perror("mmap"); return -1; }
+        size_t members = 0;
+        for (const unsigned char *p = map; members < 2 && (p = memchr(p, 0x1f, size - (p - map))); ++p)
+            members += gz_header_at(p, map + size);
+        int rc = 0;
+        if (members > 1) {
+            madvise(map, size, MADV_WILLNEED);
+            rc = scan_gzip_members(map, size, tot);
+        }
+        munmap(map, size);
+        if (members > 1) return rc;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return scan_gzip_stream(fd, NULL, 0, tot);
+}
+#endif /* HAVE_ZLIB */
+
+/* Offset just past the last newline in [off, size), or off if there is none. */
+static off_t complete_lines_end(int fd, off_t off, off_t size) {
+    char buf[1 << 16];
+    off_t hi = size;
+    while (hi > off) {
+        off_t lo = hi - (off_t)sizeof(buf) > off ? hi - (off_t)sizeof(buf) : off;
+        ssize_t n = pread(fd, buf, hi - lo, lo);
+        if (n <= 0) break;
+        while (n > 0 && buf[n - 1] != '\n') --n;
+        if (n > 0) return lo + n;
+        hi = lo;
+    }
+    return off;
+}
+
+static void print_summary(const size_t *counts) {
+    stats_t sum;
+    counts_to_stats(&sum, counts, cfg.min_level);
+
+    printf("\n===== loganalyzer SUMMARY =====\n");
+    printf("Total lines analyzed : %zu\n", sum.total);
+    printf("  INFO  : %zu\n", sum.info);
+    printf("  WARN  : %zu\n", sum.warn);
+    printf("  ERROR : %zu\n", sum.error);
+    printf("  DEBUG : %zu\n", sum.debug);
+    printf("  TRACE : %zu\n", sum.trace);
+    printf("  OTHER : %zu\n", sum.other);
+    fflush(stdout);
+}
+
+static void print_report(const totals_t *tot) {
+    printf("\n===== scan report =====\n");
+    printf("Kernel               : %s\n",
+           cfg.per_line || cfg.formats_seen != 1u << FMT_BRACKET ? "per-line"
+                                                                : kernels[cfg.kernel].name);
+    printf("Format               :");
+    for (int f = FMT_BRACKET; f < FMT_COUNT; ++f)
+        if (cfg.formats_seen & 1u << f) printf(" %s", formats[f].name);
+    printf("%s\n", cfg.format == FMT_AUTO ? " (auto)" : "");
+    printf("Threads              : %d\n", tot->workers);
+    printf("Work units           : %zu\n", tot->units);
+    printf("Steals               : %zu\n", tot->steals);
+    printf("Bytes scanned        : %zu\n", tot->bytes);
+    if (tot->reused)
+        printf("Bytes from index     : %zu\n", tot->reused);
+    if (ac.npats)
+        printf("Patterns             : %zu (%u states x %u byte classes, %zu KB table)\n",
+               ac.npats, ac.nstates, ac.ncls,
+               (size_t)ac.nstates * ac.ncls * sizeof(*ac.next) >> 10);
+    if (cfg.budget)
+        printf("Memory budget        : %zu MB in per-worker windows%s\n", cfg.budget >> 20,
+               cfg.drop_cache ? ", dropped from cache" : "");
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        printf("Peak RSS             : %.1f MB\n", ru.ru_maxrss / 1024.0);
+    printf("Elapsed              : %.6f s\n", tot->elapsed);
+    printf("Throughput           : %.3f GB/s\n",
+           tot->elapsed > 0 ? tot->bytes / tot->elapsed / 1e9 : 0.0);
+    if (!tot->nper) return;
+
+    printf("\n%6s %4s %4s %8s %7s %10s %9s %8s\n",
+           "worker", "cpu", "node", "units", "steals", "MB", "busy s", "GB/s");
+    for (int i = 0; i < tot->nper; ++i) {
+        const worker_stat_t *w = &tot->per_worker[i];
+        char cpu[16] = "-";
+        if (w->cpu >= 0) snprintf(cpu, sizeof(cpu), "%d", w->cpu);
+        printf("%6d %4s %4d %8zu %7zu %10.1f %9.4f %8.3f\n", i, cpu, w->node, w->units,
+               w->steals, w->bytes / 1e6, w->busy, w->busy > 0 ? w->bytes / w->busy / 1e9 : 0.0);
+    }
+}
+
+static void print_pattern_hits(const size_t *hits) {
+    printf("\n===== pattern hits (lines) =====\n");
+    for (size_t i = 0; i < ac.npats; ++i) printf("%10zu  %s\n", hits[i], ac.pats[i]);
+}
+
+static void print_results(const totals_t *tot) {
+    print_summary(tot->counts);
+    if (cfg.windowed && fx_total.untimed)
+        printf("(%zu lines without a timestamp ignored by --since/--until)\n", fx_total.untimed);
+    if (cfg.bucket) print_histogram(&fx_total.hist);
+    if (ac.npats) print_pattern_hits(fx_total.hits);
+    if (cfg.top_k) print_templates(&fx_total.tpl);
+    if (query.key.name) print_groups(&fx_total.groups);
+    if (fx_total.sketch) print_sketches(fx_total.sketch);
+    if (cfg.report) print_report(tot);
+}
+
+/* ---- checkpoints ---------------------------------------------------------
+ * A small text file recording which file (dev/inode) was being read, the
+ * byte offset of the first line not yet counted, and the raw per-level
+ * counts so far. It is replaced atomically via rename(). */
+
+#define CKPT_MAGIC "loganalyzer-checkpoint 1"
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t offset;
+} ckpt_pos_t;
+
+static int load_checkpoint(const char *path, ckpt_pos_t *pos, size_t *counts) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    char magic[64] = "";
+    unsigned long long dev, ino, off;
+    size_t c[LVL_COUNT];
+    int ok = fgets(magic, sizeof(magic), f) && !strncmp(magic, CKPT_MAGIC, strlen(CKPT_MAGIC))
+          && fscanf(f, " dev %llu ino %llu offset %llu counts", &dev, &ino, &off) == 3;
+    for (int l = 0; ok && l < LVL_COUNT; ++l) ok = fscanf(f, " %zu", &c[l]) == 1;
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Ignoring unreadable checkpoint: %s\n", path);
+        return -1;
+    }
+
+    pos->dev = dev; pos->ino = ino; pos->offset = off;
+    memcpy(counts, c, sizeof(c));
+    return 0;
+}
+
+static void save_checkpoint(const char *path, const ckpt_pos_t *pos, const size_t *counts) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) { perror("checkpoint"); return; }
+
+    fprintf(f, CKPT_MAGIC "\ndev %llu\nino %llu\noffset %llu\ncounts",
+            (unsigned long long)pos->dev, (unsigned long long)pos->ino,
+            (unsigned long long)pos->offset);
+    for (int l = 0; l < LVL_COUNT; ++l) fprintf(f, " %zu", counts[l]);
+    fputc('\n', f);
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) perror("checkpoint");
+}
+
+/* ---- follow mode ---------------------------------------------------------
+ * Keeps the file open and scans only the bytes appended since the last
+ * pass, one complete line at a time. inotify is used purely as a wake-up:
+ * every pass re-checks size (truncation) and what the path now names
+ * (rotation), so missed or coalesced events cannot lose data. */
+
+typedef struct {
+    int ifd;        /* inotify fd, or -1 to fall back to polling */
+    int wd_file;
+} watch_t;
+
+static void watch_file(watch_t *w, const char *path) {
+#ifdef __linux__
+    if (w->ifd == -1) return;
+    if (w->wd_file != -1) inotify_rm_watch(w->ifd, w->wd_file);
+    w->wd_file = inotify_add_watch(w->ifd, path,
+                                   IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB);
+#else
+    (void)w; (void)path;
+#endif
+}
+
+static void watch_init(watch_t *w, const char *path) {
+    w->ifd = -1;
+    w->wd_file = -1;
+#ifdef __linux__
+    w->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->ifd == -1) { perror("inotify_init1"); return; }
+    watch_file(w, path);
+
+    /* the directory watch catches the replacement file after a rotation */
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) strcpy(dir, ".");
+    else if (slash == dir) dir[1] = '\0';
+    else *slash = '\0';
+    inotify_add_watch(w->ifd, dir, IN_CREATE | IN_MOVED_TO);
+#endif
+}
+
+static void watch_wait(watch_t *w, int timeout_ms) {
+#ifdef __linux__
+    if (w->ifd != -1) {
+        struct pollfd pfd = { .fd = w->ifd, .events = POLLIN };
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            char buf[4096];
+            while (read(w->ifd, buf, sizeof(buf)) > 0) ;
+        }
+        return;
+    }
+#endif
+    poll(NULL, 0, timeout_ms < 1000 ? timeout_ms : 1000);
+}
+
+/* The last few bytes before offset, to notice a truncate-and-rewrite that
+ * happened between two passes and left the file longer than before. */
+typedef struct {
+    char bytes[32];
+    size_t len;
+} tail_sig_t;
+
+static void tail_sig_take(tail_sig_t *sig, int fd, off_t offset) {
+    sig->len = offset < (off_t)sizeof(sig->bytes) ? (size_t)offset : sizeof(sig->bytes);
+    if (pread(fd, sig->bytes, sig->len, offset - sig->len) != (ssize_t)sig->len) sig->len = 0;
+}
+
+static int tail_sig_matches(const tail_sig_t *sig, int fd, off_t offset) {
+    char now[sizeof(sig->bytes)];
+    if (sig->len == 0) return 1;
+    return pread(fd, now, sig->len, offset - sig->len) == (ssize_t)sig->len
+        && !memcmp(now, sig->bytes, sig->len);
+}
+
+static int follow_log(const char *path, int fd, off_t offset, totals_t *tot,
+                      const char *ckpt, int interval) {
+    watch_t w;
+    watch_init(&w, path);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) { perror("fstat"); return -1; }
+    ckpt_pos_t pos = { st.st_dev, st.st_ino, offset };
+    tail_sig_t sig;
+    tail_sig_take(&sig, fd, pos.offset);
+
+    size_t printed[LVL_COUNT] = {0};
+    double next_summary = now_sec() + interval;
+
+    while (!stop_now) {
+        if (fstat(fd, &st) == -1) { perror("fstat"); break; }
+        if (st.st_size < pos.offset || !tail_sig_matches(&sig, fd, pos.offset)) {
+            fprintf(stderr, "%s was truncated; restarting at offset 0\n", path);
+            pos.offset = 0;
+            sig.len = 0;
+        }
+
+        off_t end = complete_lines_end(fd, pos.offset, st.st_size);
+        if (end > pos.offset) {
+            if (scan_fd_range(fd, pos.offset, end, tot) != 0) break;
+            pos.offset = end;
+            tail_sig_take(&sig, fd, pos.offset);
+            if (ckpt) save_checkpoint(ckpt, &pos, tot->counts);
+        }
+
+        /* rotated: drain what is left of the old file, then switch over */
+        struct stat pst;
+        if (stat(path, &pst) == 0 && (pst.st_ino != st.st_ino || pst.st_dev != st.st_dev)) {
+            if (fstat(fd, &st) == 0 && scan_fd_range(fd, pos.offset, st.st_size, tot) != 0)
+                break;
+            int nfd = open(path, O_RDONLY);
+            if (nfd == -1) { perror("open"); break; }
+            close(fd);
+            fd = nfd;
+            fprintf(stderr, "%s was rotated; following the new file\n", path);
+            if (fstat(fd, &st) == -1) { perror("fstat"); break; }
+            pos = (ckpt_pos_t){ st.st_dev, st.st_ino, 0 };
+            sig.len = 0;
+            if (ckpt) save_checkpoint(ckpt, &pos, tot->counts);
+            watch_file(&w, path);
+            continue;
+        }
+
+        double now = now_sec();
+        if (now >= next_summary) {
+            if (memcmp(printed, tot->counts, sizeof(printed))) {
+                print_summary(tot->counts);
+                memcpy(printed, tot->counts, sizeof(printed));
+            }
+            next_summary = now + interval;
+        }
+        watch_wait(&w, (int)((next_summary - now) * 1000) + 1);
+    }
+
+    if (w.ifd != -1) close(w.ifd);
+    close(fd);
+    return 0;
+}
+
+/* ---- sidecar index -------------------------------------------------------
+ * FILE.laidx holds raw level counts for every 64 KB block of FILE (lines
+ * counted in the block holding their first byte) plus the offset of the
+ * first line starting in each block. A block is written only once every
+ * line starting in it has ended, so an appended file keeps its old
+ * entries and only the tail is scanned again.
+ *
+ *   header | entry[0] | entry[1] | ... | entry[nblocks - 1]
+ */
+
+#define IDX_MAGIC    "LAIDX\0\0"
+#define IDX_VERSION  2
+#define IDX_BLOCK    (64u << 10)
+
+#ifdef __APPLE__
+  #define ST_MTIME_NS(st) ((uint64_t)(st).st_mtimespec.tv_sec * 1000000000u + (st).st_mtimespec.tv_nsec)
+#else
+  #define ST_MTIME_NS(st) ((uint64_t)(st).st_mtim.tv_sec * 1000000000u + (st).st_mtim.tv_nsec)
+#endif
+
+typedef struct {
+    char magic[8];
+    uint32_t version, block;
+    uint64_t dev, ino, size, mtime_ns;
+    uint64_t nblocks;                /* complete entries that follow */
+    uint64_t stable;                 /* end of the last complete line */
+    uint64_t tail_counts[LVL_COUNT]; /* lines from block nblocks on, at this size */
+    uint32_t format;                 /* FMT_* the counts were taken with */
+    uint32_t sig_len;
+    char sig[32];                    /* bytes just before 'stable' */
+} idx_header_t;
+
+typedef struct {
+    uint64_t first_line;
+    uint32_t counts[LVL_COUNT];
+} idx_entry_t;
+
+/* Answers from (and refreshes) path's index. Falls back to a full rebuild
+ * when the index is missing, stale or for a different file. */
+static int index_scan(int fd, const struct stat *st, const char *path, int fmt, totals_t *tot) {
+    int ifd = open(path, O_RDWR | O_CREAT, 0644);
+    if (ifd == -1) { perror(path); return -1; }
+
+    idx_header_t h;
+    uint64_t from = 0;   /* first block to (re)scan */
+    int ok = pread(ifd, &h, sizeof(h), 0) == sizeof(h)
+          && !memcmp(h.magic, IDX_MAGIC, sizeof(h.magic))
+          && h.version == IDX_VERSION && h.block == IDX_BLOCK && h.format == (uint32_t)fmt
+          && h.dev == (uint64_t)st->st_dev && h.ino == (uint64_t)st->st_ino
+          && h.size <= (uint64_t)st->st_size;
+    if (ok) {
+        tail_sig_t sig = { .len = h.sig_len };
+        memcpy(sig.bytes, h.sig, sizeof(sig.bytes));
+        ok = h.sig_len <= sizeof(h.sig) && tail_sig_matches(&sig, fd, h.stable);
+    }
+
+    size_t counts[LVL_COUNT] = {0};
+    if (ok) {
+        idx_entry_t buf[1024];
+        for (uint64_t b = 0; b < h.nblocks; ) {
+            size_t n = h.nblocks - b < 1024 ? h.nblocks - b : 1024;
+            if (pread(ifd, buf, n * sizeof(*buf), sizeof(h) + b * sizeof(*buf))
+                    != (ssize_t)(n * sizeof(*buf))) { ok = 0; break; }
+            for (size_t i = 0; i < n; ++i)
+                for (int l = 0; l < LVL_COUNT; ++l) counts[l] += buf[i].counts[l];
+            b += n;
+        }
+    }
+    if (ok && h.size == (uint64_t)st->st_size && h.mtime_ns == ST_MTIME_NS(*st)) {
+        for (int l = 0; l < LVL_COUNT; ++l) tot->counts[l] += counts[l] + h.tail_counts[l];
+        tot->reused += h.size;
+        close(ifd);
+        return 0;
+    }
+    if (ok) {
+        from = h.nblocks;
+    } else {
+        memset(counts, 0, sizeof(counts));
+        if (ftruncate(ifd, 0) == -1) { perror(path); close(ifd); return -1; }
+    }
+
+    /* scan [from * IDX_BLOCK, size) with one unit per block; map one page
+     * early so the first block can tell whether it starts mid-line */
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = from * IDX_BLOCK;
+    size_t base = start && !cfg.budget ? start - page : 0;
+    size_t len = st->st_size - base;
+    char *map = len && !cfg.budget ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, base) : NULL;
+    if (map == MAP_FAILED) { perror("mmap"); close(ifd); return -1; }
+
+    uint32_t nunits = (st->st_size - start + IDX_BLOCK - 1) / IDX_BLOCK;
+    job_t job = { .data = map, .fd = fd, .size = len, .begin = start - base, .unit = IDX_BLOCK };
+    job.unit_counts = calloc(nunits ? nunits : 1, sizeof(*job.unit_counts));
+    if (!job.unit_counts) { perror("calloc"); exit(EXIT_FAILURE); }
+    int rc = scan_jobs(&job, 1, tot);
+    tot->reused += start;
+    for (int l = 0; l < LVL_COUNT; ++l) tot->counts[l] += counts[l];
+
+    if (rc == 0) {
+        uint64_t stable = complete_lines_end(fd, ok ? h.stable : 0, st->st_size);
+        uint64_t nblocks = stable / IDX_BLOCK;
+        if (nblocks < from) nblocks = from;
+
+        idx_header_t nh = { .version = IDX_VERSION, .block = IDX_BLOCK, .format = fmt,
+                            .dev = st->st_dev, .ino = st->st_ino, .size = st->st_size,
+                            .mtime_ns = ST_MTIME_NS(*st), .nblocks = nblocks, .stable = stable };
+        memcpy(nh.magic, IDX_MAGIC, sizeof(nh.magic));
+        tail_sig_t sig;
+        tail_sig_take(&sig, fd, stable);
+        nh.sig_len = sig.len;
+        memcpy(nh.sig, sig.bytes, sizeof(nh.sig));
+
+        idx_entry_t *ent = calloc(nblocks - from + 1, sizeof(*ent));
+        if (!ent) { perror("calloc"); exit(EXIT_FAILURE); }
+        for (uint32_t u = 0; u < nunits; ++u) {
+            if (from + u < nblocks) {
+                size_t off = job.begin + (size_t)u * IDX_BLOCK;
+                ent[u].first_line = base + (map ? align_to_line(map, len, off)
+                                                : fd_align_to_line(fd, len, off));
+                for (int l = 0; l < LVL_COUNT; ++l) ent[u].counts[l] = job.unit_counts[u][l];
+            } else {
+                for (int l = 0; l < LVL_COUNT; ++l) nh.tail_counts[l] += job.unit_counts[u][l];
+            }
+        }
+        /* entries first, header last: a torn update leaves the old header
+         * describing entries that are still intact */
+        size_t nent = nblocks - from;
+        if (pwrite(ifd, ent, nent * sizeof(*ent), sizeof(nh) + from * sizeof(*ent))
+                != (ssize_t)(nent * sizeof(*ent))
+            || pwrite(ifd, &nh, sizeof(nh), 0) != sizeof(nh))
+            perror(path);
+        free(ent);
+    }
+
+    free(job.unit_counts);
+    if (map) munmap(map, len);
+    close(ifd);
+    return rc;
+}
+
+/* ---- multiple inputs -----------------------------------------------------
+ * Several files (globs expanded, directories walked) are mapped a batch at
+ * a time and handed to a single pool run. Their units are dealt out in
+ * file order, so small files are scanned side by side and large ones are
+ * split across the pool just as a lone file would be. gzip files go
+ * through their own decoder pool, one file at a time. */
+
+#define FILES_PER_BATCH  256
+
+typedef struct {
+    char **paths;
+    size_t n, cap;
+} path_list_t;
+
+typedef struct {
+    const char *path;
+    size_t counts[LVL_COUNT];
+    int failed;
+} file_result_t;
+
+static void path_add(path_list_t *l, const char *path) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? 2 * l->cap : 16;
+        l->paths = xrealloc(l->paths, l->cap * sizeof(*l->paths));
+    }
+    if (!(l->paths[l->n++] = strdup(path))) { perror("strdup"); exit(EXIT_FAILURE); }
+}
+
+/* Hidden entries and our own sidecars are never log input. */
+static int skip_dir_entry(const char *name) {
+    size_t n = strlen(name);
+    return name[0] == '.' || (n > 6 && !strcmp(name + n - 6, ".laidx"));
+}
+
+enum { FROM_ARG, FROM_GLOB, FROM_DIR };
+
+/* Adds path, or every match if it is a glob, or every regular file below
+ * it (in name order, not following symlinked directories) if it is a
+ * directory. */
+static int add_inputs(path_list_t *l, const char *path, int from) {
+    if (from == FROM_ARG && strpbrk(path, "*?[")) {
+        glob_t g;
+        int rc = glob(path, 0, NULL, &g);
+        if (rc != 0) {
+            fprintf(stderr, "%s: %s\n", path, rc == GLOB_NOMATCH ? "no matches" : "glob failed");
+            return -1;
+        }
+        rc = 0;
+        for (size_t i = 0; i < g.gl_pathc; ++i)
+            if (add_inputs(l, g.gl_pathv[i], FROM_GLOB) != 0) rc = -1;
+        globfree(&g);
+        return rc;
+    }
+
+    struct stat st;
+    if ((from == FROM_DIR ? lstat(path, &st) : stat(path, &st)) == -1) { perror(path); return -1; }
+    if (from == FROM_DIR && S_ISLNK(st.st_mode)) {
+        /* symlinked files are fine, symlinked directories could loop */
+        if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        if (from == FROM_DIR && !S_ISREG(st.st_mode)) return 0;
+        path_add(l, path);
+        return 0;
+    }
+
+    struct dirent **ents;
+    int n = scandir(path, &ents, NULL, alphasort);
+    if (n < 0) { perror(path); return -1; }
+    int rc = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!skip_dir_entry(ents[i]->d_name)) {
+            char sub[PATH_MAX];
+            snprintf(sub, sizeof(sub), "%s%s%s", path,
+                     path[strlen(path) - 1] == '/' ? "" : "/", ents[i]->d_name);
+            if (add_inputs(l, sub, FROM_DIR) != 0) rc = -1;
+        }
+        free(ents[i]);
+    }
+    free(ents);
+    return rc;
+}
+
+/* Maps one batch of files and scans them in a single pool run. */
+static void scan_file_batch(file_result_t *res, size_t n, totals_t *tot) {
+    job_t *jobs = calloc(n, sizeof(*jobs));
+    char **maps = calloc(n, sizeof(*maps));
+    size_t *lens = calloc(n, sizeof(*lens)), *owner = calloc(n, sizeof(*owner));
+    if (!jobs || !maps || !lens || !owner) { perror("calloc"); exit(EXIT_FAILURE); }
+
+    size_t njobs = 0;
+    for (size_t i = 0; i < n && !stop_now; ++i) {
+        struct stat st;
+        int fd = open(res[i].path, O_RDONLY);
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            perror(res[i].path);
+            res[i].failed = 1;
+            if (fd != -1) close(fd);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+            if (!S_ISREG(st.st_mode)) {
+                fprintf(stderr, "%s: not a regular file\n", res[i].path);
+                res[i].failed = 1;
+            }
+            close(fd);
+            continue;
+        }
+
+        unsigned char magic[2];
+        if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && is_gzip(magic, sizeof(magic))) {
+#ifdef HAVE_ZLIB
+            size_t before[LVL_COUNT];
+            memcpy(before, tot->counts, sizeof(before));
+            scan_gzip_file(fd, st.st_size, tot);
+            for (int l = 0; l < LVL_COUNT; ++l) res[i].counts[l] = tot->counts[l] - before[l];
+#else
+            fprintf(stderr, "%s: gzip input needs a build with -DHAVE_ZLIB -lz\n", res[i].path);
+            res[i].failed = 1;
+#endif
+            close(fd);
+            continue;
+        }
+
+        job_t *job = &jobs[njobs];
+        if (cfg.format == FMT_AUTO) {
+            char head[FORMAT_SNIFF];
+            ssize_t r = pread(fd, head, sizeof(head), 0);
+            int fmt = detect_format(head, r > 0 ? r : 0);
+            job->scan = format_scan(fmt);
+            cfg.formats_seen |= 1u << fmt;
+        }
+        if (cfg.budget) {
+            /* windowed: the pool reads through fd, closed below */
+            window_job(job, fd, 0, st.st_size);
+            owner[njobs++] = i;
+            continue;
+        }
+
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror(res[i].path);
+            res[i].failed = 1;
+            close(fd);
+            job->scan = NULL;
+            continue;
+        }
+        readahead_hint(fd, map, st.st_size);
+        close(fd);
+
+        job->data = map;
+        job->size = st.st_size;
+        job->unit = cfg.unit;
+        if (cfg.windowed) narrow_time_window(&job->data, &job->size);
+        maps[njobs] = map;
+        lens[njobs] = st.st_size;
+        owner[njobs++] = i;
+    }
+
+    if (njobs && !stop_now) scan_jobs(jobs, njobs, tot);
+    for (size_t j = 0; j < njobs; ++j) {
+        for (int l = 0; l < LVL_COUNT; ++l) res[owner[j]].counts[l] = jobs[j].counts[l];
+        if (maps[j]) munmap(maps[j], lens[j]);
+        else close(jobs[j].fd);
+    }
+    free(jobs);
+    free(maps);
+    free(lens);
+    free(owner);
+}
+
+/* Scans every file in l, filling one result per file. Returns -1 if any
+ * file could not be read or the run was interrupted. */
+static int scan_files(const path_list_t *l, file_result_t *res, totals_t *tot) {
+    for (size_t i = 0; i < l->n; ++i) res[i].path = l->paths[i];
+    for (size_t b = 0; b < l->n && !stop_now; b += FILES_PER_BATCH)
+        scan_file_batch(res + b, l->n - b < FILES_PER_BATCH ? l->n - b : FILES_PER_BATCH, tot);
+
+    int rc = stop_now ? -1 : 0;
+    for (size_t i = 0; i < l->n; ++i) if (res[i].failed) rc = -1;
+    return rc;
+}
+
+static void print_file_results(const file_result_t *res, size_t n) {
+    printf("\n===== per-file totals =====\n");
+    printf("%10s %8s %8s %8s %8s %8s %8s  %s\n",
+           "lines", "INFO", "WARN", "ERROR", "DEBUG", "TRACE", "OTHER", "file");
+    for (size_t i = 0; i < n; ++i) {
+        if (res[i].failed) {
+            printf("%10s %8s %8s %8s %8s %8s %8s  %s\n", "-", "-", "-", "-", "-", "-", "-", res[i].path);
+            continue;
+        }
+        stats_t st;
+        counts_to_stats(&st, res[i].counts, cfg.min_level);
+        printf("%10zu %8zu %8zu %8zu %8zu %8zu %8zu  %s\n", st.total, st.info, st.warn,
+               st.error, st.debug, st.trace, st.other, res[i].path);
+    }
+}
+
+/* Parses a --since/--until argument; see usage(). */
+static int64_t parse_time_arg(const char *s) {
+    const char *end = s + strlen(s);
+    if (*s == '@') {
+        char *e;
+        long long v = strtoll(s + 1, &e, 10);
+        return e != s + 1 && !*e ? v : TS_NONE;
+    }
+    if (end - s == 10 && s[4] == '-' && s[7] == '-') {
+        char full[32];
+        snprintf(full, sizeof(full), "%sT00:00:00", s);
+        return parse_iso(full, full + strlen(full));
+    }
+    return line_timestamp(s, end, cfg.syslog_year);
+}
+
+static int64_t parse_bucket(const char *s) {
+    if (!strcasecmp(s, "sec") || !strcasecmp(s, "second")) return 1;
+    if (!strcasecmp(s, "min") || !strcasecmp(s, "minute")) return 60;
+    if (!strcasecmp(s, "hour")) return 3600;
+    char *e;
+    long long v = strtoll(s, &e, 10);
+    return e != s && !*e && v > 0 ? v : 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+"Usage: %s [OPTIONS] -f <logfile> [FILE | DIR | 'GLOB']...\n\n"
+"Options:\n"
+"  -f, --file FILE       Path to log file (required); '-' or a pipe is read as a\n"
+"                        stream through a bounded ring of buffers. May be given\n"
+"                        more than once; further files, directories (walked\n"
+"                        recursively) and quoted globs may follow the options.\n"
+"                        Several inputs share one pool and get per-file totals\n"
+"  -t, --threads N       Number of worker threads (default: 1)\n"
+"  -u, --unit KB         Work unit size in KB (default: sized from file and threads)\n"
+"  -l, --level LEVEL     Minimum severity to count (INFO, WARN, ERROR, ...)\n"
+"  -k, --kernel NAME     Scan kernel: auto, avx512, avx2, sse2, scalar (default: auto)\n"
+"      --format FMT      Where the level is read from: auto (default, picked per\n"
+"                        input from its first 4 KB), bracket ([INFO] ...), json\n"
+"                        (\"level\" or \"severity\"), logfmt (level= or lvl=) or\n"
+"                        syslog (<PRI> severity)\n"
+"  -r, --report          Print scan kernel and throughput after the summary\n"
+"  -F, --follow          Keep running and analyze lines as they are appended;\n"
+"                        follows truncation and rename-based rotation\n"
+"  -i, --interval SEC    Summary period in follow mode (default: 10)\n"
+"  -c, --checkpoint FILE Resume from and save offset and counts to FILE; only\n"
+"                        complete (newline-terminated) lines are counted\n"
+"  -x, --index           Keep per-block counts in FILE.laidx; later runs on an\n"
+"                        unchanged or appended file read them instead of rescanning\n"
+"  -b, --bucket WIDTH    Print a per-level histogram over time; WIDTH is sec,\n"
+"                        min, hour or a number of seconds\n"
+"      --since TIME      Only count lines stamped at or after TIME\n"
+"      --until TIME      Only count lines stamped before TIME; TIME is ISO-8601\n"
+"                        (2025-04-28, 2025-04-28T12:00:00[Z|+hh:mm]), syslog\n"
+"                        (Apr 28 12:00:00) or @UNIX-SECONDS, UTC unless zoned\n"
+"  -p, --patterns FILE   Also count the lines containing each string in FILE\n"
+"                        (one per line, case-sensitive), all in the same pass\n"
+"  -T, --templates K     Print the K most frequent message shapes (numbers, hex\n"
+"                        ids, IPv4 addresses and quoted strings masked)\n"
+"      --group-by FIELD  Count lines per value of FIELD: a key (key=value or JSON\n"
+"                        \"key\": value) or [N], the Nth [...] token of the line\n"
+"      --where COND      Only query lines where COND holds: level>=warn (also >,\n"
+"                        <=, <, =, !=) or FIELD=VALUE, FIELD!=VALUE; repeat to\n"
+"                        require several\n"
+"      --distinct FIELD  Estimate the number of distinct values of FIELD\n"
+"                        (HyperLogLog, fixed memory)\n"
+"      --heavy FIELD     Estimate the most frequent values of FIELD (count-min\n"
+"                        sketch, fixed memory)\n"
+"      --heavy-top K     Values printed by --heavy (default: 10)\n"
+"      --sketch-error E  Relative error the sketches are sized for (default:\n"
+"                        0.01); smaller costs more memory\n"
+"      --memory MB       Never map more than about MB of input at once: each\n"
+"                        worker maps only the unit it is scanning (plus the\n"
+"                        rest of its last line). For logs larger than RAM\n"
+"      --drop-cache      With --memory, drop each scanned unit from the page\n"
+"                        cache so a big scan does not evict everything else\n"
+"  -P, --pin             Pin workers to CPUs, alternating between NUMA nodes, and\n"
+"                        deal each worker the units cached on its own node\n"
+"  -h, --help            Show this help and exit\n\n"
+"Timestamps are read from the start of each line (ISO-8601 or syslog, optionally\n"
+"inside '['); lines without one are never bucketed and never match a window.\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    path_list_t inputs = {0};
+    const char *file_path = NULL;
+    const char *kernel_name = NULL;
+    const char *ckpt_path = NULL;
+    const char *patterns_path = NULL;
+    int follow = 0;
+    int use_index = 0;
+    int have_where = 0;
+    int interval = 10;
+
+    time_t now = time(NULL);
+    struct tm now_tm;
+    gmtime_r(&now, &now_tm);
+    cfg.syslog_year = now_tm.tm_year + 1900;
+
+    enum { OPT_SINCE = 256, OPT_UNTIL, OPT_FORMAT, OPT_GROUP_BY, OPT_WHERE,
+           OPT_DISTINCT, OPT_HEAVY, OPT_HEAVY_TOP, OPT_SKETCH_ERROR,
+           OPT_MEMORY, OPT_DROP_CACHE };
+    static struct option long_opts[] = {
+        {"file",       required_argument, 0, 'f'},
+        {"threads",    required_argument, 0, 't'},
+        {"unit",       required_argument, 0, 'u'},
+        {"level",      required_argument, 0, 'l'},
+        {"kernel",     required_argument, 0, 'k'},
+        {"report",     no_argument,       0, 'r'},
+        {"follow",     no_argument,       0, 'F'},
+        {"interval",   required_argument, 0, 'i'},
+        {"checkpoint", required_argument, 0, 'c'},
+        {"index",      no_argument,       0, 'x'},
+        {"bucket",     required_argument, 0, 'b'},
+        {"patterns",   required_argument, 0, 'p'},
+        {"templates",  required_argument, 0, 'T'},
+        {"pin",        no_argument,       0, 'P'},
+        {"since",      required_argument, 0, OPT_SINCE},
+        {"until",      required_argument, 0, OPT_UNTIL},
+        {"format",     required_argument, 0, OPT_FORMAT},
+        {"group-by",   required_argument, 0, OPT_GROUP_BY},
+        {"where",      required_argument, 0, OPT_WHERE},
+        {"distinct",   required_argument, 0, OPT_DISTINCT},
+        {"heavy",      required_argument, 0, OPT_HEAVY},
+        {"heavy-top",  required_argument, 0, OPT_HEAVY_TOP},
+        {"sketch-error", required_argument, 0, OPT_SKETCH_ERROR},
+        {"memory",     required_argument, 0, OPT_MEMORY},
+        {"drop-cache", no_argument,       0, OPT_DROP_CACHE},
+        {"help",       no_argument,       0, 'h'},
+        {0,0,0,0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "f:t:u:l:k:rFi:c:xb:p:T:Ph", long_opts, NULL)) != -1) {
+        switch (c) {
+            case 'f': path_add(&inputs, optarg); break;
+            case 't': cfg.threads = atoi(optarg); if (cfg.threads < 1) cfg.threads = 1; break;
+            case 'u': cfg.unit = (size_t)strtoul(optarg, NULL, 10) << 10; break;
+            case 'l': cfg.min_level = str_to_level(optarg); break;
+            case 'k': kernel_name = optarg; break;
+            case 'r': cfg.report = 1; break;
+            case 'F': follow = 1; break;
+            case 'i': interval = atoi(optarg); if (interval < 1) interval = 1; break;
+            case 'c': ckpt_path = optarg; break;
+            case 'x': use_index = 1; break;
+            case 'b':
+                if (!(cfg.bucket = parse_bucket(optarg))) {
+                    fprintf(stderr, "Invalid bucket width: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p': patterns_path = optarg; break;
+            case 'P': cfg.pin = 1; break;
+            case 'T': cfg.top_k = atoi(optarg); if (cfg.top_k < 1) cfg.top_k = 1; break;
+            case OPT_SINCE:
+            case OPT_UNTIL: {
+                int64_t t = parse_time_arg(optarg);
+                if (t == TS_NONE) {
+                    fprintf(stderr, "Invalid time: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                if (c == OPT_SINCE) cfg.since = t; else cfg.until = t;
+                cfg.windowed = 1;
+                break;
+            }
+            case OPT_FORMAT:
+                if ((cfg.format = pick_format(optarg)) < 0) {
+                    fprintf(stderr, "Unknown format: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_GROUP_BY:
+            case OPT_DISTINCT:
+            case OPT_HEAVY:
+                if (parse_field(optarg, c == OPT_GROUP_BY ? &query.key
+                                      : c == OPT_DISTINCT ? &query.distinct : &query.heavy) != 0) {
+                    fprintf(stderr, "Invalid field: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                query.on = 1;
+                break;
+            case OPT_HEAVY_TOP: {
+                char *e;
+                long v = strtol(optarg, &e, 10);
+                if (e == optarg || *e || v < 1 || v > HEAVY_TOP_MAX) {
+                    fprintf(stderr, "Invalid heavy-top count: %s (1 to %d)\n", optarg, HEAVY_TOP_MAX);
+                    return EXIT_FAILURE;
+                }
+                sk.top = (int)v;
+                break;
+            }
+            case OPT_SKETCH_ERROR:
+                sk.error = strtod(optarg, NULL);
+                if (!(sk.error > 0 && sk.error < 1)) {
+                    fprintf(stderr, "Invalid sketch error: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_WHERE:
+                if (parse_where(optarg) != 0) {
+                    fprintf(stderr, "Invalid condition: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                have_where = 1;
+                break;
+            case OPT_MEMORY:
+                if (!(cfg.budget = (size_t)strtoul(optarg, NULL, 10) << 20)) {
+                    fprintf(stderr, "Invalid memory budget: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_DROP_CACHE: cfg.drop_cache = 1; break;
+            case 'h': usage(argv[0]); return EXIT_SUCCESS;
+            default : usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    while (optind < argc) path_add(&inputs, argv[optind++]);
+    if (!inputs.n) { usage(argv[0]); return EXIT_FAILURE; }
+    if (have_where && !query.on) {
+        fprintf(stderr, "--where selects the lines for --group-by, --distinct and --heavy\n");
+        return EXIT_FAILURE;
+    }
+
+    /* one plain file (or '-') keeps the single-input paths below */
+    int multi = inputs.n > 1;
+    if (!multi && strcmp(inputs.paths[0], "-")) {
+        struct stat ps;
+        if (stat(inputs.paths[0], &ps) == 0) multi = S_ISDIR(ps.st_mode);
+        else multi = strpbrk(inputs.paths[0], "*?[") != NULL;
+    }
+    file_path = inputs.paths[0];
+
+    cfg.kernel = pick_kernel(kernel_name);
+    if (cfg.kernel < 0) {
+        fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernel_name);
+        return EXIT_FAILURE;
+    }
+    if (cfg.pin && topo_init() != 0) {
+        fprintf(stderr, "--pin is not supported here; workers will not be pinned\n");
+        cfg.pin = 0;
+    }
+    if (patterns_path && ac_load(patterns_path) != 0) return EXIT_FAILURE;
+    sketch_size();
+    fx_init(&fx_total);
+    cfg.per_line = cfg.bucket || cfg.windowed || ac.npats || cfg.top_k || query.on;
+    if (cfg.format != FMT_AUTO) use_format(cfg.format);
+    else cfg.scan = format_scan(FMT_BRACKET);   /* until an input says otherwise */
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (multi) {
+        if (follow || ckpt_path || use_index) {
+            fprintf(stderr, "--follow, --checkpoint and --index take a single file\n");
+            return EXIT_FAILURE;
+        }
+        path_list_t files = {0};
+        int rc = 0;
+        for (size_t i = 0; i < inputs.n; ++i)
+            if (add_inputs(&files, inputs.paths[i], FROM_ARG) != 0) rc = -1;
+        if (!files.n) { fprintf(stderr, "No input files\n"); return EXIT_FAILURE; }
+
+        file_result_t *res = calloc(files.n, sizeof(*res));
+        if (!res) { perror("calloc"); return EXIT_FAILURE; }
+        totals_t tot = {0};
+        if (scan_files(&files, res, &tot) != 0) rc = -1;
+        print_file_results(res, files.n);
+        print_results(&tot);
+        return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    int fd = strcmp(file_path, "-") ? open(file_path, O_RDONLY) : STDIN_FILENO;
+    if (fd == -1) { perror("open"); return EXIT_FAILURE; }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) { perror("fstat"); return EXIT_FAILURE; }
+
+    totals_t tot = {0};
+    int rc = 0;
+    if (use_index && (follow || ckpt_path)) {
+        fprintf(stderr, "--index cannot be combined with --follow or --checkpoint\n");
+        return EXIT_FAILURE;
+    }
+    if (use_index && cfg.per_line) {
+        fprintf(stderr, "--index keeps level counts only; it cannot be combined with "
+                        "--bucket, --since, --until, --patterns, --templates or the queries\n");
+        return EXIT_FAILURE;
+    }
+    if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+        if (follow || ckpt_path || use_index) {
+            fprintf(stderr, "--follow, --checkpoint and --index need a regular file\n");
+            return EXIT_FAILURE;
+        }
+#ifdef F_SETPIPE_SZ
+        if (S_ISFIFO(st.st_mode)) fcntl(fd, F_SETPIPE_SZ, 1 << 20);
+#endif
+        char peek[2];
+        size_t npeek = 0;
+        ssize_t n;
+        while (npeek < sizeof(peek) && (n = read(fd, peek + npeek, sizeof(peek) - npeek)) > 0)
+            npeek += n;
+        if (is_gzip((unsigned char *)peek, npeek)) {
+#ifdef HAVE_ZLIB
+            rc = scan_gzip_stream(fd, peek, npeek, &tot);
+#else
+            fprintf(stderr, "gzip input needs a build with -DHAVE_ZLIB -lz\n");
+            return EXIT_FAILURE;
+#endif
+        } else {
+            stream_src_t src = { .read = fd_read, .fd = fd, .peek = peek, .npeek = npeek };
+            rc = scan_stream(&src, &tot);
+        }
+        print_results(&tot);
+        return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (!S_ISREG(st.st_mode) || (st.st_size == 0 && !follow)) {
+        fprintf(stderr, "Invalid file or empty: %s\n", file_path);
+        return EXIT_FAILURE;
+    }
+
+    unsigned char magic[2];
+    if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && is_gzip(magic, sizeof(magic))) {
+        if (follow || ckpt_path || use_index) {
+            fprintf(stderr, "--follow, --checkpoint and --index do not support gzip input\n");
+            return EXIT_FAILURE;
+        }
+#ifdef HAVE_ZLIB
+        rc = scan_gzip_file(fd, st.st_size, &tot);
+        close(fd);
+        print_results(&tot);
+        return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+#else
+        fprintf(stderr, "gzip input needs a build with -DHAVE_ZLIB -lz\n");
+        return EXIT_FAILURE;
+#endif
+    }
+
+    int fmt = cfg.format;
+    if (fmt == FMT_AUTO) {
+        char head[FORMAT_SNIFF];
+        ssize_t n = pread(fd, head, sizeof(head), 0);
+        use_format(fmt = detect_format(head, n > 0 ? n : 0));
+    }
+
+    off_t offset = 0;
+    ckpt_pos_t pos;
+    if (ckpt_path && load_checkpoint(ckpt_path, &pos, tot.counts) == 0) {
+        if (pos.dev == st.st_dev && pos.ino == st.st_ino && pos.offset <= st.st_size) {
+            offset = pos.offset;
+            fprintf(stderr, "Resuming %s at offset %lld\n", file_path, (long long)offset);
+        } else {
+            fprintf(stderr, "Checkpoint is for another file or a truncated one; "
+                            "keeping its totals and starting %s at offset 0\n", file_path);
+        }
+    }
+
+    if (follow) {
+        rc = follow_log(file_path, fd, offset, &tot, ckpt_path, interval);
+    } else if (ckpt_path) {
+        off_t end = complete_lines_end(fd, offset, st.st_size);
+        if ((rc = scan_fd_range(fd, offset, end, &tot)) == 0) {
+            pos = (ckpt_pos_t){ st.st_dev, st.st_ino, end };
+            save_checkpoint(ckpt_path, &pos, tot.counts);
+        }
+        close(fd);
+    } else if (use_index) {
+        char idx_path[PATH_MAX];
+        snprintf(idx_path, sizeof(idx_path), "%s.laidx", file_path);
+        rc = index_scan(fd, &st, idx_path, fmt, &tot);
+        close(fd);
+    } else {
+        rc = scan_fd_range(fd, 0, st.st_size, &tot);
+        close(fd);
+    }
+
+    print_results(&tot);
 
-    return EXIT_SUCCESS;
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
+//    gcc -O2 -pthread -DHAVE_ZLIB -o loganalyzer loganalyzer.c -lz
 //    ./loganalyzer -f demo.log
 //      ./loganalyzer -f demo.log -t 4
 //      ./loganalyzer -f demo.log -l error
@@ -206,6 +3793,20 @@ int main(int argc, char *argv[]) {
 //      time ./loganalyzer -f big.log -t 8
 //      time ./loganalyzer -f big.log -t 128
 //     ./loganalyzer -f big.log -t 8
+//      ./loganalyzer -f big.log -r -k scalar
+//      ./loganalyzer -f app.log -F -i 5 -c app.ckpt
+//      journalctl -o cat | ./loganalyzer -f - -t 4
+//      ./loganalyzer -f app.log.1.gz -t 8
+//      ./loganalyzer -f archive.log -x -l error
+//      ./loganalyzer -f service.json -t 8 --format json
+//      ./loganalyzer -t 8 /var/log/app --group-by service --where level>=warn
+//      ./loganalyzer -t 8 -f access.log --distinct user --heavy client --sketch-error 0.001
+//      ./loganalyzer -t 16 -f huge.log --memory 256 --drop-cache -r
+//      ./loganalyzer -t 16 /var/log/nginx '/var/log/app/*.log*'
+//      ./loganalyzer -f big.log -t 32 -P -r
+//      ./loganalyzer -f app.log -t 8 -p signatures.txt
+//      ./loganalyzer -f app.log -t 8 -T 20 -l warn
+//      ./loganalyzer -f app.log -b min --since 2025-04-28T12:00:00 --until 2025-04-28T13:00:00
 
 
 
@@ -0,0 +1,107 @@
+#!/usr/bin/env bash
+# Throughput benchmark for loganalyzer
+#
+# Generates synthetic logs with loggen (cached as bench-<size>.log), then runs
+# loganalyzer over every combination of file size, page-cache state and thread
+# count and prints one CSV row per combination:
+#
+#   size_bytes,cache,threads,kernel,runs,elapsed_s,gb_per_s,lines_per_s,speedup,efficiency
+#
+# elapsed_s is the median of the runs, as reported by loganalyzer -r (scan time
+# only, no process start-up). speedup and efficiency are relative to the
+# smallest thread count of the same size and cache state. Each run's counts
+# are checked against the ones loggen wrote, so a wrong answer fails loudly
+# instead of showing up as a fast one.
+#
+# Cold runs evict the file with `dd iflag=nocache` (GNU coreutils) before each
+# run; as root, /proc/sys/vm/drop_caches is used instead.
+#
+# Usage: ./loganalyzer_bench.sh [-s "256M 1G"] [-t "1 2 4 8"] [-c "warm cold"]
+#                               [-r RUNS] [-k KERNEL] [-d DIR]
+
+set -e
+
+SIZES="256M 1G"
+THREADS="1 2 4 8"
+CACHES="warm cold"
+RUNS=3
+KERNEL=auto
+DIR=.
+
+while getopts "s:t:c:r:k:d:h" opt; do
+  case $opt in
+    s) SIZES=$OPTARG ;;
+    t) THREADS=$OPTARG ;;
+    c) CACHES=$OPTARG ;;
+    r) RUNS=$OPTARG ;;
+    k) KERNEL=$OPTARG ;;
+    d) DIR=$OPTARG ;;
+    *) sed -n '2,20s/^# \{0,1\}//p' "$0" >&2; exit 1 ;;
+  esac
+done
+
+for bin in ./loganalyzer ./loggen; do
+  [[ -x $bin ]] || { echo "missing $bin (build it first)" >&2; exit 1; }
+done
+
+evict() {
+  if [[ -w /proc/sys/vm/drop_caches ]]; then
+    sync && echo 1 > /proc/sys/vm/drop_caches
+  else
+    dd if="$1" iflag=nocache count=0 status=none
+  fi
+}
+
+# prints "elapsed lines" for one run, after checking the counts
+run_once() {
+  local file=$1 threads=$2 expect=$3 out
+  out=$(./loganalyzer -f "$file" -t "$threads" -k "$KERNEL" -r)
+  local got
+  got=$(awk '/^Total lines/ {t=$5} /^  [A-Z]+ *:/ {c = c " " $1 "=" $3}
+             END {print "lines=" t c}' <<< "$out")
+  if [[ $got != "$expect" ]]; then
+    echo "count mismatch on $file with $threads threads:" >&2
+    echo "  expected: $expect" >&2
+    echo "  got:      $got" >&2
+    exit 1
+  fi
+  awk '/^Elapsed/ {e=$3} /^Total lines/ {l=$5} END {print e, l}' <<< "$out"
+}
+
+median() { sort -g | awk '{v[NR]=$1} END {print v[int((NR + 1) / 2)]}'; }
+
+kernel_name=$(./loganalyzer -f demo.log -k "$KERNEL" -r 2>/dev/null | awk '/^Kernel/ {print $3}')
+echo "size_bytes,cache,threads,kernel,runs,elapsed_s,gb_per_s,lines_per_s,speedup,efficiency"
+
+for size in $SIZES; do
+  file="$DIR/bench-$size.log"
+  meta="$file.counts"
+  if [[ ! -f $file || ! -f $meta ]]; then
+    ./loggen -s "$size" -o "$file" 2> "$meta"
+  fi
+  # loggen: lines=N bytes=B INFO=..; keep the fields loganalyzer also prints
+  expect=$(awk '{ $2 = ""; print }' "$meta" | tr -s ' ')
+  bytes=$(wc -c < "$file" | tr -d ' ')
+
+  for cache in $CACHES; do
+    base_elapsed=""
+    base_threads=""
+    for t in $THREADS; do
+      [[ $cache == warm ]] && run_once "$file" "$t" "$expect" > /dev/null
+      times=()
+      lines=0
+      for ((r = 0; r < RUNS; ++r)); do
+        [[ $cache == cold ]] && evict "$file"
+        read -r e lines < <(run_once "$file" "$t" "$expect")
+        times+=("$e")
+      done
+      elapsed=$(printf '%s\n' "${times[@]}" | median)
+      if [[ -z $base_elapsed ]]; then base_elapsed=$elapsed; base_threads=$t; fi
+      awk -v s="$bytes" -v c="$cache" -v t="$t" -v k="$kernel_name" -v n="$RUNS" \
+          -v e="$elapsed" -v l="$lines" -v be="$base_elapsed" -v bt="$base_threads" 'BEGIN {
+        gbs = lps = sp = 0
+        if (e > 0) { gbs = s / e / 1e9; lps = l / e; sp = be / e }
+        printf "%d,%s,%d,%s,%d,%.6f,%.3f,%.0f,%.2f,%.2f\n", s, c, t, k, n, e, gbs, lps, sp, sp * bt / t }'
+    done
+  done
+done
@@ -78,6 +78,251 @@ else
   fail "Help text missing"
 fi
 
+# Test 7 – Every scan kernel the CPU supports must give identical counts
+echo "Test 7: SIMD kernels match scalar kernel"
+ref=$(./loganalyzer -f big.log -k scalar)
+ok=1
+for k in sse2 avx2 avx512; do
+  out=$(./loganalyzer -f big.log -k "$k" 2>/dev/null) || continue
+  [[ "$out" == "$ref" ]] || ok=0
+done
+if [[ $ok == 1 ]]; then
+  pass "All supported kernels agree"
+else
+  fail "Kernel counts differ"
+fi
+
+# Test 8 – Throughput report
+echo "Test 8: Throughput report (-r)"
+if ./loganalyzer -f big.log -r | grep -q "Throughput .*GB/s"; then
+  pass "Throughput reported"
+else
+  fail "Throughput report missing"
+fi
+
+# Test 9 – Work-stealing pool: small units and many threads must not change counts
+echo "Test 9: -t 128 with 4 KB units matches -t 1"
+if [[ "$(./loganalyzer -f big.log -t 128 -u 4)" == "$(./loganalyzer -f big.log -t 1)" ]]; then
+  pass "Counts independent of thread count and unit size"
+else
+  fail "Counts changed with thread count or unit size"
+fi
+
+# Test 10 – Checkpoint: a second run only counts the lines appended since the first
+echo "Test 10: Checkpoint resume (-c)"
+rm -f ckpt.log ckpt.state
+printf "[INFO] one\n[WARN] two\n" > ckpt.log
+./loganalyzer -f ckpt.log -c ckpt.state > /dev/null
+printf "[ERROR] three\n" >> ckpt.log
+out=$(./loganalyzer -f ckpt.log -c ckpt.state 2>&1)
+if grep -q "Resuming" <<< "$out" && grep -q "Total lines analyzed : 3" <<< "$out"; then
+  pass "Resumed from checkpoint with running totals"
+else
+  fail "Checkpoint resume did not work"
+fi
+rm -f ckpt.log ckpt.state
+
+# Test 11 – Streaming input from a pipe must match the mmap path
+echo "Test 11: Piped input (-f -) matches file input"
+if [[ "$(cat big.log | ./loganalyzer -f - -t 4)" == "$(./loganalyzer -f big.log -t 4)" ]]; then
+  pass "Pipe and mmap paths agree"
+else
+  fail "Pipe input counts differ"
+fi
+
+# Test 12 – gzip input, single and multi-member (needs a -DHAVE_ZLIB build)
+echo "Test 12: gzip input matches plain input"
+if ./loganalyzer -f demo.log > /dev/null && printf "" | gzip | ./loganalyzer -f - 2>&1 | grep -q "HAVE_ZLIB"; then
+  echo "  (skipped: built without zlib)"
+else
+  { head -n 50000 big.log | gzip; tail -n +50001 big.log | gzip; } > big.log.gz
+  plain=$(./loganalyzer -f big.log)
+  if [[ "$(./loganalyzer -f big.log.gz -t 4)" == "$plain" && "$(cat big.log.gz | ./loganalyzer -f -)" == "$plain" ]]; then
+    pass "gzip counts match"
+  else
+    fail "gzip counts differ"
+  fi
+  # A cut in the first member (streaming) or the last one (parallel members),
+  # from a file or a pipe, is an error rather than a short count
+  head -c 30000 big.log.gz > cut1.log.gz
+  head -c $(( $(wc -c < big.log.gz) - 1000 )) big.log.gz > cut2.log.gz
+  truncated=0
+  ./loganalyzer -f cut1.log.gz -t 1 > /dev/null 2>&1 || truncated=$((truncated + 1))
+  ./loganalyzer -f cut2.log.gz -t 4 > /dev/null 2>&1 || truncated=$((truncated + 1))
+  cat cut1.log.gz | ./loganalyzer -f - > /dev/null 2>&1 || truncated=$((truncated + 1))
+  if (( truncated == 3 )); then
+    pass "Truncated gzip input fails"
+  else
+    fail "Truncated gzip input accepted ($truncated of 3 rejected)"
+  fi
+  rm -f big.log.gz cut1.log.gz cut2.log.gz
+fi
+
+# Test 13 – Sidecar index: build, reuse, then extend after an append
+echo "Test 13: Index (-x) answers match a full scan"
+head -n 60000 big.log > idx.log
+rm -f idx.log.laidx
+./loganalyzer -f idx.log -x > /dev/null
+tail -n +60001 big.log >> idx.log
+if [[ "$(./loganalyzer -f idx.log -x)" == "$(./loganalyzer -f idx.log)" ]] &&
+   ./loganalyzer -f idx.log -x -r | grep -q "Bytes scanned        : 0"; then
+  pass "Index reused and extended correctly"
+else
+  fail "Index results differ from a full scan"
+fi
+rm -f idx.log idx.log.laidx
+
+# Test 14 – Time windows: the binary search on an ordered file must agree
+# with the per-line check on the same lines out of order
+echo "Test 14: --since/--until and --bucket"
+awk 'BEGIN { split("INFO WARN ERROR DEBUG TRACE", lv, " ");
+             for (i = 0; i < 200000; ++i) { s = int(i / 4);
+               printf "2025-04-28T%02d:%02d:%02d [%s] req %d\n", s / 3600, s / 60 % 60, s % 60, lv[i % 5 + 1], i } }' > timed.log
+tac timed.log > timed_rev.log
+WIN="--since 2025-04-28T03:00:00 --until 2025-04-28T05:30:00"
+expected=$(awk '$1 >= "2025-04-28T03:00:00" && $1 < "2025-04-28T05:30:00"' timed.log | wc -l)
+if ./loganalyzer -f timed.log -t 4 $WIN | grep -q "Total lines analyzed : $expected" &&
+   [[ "$(./loganalyzer -f timed.log -t 4 $WIN -b hour)" == "$(./loganalyzer -f timed_rev.log $WIN -b hour)" ]] &&
+   ./loganalyzer -f timed.log -b hour | grep -q "^2025-04-28T12:00:00Z *2880 *2880 *2880 *2880 *2880 *0$"; then
+  pass "Time window and histogram are correct"
+else
+  fail "Time window or histogram counts are wrong"
+fi
+rm -f timed.log timed_rev.log
+
+# Test 15 – Pattern counts must match grep -c for every pattern, overlaps included
+echo "Test 15: --patterns counts match grep -cF"
+printf 'message #1\nmessage #12\n[WARN]\nARN] m\n99\nsage #1\n' > pats.txt
+out=$(./loganalyzer -f big.log -t 4 -p pats.txt)
+ok=1
+while IFS= read -r p; do
+  grep -qE "^ *$(grep -cF -- "$p" big.log)  $(printf '%s' "$p" | sed 's/[][#]/\\&/g')\$" <<< "$out" || ok=0
+done < pats.txt
+if [[ $ok == 1 ]]; then
+  pass "Per-pattern counts are correct"
+else
+  fail "Per-pattern counts differ from grep"
+fi
+rm -f pats.txt
+
+# Test 16 – Templates: numbers are masked and per-thread tables merge exactly
+echo "Test 16: --templates top-K"
+out=$(./loganalyzer -f big.log -T 5 -t 4)
+if grep -q "^ *20000 .* 20000 .*  \[ERROR\] message #<N>$" <<< "$out" &&
+   grep -q "(5 distinct templates kept)" <<< "$out" &&
+   [[ "$out" == "$(./loganalyzer -f big.log -T 5 -t 1)" ]]; then
+  pass "Templates counted and merged correctly"
+else
+  fail "Template counts are wrong"
+fi
+
+# Test 17 – Several inputs: directories and globs on one pool, per-file and grand totals
+echo "Test 17: Multiple files, directories and globs"
+rm -rf multi.d && mkdir -p multi.d/sub
+head -n 30000 big.log > multi.d/a.log
+tail -n 70000 big.log > multi.d/sub/b.log
+printf "[ERROR] tiny\n" > multi.d/sub/c.log
+out=$(./loganalyzer -t 4 multi.d)
+glob_out=$(./loganalyzer -t 4 -f multi.d/a.log 'multi.d/sub/*.log')
+if grep -q "^ *30000 .* multi.d/a.log$" <<< "$out" &&
+   grep -q "^ *1 .* multi.d/sub/c.log$" <<< "$out" &&
+   grep -q "Total lines analyzed : 100001" <<< "$out" &&
+   [[ "$out" == "$glob_out" ]]; then
+  pass "Per-file and grand totals are correct"
+else
+  fail "Multi-file totals are wrong"
+fi
+rm -rf multi.d
+
+# Test 18 – loggen's own per-level counts must match loganalyzer's
+echo "Test 18: loggen output counted correctly"
+if [[ -x ./loggen ]]; then
+  expect=$(./loggen -s 8M -S 3 -o gen.log 2>&1 | awk '{ $2 = ""; print }' | tr -s ' ')
+  got=$(./loganalyzer -f gen.log -t 4 | awk '/^Total lines/ {t=$5} /^  [A-Z]+ *:/ {c = c " " $1 "=" $3}
+                                           END {print "lines=" t c}')
+  if [[ "$got" == "$expect" ]]; then
+    pass "Generated counts match"
+  else
+    fail "Generated counts differ: $got vs $expect"
+  fi
+  rm -f gen.log
+else
+  echo "  (skipped: loggen not built)"
+fi
+
+# Test 19 – Pinned workers give the same counts and a per-worker report
+echo "Test 19: --pin and per-worker report"
+out=$(./loganalyzer -f big.log -t 4 -u 64 -P -r 2>/dev/null)
+if [[ "$(head -n 9 <<< "$out")" == "$(./loganalyzer -f big.log)" ]] &&
+   [[ $(grep -cE "^ +[0-3] +[0-9-]+ +[0-9]+ +[0-9]+" <<< "$out") == 4 ]]; then
+  pass "Pinned run matches and reports every worker"
+else
+  fail "Pinned run or per-worker report is wrong"
+fi
+
+# Test 20 – JSON, logfmt and syslog input, with the format detected per file
+echo "Test 20: --format json/logfmt/syslog and auto-detection"
+awk 'BEGIN { split("info warning error debug trace", lv, " ");
+             for (i = 0; i < 50000; ++i) {
+               printf "{\"ts\":\"2025-04-28T00:00:00Z\",\"level\":\"%s\",\"msg\":\"req %d\"}\n", lv[i % 5 + 1], i > "fmt.json"
+               printf "ts=2025-04-28T00:00:00Z lvl=\"%s\" msg=\"req %d\"\n", toupper(lv[i % 5 + 1]), i > "fmt.logfmt"
+               printf "<%d>Apr 28 12:00:00 host app: req %d\n", 8 + (i % 5) * 2, i > "fmt.syslog" } }'
+out=$(./loganalyzer -t 4 fmt.json fmt.logfmt fmt.syslog)
+if grep -q "^ *50000 *10000 *10000 *10000 *10000 *10000 *0  fmt.json$" <<< "$out" &&
+   grep -q "^ *50000 *10000 *10000 *10000 *10000 *10000 *0  fmt.logfmt$" <<< "$out" &&
+   grep -q "^ *50000 *10000 *10000 *30000 *0 *0 *0  fmt.syslog$" <<< "$out" &&
+   [[ "$(./loganalyzer -f - -t 4 < fmt.json)" == "$(./loganalyzer -f fmt.json --format json)" ]] &&
+   ./loganalyzer -f fmt.json --format bracket | grep -q "OTHER : 50000"; then
+  pass "Every format counted correctly"
+else
+  fail "Format counts are wrong"
+fi
+rm -f fmt.json fmt.logfmt fmt.syslog
+
+# Test 21 – Group-by must match the equivalent awk pass, whatever the thread count
+echo "Test 21: --group-by with --where"
+awk 'BEGIN { split("info warn error debug trace", lv, " "); split("api db auth", sv, " ");
+             for (i = 0; i < 100000; ++i)
+               printf "level=%s service=%s host=h%d msg=\"req %d\"\n", lv[i % 5 + 1], sv[i % 7 % 3 + 1], i % 4, i }' > group.log
+expected=$(awk '($1 == "level=warn" || $1 == "level=error") && $3 != "host=h0" { c[substr($2, 9)]++ }
+                END { for (k in c) print c[k], k }' group.log | sort)
+out=$(./loganalyzer -f group.log -t 4 -u 64 --group-by service --where 'level>=warn' --where 'host!=h0')
+if [[ "$(awk '/^===== lines by/ {on = 1; next} on && /^ *[0-9]/ {print $1, $NF}' <<< "$out" | sort)" == "$expected" ]] &&
+   [[ "$out" == "$(./loganalyzer -f group.log -t 1 --group-by service --where 'level>=warn' --where 'host!=h0')" ]]; then
+  pass "Grouped counts match awk"
+else
+  fail "Grouped counts are wrong"
+fi
+rm -f group.log
+
+# Test 22 – Sketches: distinct estimate within 3%, heavy hitters found with
+# counts inside the printed bound, same answer from a pipe
+echo "Test 22: --distinct and --heavy"
+awk 'BEGIN { srand(5); for (i = 0; i < 300000; ++i) { u = int(1 / (rand() + 0.0001));
+             printf "level=%s user=u%d client=10.%d.%d.1\n", i % 3 ? "info" : "warn", i % 50000, u % 256, int(u / 256) % 256 } }' > sketch.log
+out=$(./loganalyzer -f sketch.log -t 4 -u 64 --distinct user --heavy client --heavy-top 3)
+est=$(awk '/^===== distinct/ {getline; print substr($1, 2)}' <<< "$out")
+top=$(awk '/^===== top 3 values/ {getline; for (i = 0; i < 3; ++i) {getline; printf "%s ", $2}}' <<< "$out")
+exact=$(awk '{c[$3]++} END {for (k in c) print c[k], substr(k, 8)}' sketch.log | sort -rn | head -n 3 | awk '{printf "%s ", $2}')
+if awk -v e="$est" 'BEGIN { exit !(e > 50000 * 0.97 && e < 50000 * 1.03) }' && [[ "$top" == "$exact" ]] &&
+   [[ "$(./loganalyzer -f - < sketch.log --distinct user --heavy client --heavy-top 3)" == "$out" ]]; then
+  pass "Sketch estimates are within bounds"
+else
+  fail "Sketch estimates are off: distinct=$est top=$top expected=$exact"
+fi
+rm -f sketch.log
+
+# Test 23 – Windowed scans under a memory budget give the same answers
+echo "Test 23: --memory windows match a whole-file map"
+out=$(./loganalyzer -f big.log -t 4 -u 4 --memory 1 --drop-cache -r)
+if [[ "$(head -n 9 <<< "$out")" == "$(./loganalyzer -f big.log)" ]] &&
+   grep -q "Memory budget        : 1 MB" <<< "$out" &&
+   [[ "$(./loganalyzer -f big.log -t 4 -T 5 --memory 1)" == "$(./loganalyzer -f big.log -t 4 -T 5)" ]]; then
+  pass "Windowed results are identical"
+else
+  fail "Windowed results differ"
+fi
+
 echo "============================================"
 echo "TEST SUMMARY COMPLETE"
 echo "============================================"
@@ -0,0 +1,328 @@
+#include <stdio.h>         // for fprintf(), perror()
+#include <stdlib.h>        // for exit(), strtoull()
+#include <string.h>        // for memcpy(), strlen()
+#include <strings.h>       // for strncasecmp()
+#include <stdint.h>        // for fixed-width integers
+#include <unistd.h>        // for write(), close()
+#include <fcntl.h>         // for open()
+#include <getopt.h>        // for parsing long options
+#include <time.h>          // for gmtime_r(), strftime()
+#include <math.h>          // for pow()
+
+// Synthetic log generator for benchmarking loganalyzer.
+//
+// Lines look like a typical service log:
+//   2025-04-28T12:00:01.234Z [WARN] db-pool: slow query id=48213 took 912ms from 10.1.7.33
+// with realistic lengths (roughly 60-250 bytes, occasional multi-KB lines),
+// a configurable level mix, Zipf-skewed message templates (a few shapes
+// dominate, as in real logs) and some continuation lines with no level at
+// all. Output is deterministic for a given seed. The exact per-level counts
+// are printed on stderr so a benchmark can check loganalyzer's answer.
+
+#define OUT_BUF      (4u << 20)   // flush to the fd in 4 MB writes
+#define LINE_MAX_LEN 8192         // longest line we ever build
+
+enum { L_TRACE, L_DEBUG, L_INFO, L_WARN, L_ERROR, L_NONE, L_COUNT };
+
+static const char *level_tags[L_COUNT] = {
+    "[TRACE]", "[DEBUG]", "[INFO]", "[WARN]", "[ERROR]", ""
+};
+
+// Placeholders: %u number, %m milliseconds, %x hex id, %i IPv4 address,
+// %w word, %q quoted string, %l long payload (a few KB).
+static const char *templates[] = {
+    "http: request id=%u served in %mms by worker-%u",
+    "db-pool: slow query id=%u took %mms from %i",
+    "auth: user %w logged in from %i session=%x",
+    "cache: miss for key %q, loading from backend",
+    "scheduler: job %x finished in %mms with status %u",
+    "http: GET /api/v1/items/%u returned %u in %mms",
+    "kafka: committed offset %u for partition %u of topic %w",
+    "gc: pause of %mms, heap %uMB -> %uMB",
+    "auth: token %x expired for user %w",
+    "db-pool: connection reset by peer %i, retrying (attempt %u)",
+    "http: upstream timeout after %mms contacting %i",
+    "worker-%u: processed batch %x with %u records",
+    "storage: wrote %u bytes to segment %x",
+    "scheduler: rescheduling job %x on node %w",
+    "kernel: OOM killer invoked for pid %u (%w)",
+    "payload: %l",
+};
+#define NTEMPLATES (sizeof(templates) / sizeof(templates[0]))
+
+static const char *words[] = {
+    "alice", "bob", "carol", "orders", "billing", "inventory", "search",
+    "edge-1", "edge-2", "eu-west", "us-east", "metrics", "events", "ledger",
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+// xorshift64* - fast, good enough for test data, reproducible
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static inline uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform double in [0, 1)
+static inline double rng_unit(void) {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Index of the first cdf entry greater than u
+static int pick(const double *cdf, int n, double u) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] > u) hi = mid; else lo = mid + 1;
+    }
+    return lo;
+}
+
+// Writes v in decimal at p and returns the number of digits
+static inline int put_uint(char *p, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do { tmp[n++] = '0' + v % 10; v /= 10; } while (v);
+    for (int i = 0; i < n; ++i) p[i] = tmp[n - 1 - i];
+    return n;
+}
+
+// Expands one template at p (at most about LINE_MAX_LEN - 128 bytes)
+static int put_message(char *p, const char *t) {
+    static const char hex[] = "0123456789abcdef";
+    char *start = p;
+    for (; *t; ++t) {
+        if (*t != '%') { *p++ = *t; continue; }
+        switch (*++t) {
+            case 'u': p += put_uint(p, rng_next() % 100000); break;
+            case 'm': p += put_uint(p, (uint64_t)(-log(1.0 - rng_unit()) * 40.0)); break;
+            case 'x': {
+                uint64_t v = rng_next();
+                for (int i = 0; i < 16; ++i, v >>= 4) *p++ = hex[v & 15];
+                break;
+            }
+            case 'i': {
+                uint64_t v = rng_next();
+                p += put_uint(p, 10);
+                for (int i = 0; i < 3; ++i, v >>= 8) { *p++ = '.'; p += put_uint(p, v & 255); }
+                break;
+            }
+            case 'w': {
+                const char *w = words[rng_next() % NWORDS];
+                size_t n = strlen(w);
+                memcpy(p, w, n);
+                p += n;
+                break;
+            }
+            case 'q': {
+                *p++ = '"';
+                const char *w = words[rng_next() % NWORDS];
+                size_t n = strlen(w);
+                memcpy(p, w, n);
+                p += n;
+                *p++ = ':';
+                p += put_uint(p, rng_next() % 1000);
+                *p++ = '"';
+                break;
+            }
+            case 'l': {
+                // a long JSON-ish blob, 1-6 KB
+                size_t n = 1024 + rng_next() % 5120;
+                for (size_t i = 0; i < n; i += 8) {
+                    uint64_t v = rng_next();
+                    for (int k = 0; k < 8; ++k, v >>= 8) p[i + k] = 'a' + (v & 255) % 26;
+                }
+                p += n;
+                break;
+            }
+            default: *p++ = '%'; *p++ = *t; break;
+        }
+    }
+    return p - start;
+}
+
+// Parses sizes like 512M, 4G or 1000000
+static uint64_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+        case 'k': case 'K': v *= 1024.0; break;
+        case 'm': case 'M': v *= 1024.0 * 1024.0; break;
+        case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; break;
+        case '\0': break;
+        default: return 0;
+    }
+    return v > 0 ? (uint64_t)v : 0;
+}
+
+// Parses "info=60,warn=20,error=5,debug=10,trace=4,none=1" into weights
+static int parse_mix(const char *s, double *w) {
+    static const char *names[L_COUNT] = { "trace", "debug", "info", "warn", "error", "none" };
+    for (int l = 0; l < L_COUNT; ++l) w[l] = 0;
+    while (*s) {
+        int l = 0;
+        while (l < L_COUNT && strncasecmp(s, names[l], strlen(names[l]))) ++l;
+        if (l == L_COUNT || s[strlen(names[l])] != '=') return -1;
+        s += strlen(names[l]) + 1;
+        char *end;
+        w[l] = strtod(s, &end);
+        if (end == s || w[l] < 0) return -1;
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s -s SIZE [OPTIONS]\n\n"
+        "Options:\n"
+        "  -s, --size SIZE     Bytes to generate, rounded up to a whole line (suffix K,\n"
+        "                      M or G), required\n"
+        "  -o, --output FILE   Write to FILE instead of stdout\n"
+        "  -S, --seed N        Random seed (default: 1)\n"
+        "  -m, --mix SPEC      Level weights, e.g. info=60,warn=20,error=5,debug=10,\n"
+        "                      trace=4,none=1 ('none' lines carry no level tag)\n"
+        "  -z, --skew A        Zipf exponent over message templates (default: 1.1,\n"
+        "                      0 means uniform)\n"
+        "  -r, --rate N        Lines per second of simulated time (default: 1000)\n"
+        "  -h, --help          Show this help and exit\n\n"
+        "Per-level line counts are printed on stderr when done.\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t size = 0, seed = 1, rate = 1000;
+    const char *out_path = NULL;
+    double skew = 1.1;
+    double mix[L_COUNT] = { 4, 10, 60, 20, 5, 1 };
+
+    struct option long_options[] = {
+        {"size",   required_argument, 0, 's'},
+        {"output", required_argument, 0, 'o'},
+        {"seed",   required_argument, 0, 'S'},
+        {"mix",    required_argument, 0, 'm'},
+        {"skew",   required_argument, 0, 'z'},
+        {"rate",   required_argument, 0, 'r'},
+        {"help",   no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:o:S:m:z:r:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's': size = parse_size(optarg); break;
+            case 'o': out_path = optarg; break;
+            case 'S': seed = strtoull(optarg, NULL, 10); break;
+            case 'm':
+                if (parse_mix(optarg, mix) != 0) {
+                    fprintf(stderr, "Error: invalid level mix '%s'\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'z': skew = atof(optarg); break;
+            case 'r': rate = strtoull(optarg, NULL, 10); if (!rate) rate = 1; break;
+            case 'h': usage(argv[0]); return EXIT_SUCCESS;
+            default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (!size) { usage(argv[0]); return EXIT_FAILURE; }
+
+    // Seed through one round of splitmix so small seeds still differ a lot
+    rng_state = seed + 0x9E3779B97F4A7C15ULL;
+    rng_state = (rng_state ^ (rng_state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    rng_state = (rng_state ^ (rng_state >> 27)) * 0x94D049BB133111EBULL;
+    rng_state ^= rng_state >> 31;
+    if (!rng_state) rng_state = 1;
+
+    // Cumulative distributions for levels and templates
+    double level_cdf[L_COUNT], tpl_cdf[NTEMPLATES], sum = 0;
+    for (int l = 0; l < L_COUNT; ++l) level_cdf[l] = (sum += mix[l]);
+    if (sum <= 0) { fprintf(stderr, "Error: level mix is all zero\n"); return EXIT_FAILURE; }
+    for (int l = 0; l < L_COUNT; ++l) level_cdf[l] /= sum;
+    sum = 0;
+    for (size_t i = 0; i < NTEMPLATES; ++i) tpl_cdf[i] = (sum += 1.0 / pow(i + 1, skew));
+    for (size_t i = 0; i < NTEMPLATES; ++i) tpl_cdf[i] /= sum;
+
+    int fd = out_path ? open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    if (fd == -1) { perror("open"); return EXIT_FAILURE; }
+
+    char *buf = malloc(OUT_BUF + LINE_MAX_LEN);
+    if (!buf) { perror("malloc"); return EXIT_FAILURE; }
+
+    // Timestamps: the "YYYY-MM-DDTHH:MM:SS." prefix only changes once a second
+    time_t sec = 1745798400;   // 2025-04-28T00:00:00Z
+    char stamp[32];
+    size_t stamp_len = 0;
+    time_t stamp_sec = -1;
+
+    uint64_t counts[L_COUNT] = {0}, lines = 0, written = 0;
+    size_t used = 0;
+
+    while (written + used < size) {
+        char *p = buf + used;
+        time_t now = sec + lines / rate;
+        unsigned ms = (unsigned)(lines % rate * 1000 / rate);
+        if (now != stamp_sec) {
+            struct tm tm;
+            gmtime_r(&now, &tm);
+            stamp_len = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S.", &tm);
+            stamp_sec = now;
+        }
+
+        int lvl = pick(level_cdf, L_COUNT, rng_unit());
+        if (lvl == L_NONE) {
+            // continuation line, e.g. a stack frame
+            static const char frame[] = "    at com.example.service.Handler.handle(Handler.java:";
+            memcpy(p, frame, sizeof(frame) - 1);
+            p += sizeof(frame) - 1;
+            p += put_uint(p, rng_next() % 900 + 10);
+            *p++ = ')';
+        } else {
+            memcpy(p, stamp, stamp_len);
+            p += stamp_len;
+            *p++ = '0' + ms / 100;
+            *p++ = '0' + ms / 10 % 10;
+            *p++ = '0' + ms % 10;
+            *p++ = 'Z';
+            *p++ = ' ';
+            size_t n = strlen(level_tags[lvl]);
+            memcpy(p, level_tags[lvl], n);
+            p += n;
+            *p++ = ' ';
+            p += put_message(p, templates[pick(tpl_cdf, NTEMPLATES, rng_unit())]);
+        }
+        *p++ = '\n';
+        used = p - buf;
+        counts[lvl]++;
+        lines++;
+
+        if (used >= OUT_BUF) {
+            for (size_t off = 0; off < used; ) {
+                ssize_t w = write(fd, buf + off, used - off);
+                if (w < 0) { perror("write"); return EXIT_FAILURE; }
+                off += w;
+            }
+            written += used;
+            used = 0;
+        }
+    }
+    for (size_t off = 0; off < used; ) {
+        ssize_t w = write(fd, buf + off, used - off);
+        if (w < 0) { perror("write"); return EXIT_FAILURE; }
+        off += w;
+    }
+    written += used;
+    if (out_path) close(fd);
+    free(buf);
+
+    // Same names and order as the loganalyzer summary
+    fprintf(stderr, "lines=%llu bytes=%llu INFO=%llu WARN=%llu ERROR=%llu DEBUG=%llu TRACE=%llu OTHER=%llu\n",
+            (unsigned long long)lines, (unsigned long long)written,
+            (unsigned long long)counts[L_INFO], (unsigned long long)counts[L_WARN],
+            (unsigned long long)counts[L_ERROR], (unsigned long long)counts[L_DEBUG],
+            (unsigned long long)counts[L_TRACE], (unsigned long long)counts[L_NONE]);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE        // for memfd_create()
+#endif
+#include <stdio.h>         // for printf(), perror()
+#include <stdlib.h>        // for exit(), strtoul()
+#include <string.h>        // for strcmp()
+#include <unistd.h>        // for sysconf(), pause(), getpid()
+#include <fcntl.h>         // for open()
+#include <getopt.h>        // for parsing options
+#include <signal.h>        // for sigaction()
+#include <sys/mman.h>      // for mmap(), mprotect(), shm_open(), memfd_create()
+#include <sys/shm.h>       // for shmget(), shmat()
+
+// Creates a process with a huge number of mappings, for benchmarking
+// memview's maps parser against something that looks like a big JVM or
+// database.
+//
+// Anonymous mode maps one large region and flips the protection of every
+// other page, so the kernel cannot merge neighbours and each page becomes
+// its own VMA. File mode (-f) maps page 0 of the given file over and over;
+// the offsets never line up, so those never merge either and every line in
+// /proc/PID/maps carries the same pathname.
+//
+// -t sysv, posix or memfd instead creates COUNT separate one-page shared
+// memory objects of that kind (SysV segments, /dev/shm files or memfds) and
+// maps and writes each one, so every object has one resident page, for
+// exercising memview -m. SysV segments are marked for
+// removal and /dev/shm files are unlinked when the process exits.
+//
+// Once everything is mapped it prints "<pid> <regions>" on stdout and waits
+// to be killed. The kernel caps mappings at vm.max_map_count (65530 by
+// default), so ask for a bit less than that.
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -n COUNT [-f FILE | -t sysv|posix|memfd]\n", prog);
+    fprintf(stderr, "  -n COUNT   number of extra mappings to create\n");
+    fprintf(stderr, "  -f FILE    map pages of FILE instead of anonymous memory\n");
+    fprintf(stderr, "  -t TYPE    map COUNT shared memory objects of TYPE\n");
+}
+
+static unsigned long posix_count;
+
+// Remove the /dev/shm objects we created
+static void cleanup(void) {
+    char name[64];
+    for (unsigned long i = 0; i < posix_count; i++) {
+        snprintf(name, sizeof(name), "/mapstress-%d-%lu", (int)getpid(), i);
+        shm_unlink(name);
+    }
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    exit(EXIT_SUCCESS);     // runs cleanup()
+}
+
+// Map one shared page of the given kind; returns the mapping or MAP_FAILED
+static void *map_shared(const char *type, unsigned long i, size_t page) {
+    char name[64];
+    void *p;
+    int fd;
+
+    if (strcmp(type, "sysv") == 0) {
+        int id = shmget(IPC_PRIVATE, page, IPC_CREAT | 0600);
+        if (id < 0)
+            return MAP_FAILED;
+        p = shmat(id, NULL, 0);
+        shmctl(id, IPC_RMID, NULL);     // destroyed once we detach
+        return p == (void *)-1 ? MAP_FAILED : p;
+    }
+    if (strcmp(type, "posix") == 0) {
+        snprintf(name, sizeof(name), "/mapstress-%d-%lu", (int)getpid(), i);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        posix_count = i + 1;
+    } else {
+        snprintf(name, sizeof(name), "mapstress-%lu", i);
+        fd = memfd_create(name, 0);
+    }
+    if (fd < 0)
+        return MAP_FAILED;
+    p = MAP_FAILED;
+    if (ftruncate(fd, (off_t)page) == 0)
+        p = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long count = 0;
+    const char *file = NULL;
+    const char *type = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:f:t:h")) != -1) {
+        switch (opt) {
+            case 'n': count = strtoul(optarg, NULL, 10); break;
+            case 'f': file = optarg; break;
+            case 't': type = optarg; break;
+            default: usage(argv[0]); exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (count == 0 || (type && strcmp(type, "sysv") != 0 && strcmp(type, "posix") != 0 &&
+                        strcmp(type, "memfd") != 0)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    atexit(cleanup);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    if (type) {
+        for (unsigned long i = 0; i < count; i++) {
+            char *p = map_shared(type, i, page);
+            if (p == MAP_FAILED) {
+                perror(type);
+                exit(EXIT_FAILURE);
+            }
+            p[0] = 1;
+        }
+    } else if (file) {
+        int fd = open(file, O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            exit(EXIT_FAILURE);
+        }
+        for (unsigned long i = 0; i < count; i++) {
+            if (mmap(NULL, page, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED) {
+                perror("mmap");
+                exit(EXIT_FAILURE);
+            }
+        }
+        close(fd);
+    } else {
+        char *base = mmap(NULL, count * page, PROT_READ,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        for (unsigned long i = 1; i < count; i += 2) {
+            if (mprotect(base + i * page, page, PROT_READ | PROT_WRITE) < 0) {
+                perror("mprotect");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    printf("%d %lu\n", (int)getpid(), count);
+    fflush(stdout);
+    for (;;)
+        pause();
+}
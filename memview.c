@@ -13,6 +13,13 @@
 #include <dirent.h>
 #include <ctype.h>
 #include <limits.h> 
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <sys/resource.h>
+#include <poll.h>
 
 
 #ifdef __APPLE__
@@ -27,6 +34,8 @@
 
 
 #define BUFFER_SIZE 4096
+#define MAPS_CHUNK  (1 << 20)     // read /proc/PID/maps 1 MB at a time
+#define ARENA_BLOCK (64 * 1024)   // pathname arena grows in 64 KB blocks
 
 typedef struct {
     unsigned long start;
@@ -36,207 +45,3006 @@ typedef struct {
     unsigned long offset;
     char device[8];
     unsigned long inode;
-    char pathname[PATH_MAX];
+    const char *pathname;   // interned in the list's StringArena, "" if none
+    // From /proc/PID/smaps, in KB; all zero when only maps was read
+    unsigned long rss_kb;
+    unsigned long pss_kb;
+    unsigned long shared_kb;    // Shared_Clean + Shared_Dirty
+    unsigned long private_kb;   // Private_Clean + Private_Dirty
+    unsigned long swap_kb;
+    unsigned long anon_huge_kb;
 } MemoryRegion;
 
+// Pathnames repeat a lot (every library has 4-5 mappings, a JVM maps the
+// same jar thousands of times), so each distinct one is stored once in a
+// bump-allocated arena and found again through an open-addressing hash set.
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t cap;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *blocks;
+    const char **slots;     // hash set of interned strings, NULL = empty
+    size_t nslots;          // power of two
+    size_t count;
+} StringArena;
+
+// Growable array of regions plus the arena their pathnames live in
+typedef struct {
+    MemoryRegion *items;
+    size_t count;
+    size_t cap;
+    StringArena names;
+} RegionList;
+
 // Function to display help
 void display_help(const char *program_name) {
     printf("Usage: %s [OPTIONS]\n", program_name);
     printf("Display memory usage information for processes or system.\n\n");
     printf("Options:\n");
-    printf("  -p PID      Display memory maps for the specified process ID\n");
+    printf("  -p PID      Display memory maps for the specified process ID; repeat -p\n");
+    printf("              or give a comma-separated list for several processes\n");
     printf("  -s          Display system memory information\n");
-    printf("  -m          Display shared memory segments\n");
+    printf("  -m          Display SysV, POSIX (/dev/shm) and memfd shared memory and the\n");
+    printf("              processes attaching each\n");
     printf("  -f FILTER   Filter memory regions by type (heap, stack, anon, file, etc.)\n");
     printf("  -v          Verbose output with more details\n");
+    printf("  -r          Show resident memory per region (Rss, Pss, Swap, ...) from smaps\n");
+    printf("  -R          Show only resident memory totals, from smaps_rollup\n");
+    printf("  -P          List processes by memory use (scans /proc in parallel)\n");
+    printf("  -n N        With -P or -s -v, show only the top N processes (default: all)\n");
+    printf("  -o KEY      Sort processes by rss, pss, vsz, shared, pid, name or user (default: rss)\n");
+    printf("  -c NAME     Only processes whose command name contains NAME\n");
+    printf("  -u USER     Only processes owned by USER (name or uid)\n");
+    printf("  -j N        Scan /proc with N threads (default: one per CPU)\n");
+    printf("  --pages     With -p, show the share of each region that is resident, swapped\n");
+    printf("              or backed by huge pages, from /proc/PID/pagemap\n");
+    printf("  --numa      With -p, show how each region is spread over the NUMA nodes and\n");
+    printf("              flag (!) regions mostly on nodes remote from the allowed CPUs\n");
+    printf("  --cgroups   Show the cgroup v2 tree ranked by memory use (-o usage, stall, full\n");
+    printf("              or name; -n N for the top N; -j N threads)\n");
+    printf("  --cgroup-root DIR\n");
+    printf("              cgroup v2 mount to read (default: /sys/fs/cgroup)\n");
+    printf("  --psi-watch MS\n");
+    printf("              With --cgroups, sleep on PSI triggers for the system and the\n");
+    printf("              ranked cgroups and report each time tasks stall on memory for\n");
+    printf("              MS ms within a 2 s window\n");
+    printf("  --snapshot FILE\n");
+    printf("              Save the region lists and totals of the -p processes (default:\n");
+    printf("              all processes) to FILE in memview's binary snapshot format\n");
+    printf("  --dump FILE Print the processes in a snapshot; -v adds their regions\n");
+    printf("  --diff OLD NEW\n");
+    printf("              Compare two snapshots; -v lists every region change\n");
+    printf("  --watch INTERVAL\n");
+    printf("              Sample the -p processes every INTERVAL (e.g. 100ms, 2s, 0.5)\n");
+    printf("              and flag memory or regions that keep growing; -v lists\n");
+    printf("              every region that appears, disappears or changes size\n");
+    printf("  --samples N Stop watching after N samples (default: until they exit)\n");
+    printf("  --grow N    Flag growth after N samples without shrinking (default: 3)\n");
+    printf("  -T          Print how long parsing the memory maps took (on stderr)\n");
     printf("  -h          Display this help and exit\n");
 }
 
-// Parse memory maps line into a structured format
-void parse_memory_line(char *line, MemoryRegion *region) {
-    char perms[5] = {0};
-    char device[8] = {0};
-    char pathname[PATH_MAX] = {0};
-    
-    memset(region, 0, sizeof(MemoryRegion));
-    
-    // Format of /proc/PID/maps line:
-    // address           perms offset  dev   inode   pathname
-    // 08048000-08056000 r-xp 00000000 03:0c 64593   /usr/sbin/gpm
-    
-    sscanf(line, "%lx-%lx %4s %lx %7s %lu %s",
-           &region->start, &region->end, 
-           perms, &region->offset, 
-           device, &region->inode, 
-           pathname);
-    
-    strncpy(region->permissions, perms, 4);
-    strncpy(region->device, device, 7);
-    strncpy(region->pathname, pathname, PATH_MAX - 1);
-    
-    region->size = region->end - region->start;
+void *xrealloc(void *ptr, size_t size) {
+    void *p = realloc(ptr, size);
+    if (!p) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+// FNV-1a; pathnames are short so this is cheaper than anything fancier
+static inline uint64_t hash_bytes(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Copy len bytes into the arena and NUL-terminate them
+char *arena_store(StringArena *arena, const char *s, size_t len) {
+    ArenaBlock *b = arena->blocks;
+    if (!b || b->cap - b->used < len + 1) {
+        size_t cap = len + 1 > ARENA_BLOCK ? len + 1 : ARENA_BLOCK;
+        b = xrealloc(NULL, sizeof(ArenaBlock) + cap);
+        b->next = arena->blocks;
+        b->used = 0;
+        b->cap = cap;
+        arena->blocks = b;
+    }
+    char *dst = b->data + b->used;
+    memcpy(dst, s, len);
+    dst[len] = '\0';
+    b->used += len + 1;
+    return dst;
+}
+
+// Return the interned copy of s[0..len), adding it on first sight
+const char *arena_intern(StringArena *arena, const char *s, size_t len) {
+    if (len == 0)
+        return "";
+
+    // Keep the set at most half full
+    if (2 * (arena->count + 1) > arena->nslots) {
+        size_t nslots = arena->nslots ? 2 * arena->nslots : 1024;
+        const char **slots = calloc(nslots, sizeof(*slots));
+        if (!slots) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < arena->nslots; i++) {
+            const char *old = arena->slots[i];
+            if (!old)
+                continue;
+            size_t j = hash_bytes(old, strlen(old)) & (nslots - 1);
+            while (slots[j])
+                j = (j + 1) & (nslots - 1);
+            slots[j] = old;
+        }
+        free(arena->slots);
+        arena->slots = slots;
+        arena->nslots = nslots;
+    }
+
+    size_t mask = arena->nslots - 1;
+    size_t i = hash_bytes(s, len) & mask;
+    for (; arena->slots[i]; i = (i + 1) & mask) {
+        const char *t = arena->slots[i];
+        if (strncmp(t, s, len) == 0 && t[len] == '\0')
+            return t;
+    }
+    arena->slots[i] = arena_store(arena, s, len);
+    arena->count++;
+    return arena->slots[i];
+}
+
+void arena_free(StringArena *arena) {
+    while (arena->blocks) {
+        ArenaBlock *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    free(arena->slots);
+    memset(arena, 0, sizeof(*arena));
+}
+
+MemoryRegion *region_list_push(RegionList *list) {
+    if (list->count == list->cap) {
+        list->cap = list->cap ? 2 * list->cap : 256;
+        list->items = xrealloc(list->items, list->cap * sizeof(MemoryRegion));
+    }
+    MemoryRegion *region = &list->items[list->count++];
+    memset(region, 0, sizeof(*region));
+    return region;
+}
+
+void region_list_free(RegionList *list) {
+    free(list->items);
+    arena_free(&list->names);
+    memset(list, 0, sizeof(*list));
+}
+
+// Hand-written tokenizers for the maps fields. Each one advances *p past
+// the digits it consumed and stops at the first character that is not one.
+static inline unsigned long parse_hex(const char **p, const char *end) {
+    unsigned long v = 0;
+    const char *s = *p;
+    for (; s < end; s++) {
+        unsigned c = (unsigned char)*s, d;
+        if (c - '0' < 10)
+            d = c - '0';
+        else if ((c | 0x20) - 'a' < 6)
+            d = (c | 0x20) - 'a' + 10;
+        else
+            break;
+        v = (v << 4) | d;
+    }
+    *p = s;
+    return v;
+}
+
+static inline unsigned long parse_dec(const char **p, const char *end) {
+    unsigned long v = 0;
+    const char *s = *p;
+    for (; s < end && (unsigned)(*s - '0') < 10; s++)
+        v = v * 10 + (unsigned long)(*s - '0');
+    *p = s;
+    return v;
+}
+
+static inline const char *skip_spaces(const char *s, const char *end) {
+    while (s < end && *s == ' ')
+        s++;
+    return s;
+}
+
+// Parse one maps line [line, end) (no newline) into a structured format.
+// Returns 0 on success, -1 if the line is malformed.
+int parse_memory_line(const char *line, const char *end, MemoryRegion *region,
+                      StringArena *names) {
+    // Format of /proc/PID/maps line:
+    // address           perms offset  dev   inode   pathname
+    // 08048000-08056000 r-xp 00000000 03:0c 64593   /usr/sbin/gpm
+    const char *p = line;
+
+    region->start = parse_hex(&p, end);
+    if (p >= end || *p++ != '-')
+        return -1;
+    region->end = parse_hex(&p, end);
+    p = skip_spaces(p, end);
+
+    size_t n = 0;
+    while (p < end && *p != ' ' && n < 4)
+        region->permissions[n++] = *p++;
+    region->permissions[n] = '\0';
+    p = skip_spaces(p, end);
+
+    region->offset = parse_hex(&p, end);
+    p = skip_spaces(p, end);
+
+    n = 0;
+    while (p < end && *p != ' ') {
+        if (n < sizeof(region->device) - 1)
+            region->device[n++] = *p;
+        p++;
+    }
+    region->device[n] = '\0';
+    p = skip_spaces(p, end);
+
+    region->inode = parse_dec(&p, end);
+    p = skip_spaces(p, end);
+
+    // The pathname is the rest of the line and may contain spaces,
+    // e.g. "/tmp/x (deleted)"
+    region->pathname = arena_intern(names, p, (size_t)(end - p));
+    region->size = region->end - region->start;
+    return n ? 0 : -1;
+}
+
+// smaps key-dispatch table: which MemoryRegion counter each "Key: N kB"
+// line adds into. Keys not listed here (Referenced, KSM, VmFlags, ...) are
+// skipped after a length check, without being parsed.
+typedef struct {
+    const char *key;
+    size_t len;
+    size_t field;           // offsetof() an unsigned long in MemoryRegion
+} SmapsKey;
+
+#define SMAPS_KEY(name, member) { name, sizeof(name) - 1, offsetof(MemoryRegion, member) }
+
+static const SmapsKey smaps_keys[] = {
+    SMAPS_KEY("Rss",           rss_kb),
+    SMAPS_KEY("Pss",           pss_kb),
+    SMAPS_KEY("Shared_Clean",  shared_kb),
+    SMAPS_KEY("Shared_Dirty",  shared_kb),
+    SMAPS_KEY("Private_Clean", private_kb),
+    SMAPS_KEY("Private_Dirty", private_kb),
+    SMAPS_KEY("Swap",          swap_kb),
+    SMAPS_KEY("AnonHugePages", anon_huge_kb),
+};
+
+// Add one smaps "Key:   N kB" line [line, end) into region
+void parse_smaps_field(const char *line, const char *end, MemoryRegion *region) {
+    const char *colon = memchr(line, ':', (size_t)(end - line));
+    if (!colon)
+        return;
+    size_t len = (size_t)(colon - line);
+    for (size_t i = 0; i < sizeof(smaps_keys) / sizeof(smaps_keys[0]); i++) {
+        if (smaps_keys[i].len != len || memcmp(smaps_keys[i].key, line, len) != 0)
+            continue;
+        const char *p = skip_spaces(colon + 1, end);
+        *(unsigned long *)((char *)region + smaps_keys[i].field) += parse_dec(&p, end);
+        return;
+    }
+}
+
+// One line of maps, smaps or smaps_rollup. Region headers start with a
+// lowercase hex address; smaps field lines start with an uppercase key and
+// belong to the region above them.
+static inline void parse_proc_line(const char *line, const char *end, RegionList *list) {
+    if (line == end)
+        return;
+    if ((unsigned)(*line - 'A') < 26) {
+        if (list->count)
+            parse_smaps_field(line, end, &list->items[list->count - 1]);
+        return;
+    }
+    if (parse_memory_line(line, end, region_list_push(list), &list->names) < 0)
+        list->count--;
+}
+
+// Read an open /proc file from the start, in MAPS_CHUNK pieces, and hand
+// every line (without its newline) to fn as it arrives. smaps is costly for
+// the kernel to generate, so it is read once, straight through. pread()
+// means a watcher can keep the fd open and simply read it again for the
+// next sample. Being inline, each caller gets the loop with its own line
+// parser inlined. Returns 0, or -1 with errno set.
+static inline int read_lines_fd(int fd, void (*fn)(const char *, const char *, void *),
+                                void *ctx) {
+    // One chunk buffer for the whole run; nothing reads /proc concurrently
+    static char *buf;
+    if (!buf)
+        buf = xrealloc(NULL, MAPS_CHUNK);
+
+    off_t off = 0;
+    size_t have = 0;        // bytes of an unfinished line carried over
+    for (;;) {
+        ssize_t got = pread(fd, buf + have, MAPS_CHUNK - have, off);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        off += got;
+        size_t len = have + (size_t)got;
+        const char *p = buf, *stop = buf + len;
+        for (;;) {
+            const char *nl = memchr(p, '\n', (size_t)(stop - p));
+            if (!nl) {
+                // Last line without a newline at EOF
+                if (got == 0)
+                    fn(p, stop, ctx);
+                break;
+            }
+            fn(p, nl, ctx);
+            p = nl + 1;
+        }
+        if (got == 0)
+            break;
+        have = (size_t)(stop - p);
+        if (have == MAPS_CHUNK) // a single line longer than the buffer: drop it
+            have = 0;
+        memmove(buf, p, have);
+    }
+    return 0;
+}
+
+static void region_line(const char *line, const char *end, void *list) {
+    parse_proc_line(line, end, list);
+}
+
+// Read an open maps, smaps or smaps_rollup file and append every region
+// to list. Returns 0, or -1 with errno set.
+int read_regions_fd(int fd, RegionList *list) {
+    return read_lines_fd(fd, region_line, list);
+}
+
+// Read /proc/PID/<file> ("maps", "smaps" or "smaps_rollup") into list.
+// Returns 0, or -1 with errno set if the file could not be read.
+int read_proc_regions(pid_t pid, const char *file, RegionList *list) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    int rc = read_regions_fd(fd, list);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return rc;
+}
+
+// Function to determine memory region type
+const char* get_region_type(MemoryRegion *region) {
+    if (strstr(region->pathname, "[heap]"))
+        return "heap";
+    else if (strstr(region->pathname, "[stack]"))
+        return "stack";
+    else if (strstr(region->pathname, "[vdso]"))
+        return "vdso";
+    else if (strstr(region->pathname, "[vsyscall]"))
+        return "vsyscall";
+    else if (region->pathname[0] == '\0')
+        return "anonymous";
+    else if (strstr(region->pathname, "SYSV"))
+        return "shared_memory";
+    else if (region->pathname[0] == '/')
+        return "file_mapped";
+    else
+        return "other";
+}
+
+// Region categories used by the usage summary
+enum { CAT_HEAP, CAT_STACK, CAT_SHARED, CAT_LIBRARY, CAT_ANON, CAT_OTHER, CAT_COUNT };
+
+static const char *category_names[CAT_COUNT] = {
+    "Heap", "Stack", "Shared", "Library", "Anonymous", "Other"
+};
+
+int region_category(MemoryRegion *region) {
+    const char *type = get_region_type(region);
+    if (strcmp(type, "heap") == 0)
+        return CAT_HEAP;
+    else if (strcmp(type, "stack") == 0)
+        return CAT_STACK;
+    else if (strcmp(type, "shared_memory") == 0 || (region->permissions[0] == 'r' && region->permissions[3] == 's'))
+        return CAT_SHARED;
+    else if (strcmp(type, "file_mapped") == 0 && strstr(region->pathname, ".so"))
+        return CAT_LIBRARY;
+    else if (strcmp(type, "anonymous") == 0)
+        return CAT_ANON;
+    return CAT_OTHER;
+}
+
+// Add the sizes and smaps counters of src into dst
+void add_region_counters(MemoryRegion *dst, const MemoryRegion *src) {
+    dst->size += src->size;
+    dst->rss_kb += src->rss_kb;
+    dst->pss_kb += src->pss_kb;
+    dst->shared_kb += src->shared_kb;
+    dst->private_kb += src->private_kb;
+    dst->swap_kb += src->swap_kb;
+    dst->anon_huge_kb += src->anon_huge_kb;
+}
+
+// Calculate memory usage summary. Region sizes only describe address space;
+// when the regions came from smaps (resident is set) the summary also shows
+// how much of each category is actually in RAM or swapped out.
+void calculate_memory_summary(MemoryRegion *regions, size_t count, int resident) {
+    MemoryRegion sums[CAT_COUNT] = {0};
+    MemoryRegion total = {0};
+    
+    for (size_t i = 0; i < count; i++) {
+        add_region_counters(&sums[region_category(&regions[i])], &regions[i]);
+        add_region_counters(&total, &regions[i]);
+    }
+    
+    if (resident) {
+        printf("\nMemory Usage Summary (KB):\n");
+        printf("-----------------------------------------------------\n");
+        printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n",
+               "Type", "Virtual", "Rss", "Pss", "Shared", "Private", "Swap", "AnonHuge");
+        for (int c = 0; c <= CAT_COUNT; c++) {
+            MemoryRegion *sum = c < CAT_COUNT ? &sums[c] : &total;
+            printf("%-10s %10lu %10lu %10lu %10lu %10lu %10lu %10lu\n",
+                   c < CAT_COUNT ? category_names[c] : "Total",
+                   sum->size / 1024, sum->rss_kb, sum->pss_kb, sum->shared_kb,
+                   sum->private_kb, sum->swap_kb, sum->anon_huge_kb);
+        }
+        return;
+    }
+    
+    printf("\nMemory Usage Summary:\n");
+    printf("-----------------------------------------------------\n");
+    printf("Total address space:     %10lu KB (%lu bytes)\n", total.size / 1024, total.size);
+    printf("Heap memory:             %10lu KB (%lu bytes)\n", sums[CAT_HEAP].size / 1024, sums[CAT_HEAP].size);
+    printf("Stack memory:            %10lu KB (%lu bytes)\n", sums[CAT_STACK].size / 1024, sums[CAT_STACK].size);
+    printf("Shared memory:           %10lu KB (%lu bytes)\n", sums[CAT_SHARED].size / 1024, sums[CAT_SHARED].size);
+    printf("Library memory:          %10lu KB (%lu bytes)\n", sums[CAT_LIBRARY].size / 1024, sums[CAT_LIBRARY].size);
+    printf("Anonymous memory:        %10lu KB (%lu bytes)\n", sums[CAT_ANON].size / 1024, sums[CAT_ANON].size);
+    printf("(virtual sizes; use -r or -R for resident memory)\n");
+}
+
+// Read /proc/PID/<file> into list or exit with an error, and report how
+// long that took on stderr when timing is set
+void load_regions(pid_t pid, const char *file, RegionList *list, int timing) {
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (read_proc_regions(pid, file, list) < 0) {
+        fprintf(stderr, "Error: cannot read /proc/%d/%s: %s\n", pid, file, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (timing) {
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        fprintf(stderr, "Parsed %zu regions (%zu distinct pathnames) from /proc/%d/%s in %.3f ms\n",
+                list->count, list->names.count, pid, file, ms);
+    }
+}
+
+// Show detailed process memory information. Only maps is read unless the
+// resident columns were asked for, since smaps is much slower to produce.
+void show_process_memory(pid_t pid, const char *filter, int verbose, int resident, int timing) {
+    char path[PATH_MAX];
+    char buffer[BUFFER_SIZE];
+    RegionList list = {0};
+
+    load_regions(pid, resident ? "smaps" : "maps", &list, timing);
+    
+    printf("Memory maps for PID %d:\n", pid);
+    printf("-----------------------------------------------------\n");
+    
+    if (resident) {
+        printf("%-33s %-5s %11s %8s %8s %8s %8s %8s %8s %s\n",
+               "Address Range", "Perms", "Size", "Rss", "Pss", "Shared", "Private",
+               "Swap", "AnonHuge", "Pathname");
+        printf("-----------------------------------------------------\n");
+    } else if (verbose) {
+        printf("%-16s %-8s %-16s %-7s %-8s %s\n", 
+               "Address Range", "Perms", "Size", "Offset", "Inode", "Pathname");
+        printf("-----------------------------------------------------\n");
+    }
+    
+    // Print each region, keeping only the ones that pass the filter
+    size_t region_count = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        MemoryRegion *region = &list.items[i];
+        const char *type = get_region_type(region);
+        
+        // Apply filter if specified
+        if (filter && strcmp(filter, type) != 0) {
+            continue;
+        }
+        
+        if (resident) {
+            printf("%016lx-%016lx %s %8lu KB %8lu %8lu %8lu %8lu %8lu %8lu %s",
+                   region->start, region->end,
+                   region->permissions,
+                   region->size / 1024,
+                   region->rss_kb, region->pss_kb,
+                   region->shared_kb, region->private_kb,
+                   region->swap_kb, region->anon_huge_kb,
+                   region->pathname);
+            if (verbose)
+                printf(" [%s]", type);
+            printf("\n");
+        } else if (verbose) {
+            printf("%016lx-%016lx %s %8lu KB %8lx %8lu %s [%s]\n", 
+                   region->start, region->end,
+                   region->permissions,
+                   region->size / 1024,
+                   region->offset,
+                   region->inode,
+                   region->pathname,
+                   type);
+        } else {
+            printf("%016lx-%016lx %s %8lu KB %s\n", 
+                   region->start, region->end,
+                   region->permissions,
+                   region->size / 1024,
+                   region->pathname);
+        }
+        
+        list.items[region_count++] = *region;
+    }
+    
+    // Print memory usage summary
+    calculate_memory_summary(list.items, region_count, resident);
+    region_list_free(&list);
+    
+    // Additional process info
+    if (verbose) {
+        // Show status information
+        snprintf(path, sizeof(path), "/proc/%d/status", pid);
+        FILE *file = fopen(path, "r");
+        if (file) {
+            printf("\nProcess Status Information:\n");
+            printf("-----------------------------------------------------\n");
+            while (fgets(buffer, sizeof(buffer), file)) {
+                if (strncmp(buffer, "Vm", 2) == 0) { // Show only memory-related status
+                    printf("%s", buffer);
+                }
+            }
+            fclose(file);
+        }
+    }
+}
+
+// Show only the resident memory totals of a process. smaps_rollup (Linux
+// 4.14+) has the kernel do the summing and skips formatting every region;
+// with a filter, or on older kernels, the totals are summed from smaps.
+void show_process_totals(pid_t pid, const char *filter, int timing) {
+    char path[PATH_MAX];
+    RegionList list = {0};
+    MemoryRegion total = {0};
+    const char *file = "smaps_rollup";
+
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    if (filter || access(path, F_OK) != 0)
+        file = "smaps";
+    load_regions(pid, file, &list, timing);
+
+    for (size_t i = 0; i < list.count; i++) {
+        if (filter && strcmp(filter, get_region_type(&list.items[i])) != 0)
+            continue;
+        add_region_counters(&total, &list.items[i]);
+    }
+    region_list_free(&list);
+
+    printf("Resident memory totals for PID %d (from %s):\n", pid, file);
+    printf("-----------------------------------------------------\n");
+    printf("Rss:             %10lu KB\n", total.rss_kb);
+    printf("Pss:             %10lu KB\n", total.pss_kb);
+    printf("Shared:          %10lu KB\n", total.shared_kb);
+    printf("Private:         %10lu KB\n", total.private_kb);
+    printf("Swap:            %10lu KB\n", total.swap_kb);
+    printf("AnonHugePages:   %10lu KB\n", total.anon_huge_kb);
+}
+
+// Shared memory objects (-m). SysV segments come from a single read of
+// /proc/sysvipc/shm, falling back to SHM_INFO + SHM_STAT over the indexes
+// actually in use; segment ids are sparse, so probing ids is hopeless.
+// POSIX objects are the files in /dev/shm. Every process's maps is then
+// read once to find who attaches what: SysV mappings show up as
+// "/SYSV<key>" with the shmid as inode, /dev/shm files by inode, and
+// memfds as "/memfd:<name>", which is the only place those are visible.
+
+enum { SHM_SYSV, SHM_POSIX, SHM_MEMFD, SHM_KINDS };
+
+typedef struct {
+    int kind;
+    unsigned long inode;        // shmid for SysV, file inode otherwise
+    const char *name;           // interned; "" for SysV
+    long key;                   // SysV only
+    unsigned long size;         // bytes; largest mapping seen for memfds
+    uid_t uid;
+    unsigned mode;
+    unsigned long nattch;       // the kernel's count, SysV only
+    unsigned long rss_kb;       // SysV only (0 on kernels without the column)
+    pid_t *pids;                // attaching processes, each listed once
+    size_t npids;
+    size_t pids_cap;
+} SharedObject;
+
+// Objects plus an open-addressing index on (kind, inode)
+typedef struct {
+    SharedObject *items;
+    size_t count;
+    size_t cap;
+    size_t *slots;              // index + 1, 0 = empty
+    size_t nslots;              // power of two
+    StringArena names;
+} SharedTable;
+
+static inline uint64_t mix_key(int kind, unsigned long inode) {
+    uint64_t h = ((uint64_t)inode << 2 | (uint64_t)kind) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 29);
+}
+
+// Read a whole (small) file into a NUL-terminated malloc'd buffer.
+// Returns NULL with errno set on failure.
+char *read_whole_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    size_t cap = 64 * 1024, used = 0;
+    char *buf = xrealloc(NULL, cap);
+    for (;;) {
+        if (cap - used < 4096) {
+            cap *= 2;
+            buf = xrealloc(buf, cap);
+        }
+        ssize_t got = read(fd, buf + used, cap - used - 1);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0) {
+            int saved = errno;
+            free(buf);
+            close(fd);
+            errno = saved;
+            return NULL;
+        }
+        if (got == 0)
+            break;
+        used += (size_t)got;
+    }
+    close(fd);
+    buf[used] = '\0';
+    *len = used;
+    return buf;
+}
+
+// Find the object of this kind and inode, adding an empty one if create
+SharedObject *shared_find(SharedTable *table, int kind, unsigned long inode, int create) {
+    if (2 * (table->count + 1) > table->nslots) {
+        size_t nslots = table->nslots ? 2 * table->nslots : 256;
+        size_t *slots = calloc(nslots, sizeof(*slots));
+        if (!slots) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < table->count; i++) {
+            SharedObject *o = &table->items[i];
+            size_t j = (size_t)mix_key(o->kind, o->inode) & (nslots - 1);
+            while (slots[j])
+                j = (j + 1) & (nslots - 1);
+            slots[j] = i + 1;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->nslots = nslots;
+    }
+
+    size_t mask = table->nslots - 1;
+    size_t j = (size_t)mix_key(kind, inode) & mask;
+    for (; table->slots[j]; j = (j + 1) & mask) {
+        SharedObject *o = &table->items[table->slots[j] - 1];
+        if (o->kind == kind && o->inode == inode)
+            return o;
+    }
+    if (!create)
+        return NULL;
+
+    if (table->count == table->cap) {
+        table->cap = table->cap ? 2 * table->cap : 64;
+        table->items = xrealloc(table->items, table->cap * sizeof(SharedObject));
+    }
+    SharedObject *o = &table->items[table->count++];
+    memset(o, 0, sizeof(*o));
+    o->kind = kind;
+    o->inode = inode;
+    o->name = "";
+    table->slots[j] = table->count;
+    return o;
+}
+
+void shared_add_pid(SharedObject *o, pid_t pid) {
+    // Processes are scanned one at a time, so a repeat can only be the last
+    if (o->npids && o->pids[o->npids - 1] == pid)
+        return;
+    if (o->npids == o->pids_cap) {
+        o->pids_cap = o->pids_cap ? 2 * o->pids_cap : 4;
+        o->pids = xrealloc(o->pids, o->pids_cap * sizeof(pid_t));
+    }
+    o->pids[o->npids++] = pid;
+}
+
+// Parse a possibly negative decimal field
+static inline long parse_signed(const char **p, const char *end) {
+    int neg = *p < end && **p == '-';
+    if (neg)
+        (*p)++;
+    long v = (long)parse_dec(p, end);
+    return neg ? -v : v;
+}
+
+static inline unsigned long parse_oct(const char **p, const char *end) {
+    unsigned long v = 0;
+    const char *s = *p;
+    for (; s < end && (unsigned)(*s - '0') < 8; s++)
+        v = v * 8 + (unsigned long)(*s - '0');
+    *p = s;
+    return v;
+}
+
+// Load SysV segments. Returns the number found.
+size_t load_sysv_segments(SharedTable *table) {
+    size_t len, found = 0;
+    char *buf = read_whole_file("/proc/sysvipc/shm", &len);
+    if (buf) {
+        // key shmid perms size cpid lpid nattch uid gid cuid cgid atime dtime ctime [rss swap]
+        const char *line = memchr(buf, '\n', len), *end = buf + len;
+        while (line && ++line < end) {
+            const char *nl = memchr(line, '\n', (size_t)(end - line));
+            const char *stop = nl ? nl : end;
+            const char *p = skip_spaces(line, stop);
+            unsigned long fields[16] = {0};
+            long key = parse_signed(&p, stop);
+            int n = 0;
+            for (p = skip_spaces(p, stop); p < stop && n < 16; p = skip_spaces(p, stop), n++)
+                fields[n] = n == 1 ? parse_oct(&p, stop) : parse_dec(&p, stop);
+            line = nl;
+            if (n < 6)
+                continue;
+            SharedObject *o = shared_find(table, SHM_SYSV, fields[0], 1);
+            o->key = key;
+            o->mode = (unsigned)fields[1];
+            o->size = fields[2];
+            o->nattch = fields[5];
+            o->uid = (uid_t)fields[6];
+            o->rss_kb = n > 13 ? fields[13] / 1024 : 0;
+            found++;
+        }
+        free(buf);
+        return found;
+    }
+
+#ifdef SHM_INFO
+    // No procfs: walk the used index range instead of guessing ids
+    struct shm_info info;
+    struct shmid_ds ds;
+    int max_index = shmctl(0, SHM_INFO, (struct shmid_ds *)&info);
+    for (int idx = 0; idx <= max_index; idx++) {
+        int id = shmctl(idx, SHM_STAT, &ds);
+        if (id < 0)
+            continue;
+        SharedObject *o = shared_find(table, SHM_SYSV, (unsigned long)id, 1);
+        o->key = SHM_KEY(ds.shm_perm);
+        o->mode = ds.shm_perm.mode & 0777;
+        o->size = ds.shm_segsz;
+        o->nattch = SHM_NATTCH(ds.shm_nattch);
+        o->uid = ds.shm_perm.uid;
+        found++;
+    }
+#endif
+    return found;
+}
+
+// Load the POSIX shared memory objects in /dev/shm
+size_t load_posix_objects(SharedTable *table) {
+    DIR *dir = opendir("/dev/shm");
+    size_t found = 0;
+    if (!dir)
+        return 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        struct stat st;
+        if (entry->d_name[0] == '.' || fstatat(dirfd(dir), entry->d_name, &st, 0) < 0 ||
+            !S_ISREG(st.st_mode))
+            continue;
+        SharedObject *o = shared_find(table, SHM_POSIX, st.st_ino, 1);
+        o->name = arena_intern(&table->names, entry->d_name, strlen(entry->d_name));
+        o->size = (unsigned long)st.st_size;
+        o->uid = st.st_uid;
+        o->mode = st.st_mode & 0777;
+        found++;
+    }
+    closedir(dir);
+    return found;
+}
+
+// Strip a trailing " (deleted)" from a mapping's pathname
+static size_t undeleted_len(const char *name) {
+    size_t len = strlen(name);
+    if (len > 10 && strcmp(name + len - 10, " (deleted)") == 0)
+        len -= 10;
+    return len;
+}
+
+// Read every process's maps once and record which shared objects it maps.
+// Returns the number of processes whose maps could not be read.
+size_t scan_shared_mappings(SharedTable *table, size_t *scanned) {
+    DIR *proc_dir = opendir("/proc");
+    if (!proc_dir) {
+        perror("opendir /proc");
+        exit(EXIT_FAILURE);
+    }
+    RegionList list = {0};      // reused for every process
+    size_t denied = 0;
+    struct dirent *entry;
+    *scanned = 0;
+
+    while ((entry = readdir(proc_dir))) {
+        const char *p = entry->d_name, *end = p + strlen(p);
+        pid_t pid = (pid_t)parse_dec(&p, end);
+        if (p != end || p == entry->d_name)
+            continue;
+
+        char rel[300];
+        snprintf(rel, sizeof(rel), "%s/maps", entry->d_name);
+        int fd = openat(dirfd(proc_dir), rel, O_RDONLY | O_CLOEXEC);
+        list.count = 0;
+        if (fd < 0 || read_regions_fd(fd, &list) < 0) {
+            if (errno == EACCES || errno == EPERM)
+                denied++;
+            if (fd >= 0)
+                close(fd);
+            continue;
+        }
+        close(fd);
+        (*scanned)++;
+
+        for (size_t i = 0; i < list.count; i++) {
+            MemoryRegion *r = &list.items[i];
+            const char *name = r->pathname;
+            SharedObject *o = NULL;
+            if (strncmp(name, "/SYSV", 5) == 0) {
+                o = shared_find(table, SHM_SYSV, r->inode, 1);
+                if (!o->size)   // not in sysvipc: remember what we can see
+                    o->key = (long)strtoul(name + 5, NULL, 16);
+            } else if (strncmp(name, "/dev/shm/", 9) == 0) {
+                o = shared_find(table, SHM_POSIX, r->inode, 1);
+                if (!o->name[0])
+                    o->name = arena_intern(&table->names, name + 9, undeleted_len(name + 9));
+            } else if (strncmp(name, "/memfd:", 7) == 0) {
+                o = shared_find(table, SHM_MEMFD, r->inode, 1);
+                if (!o->name[0])
+                    o->name = arena_intern(&table->names, name + 7, undeleted_len(name + 7));
+            } else {
+                continue;
+            }
+            // memfds have no size anywhere else; use the furthest byte mapped
+            if (o->kind == SHM_MEMFD && r->offset + r->size > o->size)
+                o->size = r->offset + r->size;
+            else if (o->kind == SHM_SYSV && !o->size)
+                o->size = r->size;
+            shared_add_pid(o, pid);
+        }
+    }
+    closedir(proc_dir);
+    region_list_free(&list);
+    return denied;
+}
+
+// Print up to a handful of PIDs, then how many more there are
+void print_pids(const SharedObject *o) {
+    size_t shown = o->npids < 6 ? o->npids : 6;
+    if (!o->npids)
+        printf("-");
+    for (size_t i = 0; i < shown; i++)
+        printf("%s%d", i ? "," : "", o->pids[i]);
+    if (o->npids > shown)
+        printf(" (+%zu more)", o->npids - shown);
+    printf("\n");
+}
+
+// Show system-wide shared memory segments
+void show_shared_memory(int timing) {
+    SharedTable table = {0};
+    struct timespec t0, t1;
+    size_t scanned = 0, counts[SHM_KINDS] = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    load_sysv_segments(&table);
+    load_posix_objects(&table);
+    size_t denied = scan_shared_mappings(&table, &scanned);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (size_t i = 0; i < table.count; i++)
+        counts[table.items[i].kind]++;
+
+    printf("System Shared Memory Segments (%zu):\n", counts[SHM_SYSV]);
+    printf("-----------------------------------------------------\n");
+    printf("%-10s %-10s %-10s %-10s %-10s %-10s %-10s %s\n",
+           "ID", "Key", "Size (KB)", "Owner", "Perms", "Attached", "RSS (KB)", "PIDs");
+    for (size_t i = 0; i < table.count; i++) {
+        SharedObject *o = &table.items[i];
+        if (o->kind != SHM_SYSV)
+            continue;
+        printf("%-10lu 0x%08lx %-10lu %-10u %-10o %-10lu %-10lu ",
+               o->inode, (unsigned long)o->key & 0xffffffffUL, o->size / 1024,
+               (unsigned)o->uid, o->mode & 0777, o->nattch, o->rss_kb);
+        print_pids(o);
+    }
+
+    printf("\nPOSIX Shared Memory Objects in /dev/shm (%zu):\n", counts[SHM_POSIX]);
+    printf("-----------------------------------------------------\n");
+    printf("%-32s %-10s %-10s %-10s %s\n", "Name", "Size (KB)", "Owner", "Perms", "PIDs");
+    for (size_t i = 0; i < table.count; i++) {
+        SharedObject *o = &table.items[i];
+        if (o->kind != SHM_POSIX)
+            continue;
+        printf("%-32s %-10lu %-10u %-10o ", o->name, o->size / 1024, (unsigned)o->uid, o->mode);
+        print_pids(o);
+    }
+
+    printf("\nmemfd Objects (%zu):\n", counts[SHM_MEMFD]);
+    printf("-----------------------------------------------------\n");
+    printf("%-32s %-10s %-10s %s\n", "Name", "Inode", "Mapped KB", "PIDs");
+    for (size_t i = 0; i < table.count; i++) {
+        SharedObject *o = &table.items[i];
+        if (o->kind != SHM_MEMFD)
+            continue;
+        printf("%-32s %-10lu %-10lu ", o->name, o->inode, o->size / 1024);
+        print_pids(o);
+    }
+
+    if (denied)
+        printf("\n(%zu processes could not be read; run as root to see all attachments)\n", denied);
+    if (timing)
+        fprintf(stderr, "Found %zu objects across %zu processes in %.3f ms\n", table.count, scanned,
+                (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+
+    for (size_t i = 0; i < table.count; i++)
+        free(table.items[i].pids);
+    free(table.items);
+    free(table.slots);
+    arena_free(&table.names);
+}
+
+// Page-level residency (--pages). /proc/PID/pagemap has one 64-bit entry
+// per virtual page; only the mapped regions from maps are read, so a sparse
+// multi-TB address space costs no more than what is actually mapped, and
+// each region is read in PAGEMAP_BATCH-entry preads. When /proc/kpageflags
+// can be read (CAP_SYS_ADMIN, which also makes pagemap report PFNs) every
+// resident page is looked up there to see whether it is part of a THP or
+// hugetlb page; runs of consecutive PFNs are read with a single pread.
+// Otherwise THP coverage comes from the AnonHugePages line of smaps.
+
+#define PAGEMAP_BATCH 65536     // pagemap entries per pread (512 KB)
+#define PM_PRESENT    (1ULL << 63)
+#define PM_SWAPPED    (1ULL << 62)
+#define PM_PFN_MASK   ((1ULL << 55) - 1)
+#define KPF_HUGE      17        // hugetlbfs page
+#define KPF_THP       22        // transparent huge page
+
+// Types as returned by get_region_type, for the per-type summary
+static const char *region_types[] = {
+    "heap", "stack", "vdso", "vsyscall", "anonymous", "shared_memory", "file_mapped", "other"
+};
+#define REGION_TYPES (sizeof(region_types) / sizeof(region_types[0]))
+
+typedef struct {
+    unsigned long pages;
+    unsigned long resident;
+    unsigned long swapped;
+    unsigned long huge;         // resident pages backed by THP or hugetlb
+} PageCounts;
+
+// Count the pages of one region. Returns 0, or -1 if pagemap could not be
+// read. PROT_NONE regions are address space reservations (a JVM reserves
+// its whole maximum heap this way) and are counted without being read.
+int scan_region_pages(int pagemap_fd, int kflags_fd, const MemoryRegion *r, size_t page,
+                      uint64_t *entries, uint64_t *flags, PageCounts *out) {
+    memset(out, 0, sizeof(*out));
+    out->pages = r->size / page;
+    if (strcmp(r->permissions, "---p") == 0 || strcmp(r->permissions, "---s") == 0)
+        return 0;
+    if (strstr(r->pathname, "[vsyscall]"))
+        return 0;
+
+    for (unsigned long first = r->start / page, left = out->pages; left > 0;) {
+        size_t want = left < PAGEMAP_BATCH ? left : PAGEMAP_BATCH;
+        ssize_t got = pread(pagemap_fd, entries, want * sizeof(uint64_t),
+                            (off_t)(first * sizeof(uint64_t)));
+        if (got < 0)
+            return -1;
+        size_t n = (size_t)got / sizeof(uint64_t);
+        if (n == 0)
+            break;
+
+        for (size_t i = 0; i < n;) {
+            uint64_t e = entries[i];
+            if (e & PM_SWAPPED)
+                out->swapped++;
+            if (!(e & PM_PRESENT)) {
+                i++;
+                continue;
+            }
+            out->resident++;
+            uint64_t pfn = e & PM_PFN_MASK;
+            if (kflags_fd < 0 || pfn == 0) {
+                i++;
+                continue;
+            }
+            // Extend to a run of resident pages with consecutive PFNs
+            size_t j = i + 1;
+            while (j < n && (entries[j] & PM_PRESENT) &&
+                   (entries[j] & PM_PFN_MASK) == pfn + (j - i))
+                j++;
+            out->resident += j - i - 1;
+            ssize_t fl = pread(kflags_fd, flags, (j - i) * sizeof(uint64_t),
+                               (off_t)(pfn * sizeof(uint64_t)));
+            for (ssize_t k = 0; k < fl / (ssize_t)sizeof(uint64_t); k++)
+                if (flags[k] & ((1ULL << KPF_THP) | (1ULL << KPF_HUGE)))
+                    out->huge++;
+            i = j;
+        }
+        first += n;
+        left -= n;
+    }
+    return 0;
+}
+
+static double percent(unsigned long part, unsigned long whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+// Show which pages of each region are resident, swapped or huge-page backed
+void show_page_residency(pid_t pid, const char *filter, int timing) {
+    char path[PATH_MAX];
+    RegionList list = {0};
+    struct timespec t0, t1;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    snprintf(path, sizeof(path), "/proc/%d/pagemap", pid);
+    int pagemap_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (pagemap_fd < 0) {
+        fprintf(stderr, "Error: cannot read %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    int kflags_fd = open("/proc/kpageflags", O_RDONLY | O_CLOEXEC);
+
+    // Without kpageflags the AnonHugePages counts in smaps are the fallback
+    load_regions(pid, kflags_fd >= 0 ? "maps" : "smaps", &list, timing);
+
+    uint64_t *entries = xrealloc(NULL, PAGEMAP_BATCH * sizeof(uint64_t));
+    uint64_t *flags = xrealloc(NULL, PAGEMAP_BATCH * sizeof(uint64_t));
+    PageCounts by_type[REGION_TYPES] = {{0}};
+    PageCounts total = {0};
+
+    printf("Page residency for PID %d:\n", pid);
+    printf("-----------------------------------------------------\n");
+    printf("%-33s %-5s %11s %9s %9s %9s %s\n",
+           "Address Range", "Perms", "Size", "Resident", "Swapped", "Huge", "Pathname");
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t i = 0; i < list.count; i++) {
+        MemoryRegion *r = &list.items[i];
+        const char *type = get_region_type(r);
+        PageCounts c;
+
+        if (filter && strcmp(filter, type) != 0)
+            continue;
+        if (scan_region_pages(pagemap_fd, kflags_fd, r, page, entries, flags, &c) < 0) {
+            fprintf(stderr, "Error: cannot read %s: %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (kflags_fd < 0) {
+            c.huge = r->anon_huge_kb * 1024 / page;
+            if (c.huge > c.resident)
+                c.huge = c.resident;
+        }
+
+        printf("%016lx-%016lx %s %8lu KB %8.1f%% %8.1f%% %8.1f%% %s\n",
+               r->start, r->end, r->permissions, r->size / 1024,
+               percent(c.resident, c.pages), percent(c.swapped, c.pages),
+               percent(c.huge, c.pages), r->pathname);
+
+        size_t t = 0;
+        while (t < REGION_TYPES - 1 && strcmp(region_types[t], type) != 0)
+            t++;
+        by_type[t].pages += c.pages;
+        by_type[t].resident += c.resident;
+        by_type[t].swapped += c.swapped;
+        by_type[t].huge += c.huge;
+        total.pages += c.pages;
+        total.resident += c.resident;
+        total.swapped += c.swapped;
+        total.huge += c.huge;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("\nResidency by Region Type:\n");
+    printf("-----------------------------------------------------\n");
+    printf("%-14s %12s %12s %9s %9s %9s\n",
+           "Type", "Size (KB)", "Resident KB", "Resident", "Swapped", "Huge");
+    for (size_t t = 0; t <= REGION_TYPES; t++) {
+        PageCounts *c = t < REGION_TYPES ? &by_type[t] : &total;
+        if (t < REGION_TYPES && c->pages == 0)
+            continue;
+        printf("%-14s %12lu %12lu %8.1f%% %8.1f%% %8.1f%%\n",
+               t < REGION_TYPES ? region_types[t] : "total",
+               c->pages * (page / 1024), c->resident * (page / 1024),
+               percent(c->resident, c->pages), percent(c->swapped, c->pages),
+               percent(c->huge, c->pages));
+    }
+    printf("(huge pages from %s; PROT_NONE reservations are not scanned)\n",
+           kflags_fd >= 0 ? "/proc/kpageflags" : "smaps AnonHugePages");
+
+    if (timing) {
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        fprintf(stderr, "Scanned %lu pages of %zu regions in %.3f ms\n", total.pages, list.count, ms);
+    }
+
+    free(entries);
+    free(flags);
+    region_list_free(&list);
+    if (kflags_fd >= 0)
+        close(kflags_fd);
+    close(pagemap_fd);
+}
+
+// NUMA placement (--numa). /proc/PID/numa_maps has one line per VMA with
+// its memory policy and the number of pages on each node ("N1=512"); it
+// is read in a single pass with the maps tokenizer and joined to the maps
+// regions on start address, which both files list in the same order. The
+// nodes local to the process are the ones whose CPUs (sysfs cpumap)
+// intersect the Cpus_allowed mask in /proc/PID/status; regions with most
+// of their pages elsewhere are flagged.
+
+#define NUMA_MAX_NODES  64      // node masks are one uint64_t
+#define CPU_MASK_WORDS  128     // up to 8192 CPUs
+#define NUMA_REMOTE_PCT 50      // flag regions more remote than this
+
+// numa_maps being joined to a region list
+typedef struct {
+    RegionList *list;
+    size_t next;                // first region not yet matched
+    unsigned nnodes;
+    unsigned long *node_kb;     // list->count rows of nnodes, in KB
+    const char **policy;        // interned in list->names
+    size_t matched;
+} NumaJoin;
+
+// Parse a kernel hex CPU or node mask such as "ff,00000003" into mask.
+// Words are 32-bit groups, most significant first, so it is read from the
+// right.
+void parse_cpumask(const char *s, const char *end, uint64_t *mask, size_t words) {
+    memset(mask, 0, words * sizeof(uint64_t));
+    size_t bit = 0;
+    for (const char *q = end; q > s && bit < words * 64;) {
+        unsigned c = (unsigned char)*--q, d;
+        if (c == ',')
+            continue;
+        if (c - '0' < 10)
+            d = c - '0';
+        else if ((c | 0x20) - 'a' < 6)
+            d = (c | 0x20) - 'a' + 10;
+        else if (bit == 0)
+            continue;           // trailing newline
+        else
+            break;
+        mask[bit / 64] |= (uint64_t)d << (bit % 64);
+        bit += 4;
+    }
+}
+
+// Parse a node list such as "0-3,6" into a mask of nodes below NUMA_MAX_NODES
+uint64_t parse_node_list(const char *p, const char *end) {
+    uint64_t mask = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        unsigned long lo = parse_dec(&p, end), hi = lo;
+        if (p < end && *p == '-') {
+            p++;
+            hi = parse_dec(&p, end);
+        }
+        for (unsigned long n = lo; n <= hi && n < NUMA_MAX_NODES; n++)
+            mask |= 1ULL << n;
+        if (p < end && *p == ',')
+            p++;
+    }
+    return mask;
+}
+
+// One numa_maps line: "<start> <policy> [file=...] [anon=N] ... N0=N ..."
+static void numa_line(const char *line, const char *end, void *arg) {
+    NumaJoin *j = arg;
+    const char *p = line;
+    unsigned long start = parse_hex(&p, end);
+    if (p == line || p >= end || *p != ' ')
+        return;
+
+    // Both files are in address order; anything maps has that numa_maps
+    // lacks (the process changed between the two reads) is skipped
+    while (j->next < j->list->count && j->list->items[j->next].start < start)
+        j->next++;
+    if (j->next == j->list->count || j->list->items[j->next].start != start)
+        return;
+    size_t idx = j->next++;
+    j->matched++;
+
+    p = skip_spaces(p, end);
+    const char *word = p;
+    while (p < end && *p != ' ')
+        p++;
+    j->policy[idx] = arena_intern(&j->list->names, word, (size_t)(p - word));
+
+    // Node counts are in pages of kernelpagesize_kB, which comes last
+    unsigned long pages[NUMA_MAX_NODES] = {0}, page_kb = 4;
+    while ((p = skip_spaces(p, end)) < end) {
+        word = p;
+        while (p < end && *p != ' ')
+            p++;
+        if (word[0] == 'N' && (unsigned)(word[1] - '0') < 10) {
+            const char *q = word + 1;
+            unsigned long node = parse_dec(&q, p);
+            if (q < p && *q == '=' && node < j->nnodes) {
+                q++;
+                pages[node] = parse_dec(&q, p);
+            }
+        } else if (p - word > 18 && memcmp(word, "kernelpagesize_kB=", 18) == 0) {
+            const char *q = word + 18;
+            page_kb = parse_dec(&q, p);
+        }
+    }
+    unsigned long *kb = &j->node_kb[idx * j->nnodes];
+    for (unsigned n = 0; n < j->nnodes; n++)
+        kb[n] = pages[n] * page_kb;
+}
+
+// Nodes whose CPUs the process may run on. Returns 0 if that cannot be
+// worked out (no sysfs node directory, or nodes without any CPUs).
+uint64_t local_numa_nodes(pid_t pid, uint64_t online) {
+    char path[PATH_MAX];
+    uint64_t allowed[CPU_MASK_WORDS], cpus[CPU_MASK_WORDS], local = 0;
+    size_t len;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    char *status = read_whole_file(path, &len);
+    if (!status)
+        return 0;
+    const char *line = strstr(status, "\nCpus_allowed:");
+    if (!line) {
+        free(status);
+        return 0;
+    }
+    line = skip_spaces(line + 14, status + len);
+    while (*line == '\t')
+        line++;
+    const char *eol = strchr(line, '\n');
+    parse_cpumask(line, eol ? eol : status + len, allowed, CPU_MASK_WORDS);
+    free(status);
+
+    for (unsigned n = 0; n < NUMA_MAX_NODES; n++) {
+        if (!(online & (1ULL << n)))
+            continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpumap", n);
+        char *map = read_whole_file(path, &len);
+        if (!map)
+            continue;
+        parse_cpumask(map, map + len, cpus, CPU_MASK_WORDS);
+        free(map);
+        for (size_t w = 0; w < CPU_MASK_WORDS; w++) {
+            if (cpus[w] & allowed[w]) {
+                local |= 1ULL << n;
+                break;
+            }
+        }
+    }
+    return local;
+}
+
+// Print a node mask as a list, e.g. "0-1,3"
+void print_node_list(uint64_t mask) {
+    const char *sep = "";
+    for (unsigned n = 0; n < NUMA_MAX_NODES; n++) {
+        if (!(mask & (1ULL << n)))
+            continue;
+        unsigned last = n;
+        while (last + 1 < NUMA_MAX_NODES && (mask & (1ULL << (last + 1))))
+            last++;
+        if (last == n)
+            printf("%s%u", sep, n);
+        else
+            printf("%s%u-%u", sep, n, last);
+        sep = ",";
+        n = last;
+    }
+    if (!*sep)
+        printf("unknown");
+}
+
+// Show how each region's pages are spread over the NUMA nodes
+void show_numa_placement(pid_t pid, const char *filter, int timing) {
+    char path[PATH_MAX];
+    RegionList list = {0};
+    struct timespec t0, t1;
+    size_t len;
+
+    // Only online nodes get a column; without sysfs there is just node 0
+    uint64_t online = 1;
+    char *nodes = read_whole_file("/sys/devices/system/node/online", &len);
+    if (nodes) {
+        online = parse_node_list(nodes, nodes + len);
+        free(nodes);
+    }
+    unsigned nnodes = online ? 64 - (unsigned)__builtin_clzll(online) : 1;
+    uint64_t local = local_numa_nodes(pid, online);
+
+    load_regions(pid, "maps", &list, timing);
+
+    NumaJoin join = { &list, 0, nnodes, NULL, NULL, 0 };
+    join.node_kb = calloc(list.count ? list.count * nnodes : 1, sizeof(unsigned long));
+    join.policy = calloc(list.count ? list.count : 1, sizeof(const char *));
+    if (!join.node_kb || !join.policy) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/numa_maps", pid);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || read_lines_fd(fd, numa_line, &join) < 0) {
+        fprintf(stderr, "Error: cannot read %s: %s\n", path,
+                errno == ENOENT ? "kernel built without NUMA support" : strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("NUMA placement for PID %d (local nodes: ", pid);
+    print_node_list(local);
+    printf("):\n");
+    printf("-----------------------------------------------------\n");
+    printf("  %-33s %-5s %11s %-14s", "Address Range", "Perms", "Size", "Policy");
+    char label[16];
+    for (unsigned n = 0; n < nnodes; n++) {
+        snprintf(label, sizeof(label), "N%u", n);
+        if (online & (1ULL << n))
+            printf(" %9s", label);
+    }
+    printf(" %7s %s\n", "Remote", "Pathname");
+
+    // Per-type rows are node KB followed by the remote KB
+    unsigned long *by_type = calloc((REGION_TYPES + 1) * (nnodes + 1), sizeof(unsigned long));
+    if (!by_type) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    unsigned long flagged = 0, flagged_kb = 0;
+
+    for (size_t i = 0; i < list.count; i++) {
+        MemoryRegion *r = &list.items[i];
+        const char *type = get_region_type(r);
+        const unsigned long *kb = &join.node_kb[i * nnodes];
+
+        if (filter && strcmp(filter, type) != 0)
+            continue;
+        unsigned long on_nodes = 0, remote = 0;
+        for (unsigned n = 0; n < nnodes; n++) {
+            on_nodes += kb[n];
+            if (local && !(local & (1ULL << n)))
+                remote += kb[n];
+        }
+        int far = on_nodes && remote * 100 > on_nodes * NUMA_REMOTE_PCT;
+        if (far) {
+            flagged++;
+            flagged_kb += remote;
+        }
+
+        printf("%c %016lx-%016lx %s %8lu KB %-14s", far ? '!' : ' ',
+               r->start, r->end, r->permissions, r->size / 1024,
+               join.policy[i] ? join.policy[i] : "-");
+        for (unsigned n = 0; n < nnodes; n++)
+            if (online & (1ULL << n))
+                printf(" %6lu KB", kb[n]);
+        printf(" %6.1f%% %s\n", percent(remote, on_nodes), r->pathname);
+
+        size_t t = 0;
+        while (t < REGION_TYPES - 1 && strcmp(region_types[t], type) != 0)
+            t++;
+        for (size_t row = t; ; row = REGION_TYPES) {
+            unsigned long *sum = &by_type[row * (nnodes + 1)];
+            for (unsigned n = 0; n < nnodes; n++)
+                sum[n] += kb[n];
+            sum[nnodes] += remote;
+            if (row == REGION_TYPES)
+                break;
+        }
+    }
+
+    printf("\nNode Distribution by Region Type:\n");
+    printf("-----------------------------------------------------\n");
+    printf("%-14s", "Type");
+    for (unsigned n = 0; n < nnodes; n++) {
+        snprintf(label, sizeof(label), "N%u", n);
+        if (online & (1ULL << n))
+            printf(" %10s", label);
+    }
+    printf(" %7s\n", "Remote");
+    for (size_t t = 0; t <= REGION_TYPES; t++) {
+        const unsigned long *sum = &by_type[t * (nnodes + 1)];
+        unsigned long on_nodes = 0;
+        for (unsigned n = 0; n < nnodes; n++)
+            on_nodes += sum[n];
+        if (t < REGION_TYPES && on_nodes == 0)
+            continue;
+        printf("%-14s", t < REGION_TYPES ? region_types[t] : "total");
+        for (unsigned n = 0; n < nnodes; n++)
+            if (online & (1ULL << n))
+                printf(" %7lu KB", sum[n]);
+        printf(" %6.1f%%\n", percent(sum[nnodes], on_nodes));
+    }
+
+    if (!local)
+        printf("(could not tell which nodes are local; nothing is flagged)\n");
+    else if (flagged)
+        printf("! %lu regions have most of their pages on remote nodes (%lu KB remote)\n",
+               flagged, flagged_kb);
+    else
+        printf("No region has most of its pages on remote nodes\n");
+
+    if (timing) {
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        fprintf(stderr, "Joined %zu of %zu regions from %s in %.3f ms\n",
+                join.matched, list.count, path, ms);
+    }
+
+    free(by_type);
+    free(join.node_kb);
+    free(join.policy);
+    region_list_free(&list);
+}
+
+// Continuous sampling (--watch). Each watched process keeps its statm,
+// smaps_rollup and maps fds open and re-reads them with pread(), so a
+// sample costs three reads and no path lookups. Consecutive region lists
+// are diffed with a sorted merge on start address (maps is already in
+// address order), and totals or regions that keep growing are flagged.
+
+enum { TOT_VSZ, TOT_RSS, TOT_PSS, TOT_SWAP, TOT_COUNT };
+
+static const char *total_names[TOT_COUNT] = { "vsz", "rss", "pss", "swap" };
+
+// Growth tracking for one value: streak counts samples in which it grew
+// and is reset when it shrinks; staying level neither helps nor hurts.
+typedef struct {
+    unsigned long value;
+    unsigned long since;        // value when the streak started
+    unsigned streak;
+} Growth;
+
+// A region change found by the diff, printed after the sample's summary
+typedef struct {
+    char sign;                  // '+' new, '-' gone, '~' resized, '!' keeps growing
+    MemoryRegion region;
+    unsigned long old_size;
+    unsigned streak;
+} WatchEvent;
+
+typedef struct {
+    pid_t pid;
+    int statm_fd;
+    int rollup_fd;              // -1 if smaps_rollup cannot be read
+    int maps_fd;
+    RegionList cur;             // this sample; also owns the pathname arena
+    MemoryRegion *prev;         // previous sample, sorted by start
+    size_t prev_count;
+    size_t prev_cap;
+    Growth *prev_growth;        // parallel to prev
+    size_t prev_growth_cap;
+    Growth *cur_growth;         // parallel to cur.items
+    size_t cur_growth_cap;
+    Growth totals[TOT_COUNT];
+    RegionList rollup;
+    WatchEvent *events;
+    size_t nevents;
+    size_t events_cap;
+    int samples;
+} WatchTarget;
+
+// Update g with a new value; returns 1 if it has now grown in at least
+// threshold samples without shrinking
+int growth_update(Growth *g, unsigned long value, int first, unsigned threshold) {
+    if (first || value < g->value) {
+        g->streak = 0;
+        g->since = value;
+    } else if (value > g->value) {
+        g->streak++;
+    }
+    int grew = !first && value > g->value;
+    g->value = value;
+    return grew && g->streak >= threshold;
+}
+
+int watch_open(WatchTarget *t, pid_t pid) {
+    char path[PATH_MAX];
+    memset(t, 0, sizeof(*t));
+    t->pid = pid;
+
+    snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+    t->statm_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    t->maps_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    t->rollup_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (t->statm_fd < 0 || t->maps_fd < 0) {
+        fprintf(stderr, "Error: cannot watch PID %d: %s\n", pid, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void watch_close(WatchTarget *t) {
+    if (t->statm_fd >= 0)
+        close(t->statm_fd);
+    if (t->maps_fd >= 0)
+        close(t->maps_fd);
+    if (t->rollup_fd >= 0)
+        close(t->rollup_fd);
+    region_list_free(&t->cur);
+    region_list_free(&t->rollup);
+    free(t->prev);
+    free(t->prev_growth);
+    free(t->cur_growth);
+    free(t->events);
+    t->events = NULL;
+    t->prev = NULL;
+    t->prev_growth = t->cur_growth = NULL;
+    t->statm_fd = t->maps_fd = t->rollup_fd = -1;
+}
+
+void add_watch_event(WatchTarget *t, char sign, const MemoryRegion *r,
+                     unsigned long old_size, unsigned streak) {
+    if (t->nevents == t->events_cap) {
+        t->events_cap = t->events_cap ? 2 * t->events_cap : 64;
+        t->events = xrealloc(t->events, t->events_cap * sizeof(WatchEvent));
+    }
+    WatchEvent *e = &t->events[t->nevents++];
+    e->sign = sign;
+    e->region = *r;
+    e->old_size = old_size;
+    e->streak = streak;
+}
+
+void print_watch_event(const WatchEvent *e) {
+    const MemoryRegion *r = &e->region;
+    const char *name = r->pathname[0] ? r->pathname : "[anon]";
+    if (e->sign == '!') {
+        printf("    ! %016lx-%016lx %s grew in %u samples: %lu -> %lu KB\n",
+               r->start, r->end, name, e->streak, e->old_size / 1024, r->size / 1024);
+        return;
+    }
+    printf("    %c %016lx-%016lx %s ", e->sign, r->start, r->end, r->permissions);
+    if (e->sign == '~')
+        printf("%lu -> %lu KB", e->old_size / 1024, r->size / 1024);
+    else
+        printf("%lu KB", r->size / 1024);
+    printf(" %s\n", name);
+}
+
+// Take one sample of t. Returns 0, or -1 once the process has gone away.
+int watch_sample(WatchTarget *t, double elapsed, unsigned threshold, int verbose) {
+    static unsigned long page_kb;
+    char buf[256];
+    unsigned long tot[TOT_COUNT] = {0};
+
+    if (!page_kb)
+        page_kb = (unsigned long)sysconf(_SC_PAGESIZE) / 1024;
+
+    ssize_t n = pread(t->statm_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return -1;
+    const char *p = buf, *end = buf + n;
+    tot[TOT_VSZ] = parse_dec(&p, end) * page_kb;
+    p = skip_spaces(p, end);
+    tot[TOT_RSS] = parse_dec(&p, end) * page_kb;
+
+    if (t->rollup_fd >= 0) {
+        t->rollup.count = 0;
+        if (read_regions_fd(t->rollup_fd, &t->rollup) == 0 && t->rollup.count) {
+            tot[TOT_PSS] = t->rollup.items[0].pss_kb;
+            tot[TOT_SWAP] = t->rollup.items[0].swap_kb;
+        }
+    }
+
+    t->cur.count = 0;
+    if (read_regions_fd(t->maps_fd, &t->cur) < 0)
+        return -1;
+    if (t->cur.count > t->cur_growth_cap) {
+        t->cur_growth_cap = t->cur.cap;
+        t->cur_growth = xrealloc(t->cur_growth, t->cur_growth_cap * sizeof(Growth));
+    }
+
+    // Sorted merge of the previous and current region lists
+    int first = t->samples++ == 0;
+    size_t i = 0, j = 0, added = 0, removed = 0, changed = 0;
+    t->nevents = 0;
+    while (i < t->prev_count || j < t->cur.count) {
+        MemoryRegion *a = i < t->prev_count ? &t->prev[i] : NULL;
+        MemoryRegion *b = j < t->cur.count ? &t->cur.items[j] : NULL;
+        // Regions that grow downwards (the stack, merged mmaps) keep their end
+        int same = a && b && (a->start == b->start ||
+                              (a->end == b->end && a->pathname == b->pathname));
+        if (!same && b && (!a || b->start < a->start)) {
+            if (!first) {
+                added++;
+                if (verbose)
+                    add_watch_event(t, '+', b, 0, 0);
+            }
+            growth_update(&t->cur_growth[j], b->size, 1, threshold);
+            j++;
+        } else if (!same) {
+            removed++;
+            if (verbose)
+                add_watch_event(t, '-', a, 0, 0);
+            i++;
+        } else {
+            Growth *g = &t->cur_growth[j];
+            *g = t->prev_growth[i];
+            if (a->size != b->size || a->pathname != b->pathname) {
+                changed++;
+                if (verbose)
+                    add_watch_event(t, '~', b, a->size, 0);
+            }
+            if (growth_update(g, b->size, a->pathname != b->pathname, threshold))
+                add_watch_event(t, '!', b, g->since, g->streak);
+            i++;
+            j++;
+        }
+    }
+
+    printf("[%9.3fs] PID %-7d vsz %9lu KB  rss %9lu KB", elapsed, t->pid, tot[TOT_VSZ], tot[TOT_RSS]);
+    if (t->rollup_fd >= 0)
+        printf("  pss %9lu KB  swap %7lu KB", tot[TOT_PSS], tot[TOT_SWAP]);
+    printf("  regions %zu", t->cur.count);
+    if (!first)
+        printf(" (+%zu -%zu ~%zu)", added, removed, changed);
+    printf("\n");
+
+    for (int k = 0; k < TOT_COUNT; k++) {
+        if (growth_update(&t->totals[k], tot[k], first, threshold))
+            printf("    ! %s grew in %u samples: %lu -> %lu KB\n", total_names[k],
+                   t->totals[k].streak, t->totals[k].since, tot[k]);
+    }
+    for (size_t e = 0; e < t->nevents; e++)
+        print_watch_event(&t->events[e]);
+
+    // This sample becomes the previous one; the arrays are swapped, not copied
+    MemoryRegion *items = t->prev;
+    size_t cap = t->prev_cap;
+    Growth *growth = t->prev_growth;
+    size_t growth_cap = t->prev_growth_cap;
+    t->prev = t->cur.items;
+    t->prev_count = t->cur.count;
+    t->prev_cap = t->cur.cap;
+    t->prev_growth = t->cur_growth;
+    t->prev_growth_cap = t->cur_growth_cap;
+    t->cur.items = items;
+    t->cur.cap = cap;
+    t->cur_growth = growth;
+    t->cur_growth_cap = growth_cap;
+    return 0;
+}
+
+// Sample every target each interval until count samples have been taken
+// (0 = forever) or all of them have exited. Samples are scheduled on
+// absolute times so the interval does not drift with the sampling cost.
+void watch_processes(const pid_t *pids, int npids, double interval, long count,
+                     unsigned threshold, int verbose, int timing) {
+    WatchTarget *targets = calloc((size_t)npids, sizeof(*targets));
+    if (!targets) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    // Three fds stay open per process; allow as many as the hard limit does
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    int live = 0;
+    for (int i = 0; i < npids; i++) {
+        if (watch_open(&targets[i], pids[i]) < 0)
+            exit(EXIT_FAILURE);
+        live++;
+    }
+
+    // Flush after every sample so a pipe or log file sees it right away
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    struct timespec start, next, t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    next = start;
+    for (long sample = 0; live && (count == 0 || sample < count); sample++) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        double elapsed = (t0.tv_sec - start.tv_sec) + (t0.tv_nsec - start.tv_nsec) / 1e9;
+        for (int i = 0; i < npids; i++) {
+            WatchTarget *t = &targets[i];
+            if (t->statm_fd < 0)
+                continue;
+            if (watch_sample(t, elapsed, threshold, verbose) < 0) {
+                printf("[%9.3fs] PID %-7d exited\n", elapsed, t->pid);
+                watch_close(t);
+                live--;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (timing)
+            fprintf(stderr, "Sampled %d processes in %.3f ms\n", live,
+                    (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+
+        long step = (long)(interval * 1e9);
+        next.tv_sec += step / 1000000000L;
+        next.tv_nsec += step % 1000000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        if (live && (count == 0 || sample + 1 < count))
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+                ;
+    }
+
+    for (int i = 0; i < npids; i++)
+        watch_close(&targets[i]);
+    free(targets);
+}
+
+// System-wide process scan. Walking /proc with fopen() on comm and status
+// for every task costs seconds on hosts with tens of thousands of them, so
+// each PID is read with openat() relative to one /proc dirfd and a single
+// pread() of statm and stat, spread over a pool of threads. Each thread
+// keeps its own bounded heap of the best N entries; the heaps are merged at
+// the end, so memory stays O(threads * N) however many processes there are.
+
+#define SCAN_BATCH 64      // PIDs a worker claims at a time
+
+enum { SORT_RSS, SORT_PSS, SORT_VSZ, SORT_SHARED, SORT_PID, SORT_NAME, SORT_USER };
+
+static const char *sort_names[] = { "rss", "pss", "vsz", "shared", "pid", "name", "user" };
+
+typedef struct {
+    pid_t pid;
+    uid_t uid;
+    char comm[32];
+    unsigned long vsz_kb;
+    unsigned long rss_kb;
+    unsigned long shared_kb;
+    unsigned long pss_kb;       // only read when sorting by PSS
+} ProcessInfo;
+
+typedef struct {
+    size_t top;                 // 0 = every process
+    int sort_key;
+    const char *name;           // substring of the command name, or NULL
+    int by_user;
+    uid_t uid;
+    int threads;                // 0 = one per online CPU
+    int timing;
+} ProcessQuery;
+
+// Bounded heap whose root is the entry that ranks last, so a new entry
+// only has to beat the root to get in
+typedef struct {
+    ProcessInfo *items;
+    size_t count;
+    size_t cap;
+} ProcessHeap;
+
+typedef struct {
+    int procfd;
+    const pid_t *pids;
+    size_t npids;
+    size_t *next;               // shared cursor into pids
+    const ProcessQuery *query;
+    unsigned long page_kb;
+    ProcessHeap heap;
+    size_t matched;
+} ScanWorker;
+
+// Does a rank ahead of b for the given sort key? Ties go to the lower PID.
+int process_before(const ProcessInfo *a, const ProcessInfo *b, int key) {
+    unsigned long x = 0, y = 0;
+    int c;
+    switch (key) {
+        case SORT_RSS:    x = a->rss_kb;    y = b->rss_kb;    break;
+        case SORT_PSS:    x = a->pss_kb;    y = b->pss_kb;    break;
+        case SORT_VSZ:    x = a->vsz_kb;    y = b->vsz_kb;    break;
+        case SORT_SHARED: x = a->shared_kb; y = b->shared_kb; break;
+        case SORT_NAME:
+            c = strcmp(a->comm, b->comm);
+            if (c)
+                return c < 0;
+            break;
+        case SORT_USER:
+            if (a->uid != b->uid)
+                return a->uid < b->uid;
+            x = a->rss_kb;
+            y = b->rss_kb;
+            break;
+    }
+    if (x != y)
+        return x > y;
+    return a->pid < b->pid;
+}
+
+void process_heap_add(ProcessHeap *heap, const ProcessInfo *p, int key) {
+    ProcessInfo *h = heap->items;
+    size_t i;
+    if (heap->count < heap->cap) {
+        // Sift up: parents must rank after their children
+        for (i = heap->count++; i > 0 && process_before(&h[(i - 1) / 2], p, key); i = (i - 1) / 2)
+            h[i] = h[(i - 1) / 2];
+        h[i] = *p;
+        return;
+    }
+    if (!heap->cap || !process_before(p, &h[0], key))
+        return;
+    // Replace the root and sift down
+    for (i = 0;;) {
+        size_t c = 2 * i + 1;
+        if (c >= heap->count)
+            break;
+        if (c + 1 < heap->count && process_before(&h[c], &h[c + 1], key))
+            c++;
+        if (!process_before(p, &h[c], key))
+            break;
+        h[i] = h[c];
+        i = c;
+    }
+    h[i] = *p;
+}
+
+// pread() the whole of a small /proc/PID file into buf. Returns its length,
+// or -1 if the process has gone away or cannot be read.
+ssize_t read_pid_file(int procfd, const char *pid_name, const char *file, char *buf, size_t size) {
+    char rel[64];
+    snprintf(rel, sizeof(rel), "%s/%s", pid_name, file);
+    int fd = openat(procfd, rel, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+// Read one process. Returns 0, or -1 if it vanished or does not match.
+int scan_process(ScanWorker *w, pid_t pid, ProcessInfo *info) {
+    const ProcessQuery *q = w->query;
+    char name[16], buf[1024];
+    struct stat st;
+
+    snprintf(name, sizeof(name), "%d", pid);
+    memset(info, 0, sizeof(*info));
+    info->pid = pid;
+
+    if (fstatat(w->procfd, name, &st, 0) < 0)
+        return -1;
+    info->uid = st.st_uid;
+    if (q->by_user && info->uid != q->uid)
+        return -1;
+
+    // stat: "pid (comm) state ..."; comm may itself contain ')' or spaces
+    ssize_t n = read_pid_file(w->procfd, name, "stat", buf, sizeof(buf));
+    if (n < 0)
+        return -1;
+    char *open_paren = memchr(buf, '(', (size_t)n);
+    char *close_paren = strrchr(buf, ')');
+    if (open_paren && close_paren && close_paren > open_paren) {
+        size_t len = (size_t)(close_paren - open_paren - 1);
+        if (len >= sizeof(info->comm))
+            len = sizeof(info->comm) - 1;
+        memcpy(info->comm, open_paren + 1, len);
+        info->comm[len] = '\0';
+    }
+    if (q->name && !strstr(info->comm, q->name))
+        return -1;
+
+    // statm: size resident shared text lib data dt, all in pages
+    n = read_pid_file(w->procfd, name, "statm", buf, sizeof(buf));
+    if (n < 0)
+        return -1;
+    const char *p = buf, *end = buf + n;
+    info->vsz_kb = parse_dec(&p, end) * w->page_kb;
+    p = skip_spaces(p, end);
+    info->rss_kb = parse_dec(&p, end) * w->page_kb;
+    p = skip_spaces(p, end);
+    info->shared_kb = parse_dec(&p, end) * w->page_kb;
+
+    if (q->sort_key == SORT_PSS &&
+        (n = read_pid_file(w->procfd, name, "smaps_rollup", buf, sizeof(buf))) > 0) {
+        const char *pss = strstr(buf, "\nPss:");
+        if (pss) {
+            p = skip_spaces(pss + 5, buf + n);
+            info->pss_kb = parse_dec(&p, buf + n);
+        }
+    }
+    return 0;
+}
+
+void *scan_worker(void *arg) {
+    ScanWorker *w = arg;
+    ProcessInfo info;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(w->next, SCAN_BATCH, __ATOMIC_RELAXED);
+        if (i >= w->npids)
+            break;
+        size_t stop = i + SCAN_BATCH < w->npids ? i + SCAN_BATCH : w->npids;
+        for (; i < stop; i++) {
+            if (scan_process(w, w->pids[i], &info) == 0) {
+                w->matched++;
+                process_heap_add(&w->heap, &info, w->query->sort_key);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int qsort_key;
+
+int compare_processes(const void *a, const void *b) {
+    return process_before(a, b, qsort_key) ? -1 : 1;
+}
+
+// Show the top processes by memory, scanned in parallel
+void show_process_table(const ProcessQuery *q) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    DIR *proc_dir = opendir("/proc");
+    if (!proc_dir) {
+        perror("opendir /proc");
+        exit(EXIT_FAILURE);
+    }
+
+    // Collect the PIDs first; the directory stream itself is not shared
+    pid_t *pids = NULL;
+    size_t npids = 0, cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(proc_dir))) {
+        const char *p = entry->d_name, *end = p + strlen(p);
+        unsigned long v = parse_dec(&p, end);
+        if (p != end || p == entry->d_name)
+            continue;
+        if (npids == cap) {
+            cap = cap ? 2 * cap : 1024;
+            pids = xrealloc(pids, cap * sizeof(*pids));
+        }
+        pids[npids++] = (pid_t)v;
+    }
+
+    int threads = q->threads;
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > 64)
+        threads = 64;
+    if ((size_t)threads > npids / SCAN_BATCH + 1)
+        threads = (int)(npids / SCAN_BATCH + 1);
+    if (threads < 1)
+        threads = 1;
+
+    size_t top = q->top ? q->top : npids;
+    size_t next = 0;
+    ScanWorker *workers = calloc((size_t)threads, sizeof(*workers));
+    pthread_t *tids = calloc((size_t)threads, sizeof(*tids));
+    if (!workers || !tids) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < threads; t++) {
+        ScanWorker *w = &workers[t];
+        w->procfd = dirfd(proc_dir);
+        w->pids = pids;
+        w->npids = npids;
+        w->next = &next;
+        w->query = q;
+        w->page_kb = (unsigned long)sysconf(_SC_PAGESIZE) / 1024;
+        w->heap.cap = top;
+        w->heap.items = xrealloc(NULL, (top ? top : 1) * sizeof(ProcessInfo));
+        // The calling thread is worker 0
+        if (t > 0 && pthread_create(&tids[t], NULL, scan_worker, w) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    scan_worker(&workers[0]);
+
+    // Merge the per-thread heaps into the first one
+    size_t matched = workers[0].matched;
+    for (int t = 1; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        matched += workers[t].matched;
+        for (size_t i = 0; i < workers[t].heap.count; i++)
+            process_heap_add(&workers[0].heap, &workers[t].heap.items[i], q->sort_key);
+        free(workers[t].heap.items);
+    }
+    ProcessHeap *best = &workers[0].heap;
+    qsort_key = q->sort_key;
+    qsort(best->items, best->count, sizeof(ProcessInfo), compare_processes);
+    closedir(proc_dir);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+    int show_pss = q->sort_key == SORT_PSS;
+    printf("Processes by %s (%zu of %zu matching, %zu scanned):\n",
+           sort_names[q->sort_key], best->count, matched, npids);
+    printf("-----------------------------------------------------\n");
+    printf("%-8s %-12s %-20s %12s %12s %12s", "PID", "User", "Process", "RSS (KB)", "Shared (KB)", "VSZ (KB)");
+    printf(show_pss ? " %12s\n" : "\n", "PSS (KB)");
+    for (size_t i = 0; i < best->count; i++) {
+        ProcessInfo *p = &best->items[i];
+        struct passwd *pw = getpwuid(p->uid);
+        char user[16];
+        if (pw)
+            snprintf(user, sizeof(user), "%s", pw->pw_name);
+        else
+            snprintf(user, sizeof(user), "%u", (unsigned)p->uid);
+        printf("%-8d %-12s %-20s %12lu %12lu %12lu", p->pid, user, p->comm,
+               p->rss_kb, p->shared_kb, p->vsz_kb);
+        if (show_pss)
+            printf(" %12lu", p->pss_kb);
+        printf("\n");
+    }
+    if (q->timing)
+        fprintf(stderr, "Scanned %zu processes with %d threads in %.3f ms\n", npids, threads, ms);
+
+    free(best->items);
+    free(workers);
+    free(tids);
+    free(pids);
+}
+
+// Binary snapshots (--snapshot, --dump, --diff). A snapshot holds every
+// selected process's totals and full region list so two captures can be
+// compared offline. Layout, all in host byte order:
+//
+//   SnapshotHeader
+//   SnapshotProcess[nprocs]     sorted by PID
+//   SnapshotRegion[nregions]    each process's regions, in address order
+//   string table                NUL-terminated, offset 0 is ""
+//
+// Every record is a multiple of 8 bytes so a reader can mmap the file and
+// use the arrays in place. The whole file is built in memory and written
+// with one write() to a temporary name, then renamed into place.
+
+#define SNAPSHOT_MAGIC   "MEMVSNAP"
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int64_t created;            // seconds since the epoch
+    uint32_t nprocs;
+    uint32_t reserved;
+    uint64_t nregions;
+    uint64_t procs_offset;
+    uint64_t regions_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} SnapshotHeader;
+
+typedef struct {
+    int32_t pid;
+    uint32_t uid;
+    uint32_t comm;              // string table offset
+    uint32_t nregions;
+    uint64_t first_region;
+    uint64_t vsz_kb;
+    uint64_t rss_kb;
+    uint64_t pss_kb;            // 0 if smaps_rollup was unreadable
+    uint64_t swap_kb;
+} SnapshotProcess;
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    uint64_t inode;
+    uint32_t pathname;          // string table offset
+    char permissions[4];
+} SnapshotRegion;
+
+_Static_assert(sizeof(SnapshotHeader) % 8 == 0, "snapshot header must stay 8-byte aligned");
+_Static_assert(sizeof(SnapshotProcess) == 56, "snapshot process record changed size");
+_Static_assert(sizeof(SnapshotRegion) == 40, "snapshot region record changed size");
+
+// Interning string table that hands out offsets rather than pointers
+typedef struct {
+    char *data;
+    size_t size;
+    size_t cap;
+    uint32_t *slots;            // offset + 1, 0 = empty
+    size_t nslots;
+    size_t count;
+} StringTable;
+
+uint32_t string_table_add(StringTable *st, const char *s) {
+    size_t len = strlen(s);
+    if (!st->size) {
+        st->cap = 4096;
+        st->data = xrealloc(NULL, st->cap);
+        st->data[0] = '\0';
+        st->size = 1;
+    }
+    if (len == 0)
+        return 0;
+
+    if (2 * (st->count + 1) > st->nslots) {
+        size_t nslots = st->nslots ? 2 * st->nslots : 1024;
+        uint32_t *slots = calloc(nslots, sizeof(*slots));
+        if (!slots) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < st->nslots; i++) {
+            if (!st->slots[i])
+                continue;
+            const char *old = st->data + st->slots[i] - 1;
+            size_t j = hash_bytes(old, strlen(old)) & (nslots - 1);
+            while (slots[j])
+                j = (j + 1) & (nslots - 1);
+            slots[j] = st->slots[i];
+        }
+        free(st->slots);
+        st->slots = slots;
+        st->nslots = nslots;
+    }
+
+    size_t mask = st->nslots - 1;
+    size_t j = hash_bytes(s, len) & mask;
+    for (; st->slots[j]; j = (j + 1) & mask)
+        if (strcmp(st->data + st->slots[j] - 1, s) == 0)
+            return st->slots[j] - 1;
+
+    while (st->size + len + 1 > st->cap) {
+        st->cap *= 2;
+        st->data = xrealloc(st->data, st->cap);
+    }
+    uint32_t off = (uint32_t)st->size;
+    memcpy(st->data + off, s, len + 1);
+    st->size += len + 1;
+    st->slots[j] = off + 1;
+    st->count++;
+    return off;
+}
+
+static int compare_pids(const void *a, const void *b) {
+    pid_t x = *(const pid_t *)a, y = *(const pid_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Capture the given PIDs, or every readable process if npids is 0, into path
+void write_snapshot(const char *path, const pid_t *pids, int npids, int timing) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    int procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (procfd < 0) {
+        perror("open /proc");
+        exit(EXIT_FAILURE);
+    }
+
+    // Work out which processes to capture, in PID order
+    pid_t *todo = NULL;
+    size_t ntodo = 0;
+    if (npids) {
+        todo = xrealloc(NULL, (size_t)npids * sizeof(pid_t));
+        memcpy(todo, pids, (size_t)npids * sizeof(pid_t));
+        ntodo = (size_t)npids;
+    } else {
+        DIR *dir = opendir("/proc");
+        struct dirent *entry;
+        size_t cap = 0;
+        while (dir && (entry = readdir(dir))) {
+            const char *p = entry->d_name, *end = p + strlen(p);
+            unsigned long v = parse_dec(&p, end);
+            if (p != end || p == entry->d_name)
+                continue;
+            if (ntodo == cap) {
+                cap = cap ? 2 * cap : 1024;
+                todo = xrealloc(todo, cap * sizeof(pid_t));
+            }
+            todo[ntodo++] = (pid_t)v;
+        }
+        if (dir)
+            closedir(dir);
+    }
+    qsort(todo, ntodo, sizeof(pid_t), compare_pids);
+
+    SnapshotProcess *procs = xrealloc(NULL, (ntodo ? ntodo : 1) * sizeof(SnapshotProcess));
+    size_t nprocs = 0, nregions = 0, regions_cap = 0;
+    SnapshotRegion *regions = NULL;
+    StringTable strings = {0};
+    RegionList list = {0};
+    unsigned long page_kb = (unsigned long)sysconf(_SC_PAGESIZE) / 1024;
+    string_table_add(&strings, "");
+
+    for (size_t i = 0; i < ntodo; i++) {
+        char name[16], buf[1024], rel[64];
+        struct stat st;
+        snprintf(name, sizeof(name), "%d", todo[i]);
+        snprintf(rel, sizeof(rel), "%s/maps", name);
+
+        int fd = openat(procfd, rel, O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || fstatat(procfd, name, &st, 0) < 0) {
+            if (fd >= 0)
+                close(fd);
+            if (npids)
+                fprintf(stderr, "Error: cannot read /proc/%s/maps: %s\n", name, strerror(errno));
+            continue;
+        }
+        list.count = 0;
+        int rc = read_regions_fd(fd, &list);
+        close(fd);
+        if (rc < 0)
+            continue;
+
+        SnapshotProcess *sp = &procs[nprocs++];
+        memset(sp, 0, sizeof(*sp));
+        sp->pid = todo[i];
+        sp->uid = st.st_uid;
+        sp->first_region = nregions;
+        sp->nregions = (uint32_t)list.count;
+
+        ssize_t n = read_pid_file(procfd, name, "stat", buf, sizeof(buf));
+        char *open_paren = n > 0 ? memchr(buf, '(', (size_t)n) : NULL;
+        char *close_paren = n > 0 ? strrchr(buf, ')') : NULL;
+        if (open_paren && close_paren > open_paren) {
+            *close_paren = '\0';
+            sp->comm = string_table_add(&strings, open_paren + 1);
+        }
+        if ((n = read_pid_file(procfd, name, "statm", buf, sizeof(buf))) > 0) {
+            const char *p = buf, *end = buf + n;
+            sp->vsz_kb = parse_dec(&p, end) * page_kb;
+            p = skip_spaces(p, end);
+            sp->rss_kb = parse_dec(&p, end) * page_kb;
+        }
+        snprintf(rel, sizeof(rel), "%s/smaps_rollup", name);
+        if ((fd = openat(procfd, rel, O_RDONLY | O_CLOEXEC)) >= 0) {
+            RegionList rollup = {0};
+            if (read_regions_fd(fd, &rollup) == 0 && rollup.count) {
+                sp->pss_kb = rollup.items[0].pss_kb;
+                sp->swap_kb = rollup.items[0].swap_kb;
+            }
+            region_list_free(&rollup);
+            close(fd);
+        }
+
+        if (nregions + list.count > regions_cap) {
+            regions_cap = 2 * (nregions + list.count);
+            regions = xrealloc(regions, regions_cap * sizeof(SnapshotRegion));
+        }
+        for (size_t r = 0; r < list.count; r++) {
+            MemoryRegion *m = &list.items[r];
+            SnapshotRegion *sr = &regions[nregions++];
+            sr->start = m->start;
+            sr->end = m->end;
+            sr->offset = m->offset;
+            sr->inode = m->inode;
+            sr->pathname = string_table_add(&strings, m->pathname);
+            memcpy(sr->permissions, m->permissions, 4);
+        }
+    }
+    close(procfd);
+    region_list_free(&list);
+
+    // Lay the file out in one buffer
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+    h.version = SNAPSHOT_VERSION;
+    h.header_size = sizeof(h);
+    h.created = (int64_t)time(NULL);
+    h.nprocs = (uint32_t)nprocs;
+    h.nregions = nregions;
+    h.procs_offset = sizeof(h);
+    h.regions_offset = h.procs_offset + nprocs * sizeof(SnapshotProcess);
+    h.strings_offset = h.regions_offset + nregions * sizeof(SnapshotRegion);
+    h.strings_size = strings.size;
+    size_t total = h.strings_offset + h.strings_size;
+
+    char *out = xrealloc(NULL, total);
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + h.procs_offset, procs, nprocs * sizeof(SnapshotProcess));
+    if (nregions)
+        memcpy(out + h.regions_offset, regions, nregions * sizeof(SnapshotRegion));
+    memcpy(out + h.strings_offset, strings.data, strings.size);
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot create %s: %s\n", tmp, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (size_t done = 0; done < total;) {
+        ssize_t w = write(fd, out + done, total - done);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0) {
+            fprintf(stderr, "Error: cannot write %s: %s\n", tmp, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        done += (size_t)w;
+    }
+    if (close(fd) < 0 || rename(tmp, path) < 0) {
+        fprintf(stderr, "Error: cannot save %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Wrote %s: %zu processes, %zu regions, %zu strings, %zu bytes\n",
+           path, nprocs, nregions, strings.count, total);
+    if (timing)
+        fprintf(stderr, "Captured snapshot in %.3f ms\n",
+                (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+
+    free(out);
+    free(todo);
+    free(procs);
+    free(regions);
+    free(strings.data);
+    free(strings.slots);
+}
+
+// A snapshot mapped read-only, with pointers into the mapping
+typedef struct {
+    void *map;
+    size_t size;
+    const SnapshotHeader *header;
+    const SnapshotProcess *procs;
+    const SnapshotRegion *regions;
+    const char *strings;
+} Snapshot;
+
+// mmap a snapshot and check that every offset in it stays inside the file
+void open_snapshot(const char *path, Snapshot *snap) {
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Error: cannot read %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    snap->size = (size_t)st.st_size;
+    if (snap->size < sizeof(SnapshotHeader)) {
+        fprintf(stderr, "Error: %s is not a memview snapshot\n", path);
+        exit(EXIT_FAILURE);
+    }
+    snap->map = mmap(NULL, snap->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snap->map == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    const SnapshotHeader *h = snap->header = snap->map;
+    const char *base = snap->map;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, 8) != 0) {
+        fprintf(stderr, "Error: %s is not a memview snapshot\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (h->version != SNAPSHOT_VERSION || h->header_size != sizeof(SnapshotHeader)) {
+        fprintf(stderr, "Error: %s is snapshot version %u; this memview reads version %d\n",
+                path, h->version, SNAPSHOT_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    // Counts are bounded by the file size before anything is multiplied
+    // or added, so a crafted header cannot wrap an offset back into range
+    int ok = h->nregions <= snap->size / sizeof(SnapshotRegion) &&
+             h->procs_offset == sizeof(SnapshotHeader) &&
+             h->regions_offset == h->procs_offset + (uint64_t)h->nprocs * sizeof(SnapshotProcess) &&
+             h->strings_offset == h->regions_offset + h->nregions * sizeof(SnapshotRegion) &&
+             h->strings_offset < snap->size && h->strings_size > 0 &&
+             h->strings_size == snap->size - h->strings_offset &&
+             base[snap->size - 1] == '\0';
+    snap->procs = (const SnapshotProcess *)(base + h->procs_offset);
+    snap->regions = (const SnapshotRegion *)(base + h->regions_offset);
+    snap->strings = base + h->strings_offset;
+    for (uint32_t i = 0; ok && i < h->nprocs; i++) {
+        const SnapshotProcess *p = &snap->procs[i];
+        ok = p->comm < h->strings_size && p->first_region <= h->nregions &&
+             p->nregions <= h->nregions - p->first_region;
+    }
+    for (uint64_t i = 0; ok && i < h->nregions; i++)
+        ok = snap->regions[i].pathname < h->strings_size;
+    if (!ok) {
+        fprintf(stderr, "Error: %s is truncated or corrupt\n", path);
+        exit(EXIT_FAILURE);
+    }
 }
 
-// Function to determine memory region type
-const char* get_region_type(MemoryRegion *region) {
-    if (strstr(region->pathname, "[heap]"))
-        return "heap";
-    else if (strstr(region->pathname, "[stack]"))
-        return "stack";
-    else if (strstr(region->pathname, "[vdso]"))
-        return "vdso";
-    else if (strstr(region->pathname, "[vsyscall]"))
-        return "vsyscall";
-    else if (region->pathname[0] == '\0')
-        return "anonymous";
-    else if (strstr(region->pathname, "SYSV"))
-        return "shared_memory";
-    else if (region->pathname[0] == '/')
-        return "file_mapped";
+void close_snapshot(Snapshot *snap) {
+    munmap(snap->map, snap->size);
+}
+
+void print_snapshot_region(char sign, const Snapshot *snap, const SnapshotRegion *r,
+                           const SnapshotRegion *old) {
+    const char *name = snap->strings + r->pathname;
+    printf("    %c %016llx-%016llx %.4s ", sign, (unsigned long long)r->start,
+           (unsigned long long)r->end, r->permissions);
+    if (old)
+        printf("%llu -> %llu KB", (unsigned long long)(old->end - old->start) / 1024,
+               (unsigned long long)(r->end - r->start) / 1024);
     else
-        return "other";
+        printf("%llu KB", (unsigned long long)(r->end - r->start) / 1024);
+    printf(" %s\n", name[0] ? name : "[anon]");
 }
 
-// Calculate memory usage summary
-void calculate_memory_summary(MemoryRegion *regions, int count, int verbose) {
-    unsigned long total_size = 0;
-    unsigned long heap_size = 0;
-    unsigned long stack_size = 0;
-    unsigned long shared_size = 0;
-    unsigned long lib_size = 0;
-    unsigned long anon_size = 0;
-    
-    for (int i = 0; i < count; i++) {
-        total_size += regions[i].size;
-        
-        const char *type = get_region_type(&regions[i]);
-        if (strcmp(type, "heap") == 0)
-            heap_size += regions[i].size;
-        else if (strcmp(type, "stack") == 0)
-            stack_size += regions[i].size;
-        else if (strcmp(type, "shared_memory") == 0 || (regions[i].permissions[0] == 'r' && regions[i].permissions[3] == 's'))
-            shared_size += regions[i].size;
-        else if (strcmp(type, "file_mapped") == 0 && strstr(regions[i].pathname, ".so"))
-            lib_size += regions[i].size;
-        else if (strcmp(type, "anonymous") == 0)
-            anon_size += regions[i].size;
-    }
-    
-    printf("\nMemory Usage Summary:\n");
+// Print what a snapshot holds; -v adds every region
+void dump_snapshot(const char *path, int verbose) {
+    Snapshot snap;
+    open_snapshot(path, &snap);
+    const SnapshotHeader *h = snap.header;
+    time_t created = (time_t)h->created;
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&created));
+
+    printf("Snapshot %s (version %u, taken %s): %u processes, %llu regions\n", path,
+           h->version, when, h->nprocs, (unsigned long long)h->nregions);
     printf("-----------------------------------------------------\n");
-    printf("Total memory used:       %10lu KB (%lu bytes)\n", total_size / 1024, total_size);
-    printf("Heap memory:             %10lu KB (%lu bytes)\n", heap_size / 1024, heap_size);
-    printf("Stack memory:            %10lu KB (%lu bytes)\n", stack_size / 1024, stack_size);
-    printf("Shared memory:           %10lu KB (%lu bytes)\n", shared_size / 1024, shared_size);
-    printf("Library memory:          %10lu KB (%lu bytes)\n", lib_size / 1024, lib_size);
-    printf("Anonymous memory:        %10lu KB (%lu bytes)\n", anon_size / 1024, anon_size);
+    printf("%-8s %-20s %12s %12s %12s %12s %8s\n",
+           "PID", "Process", "VSZ (KB)", "RSS (KB)", "PSS (KB)", "Swap (KB)", "Regions");
+    for (uint32_t i = 0; i < h->nprocs; i++) {
+        const SnapshotProcess *p = &snap.procs[i];
+        printf("%-8d %-20s %12llu %12llu %12llu %12llu %8u\n", p->pid, snap.strings + p->comm,
+               (unsigned long long)p->vsz_kb, (unsigned long long)p->rss_kb,
+               (unsigned long long)p->pss_kb, (unsigned long long)p->swap_kb, p->nregions);
+        for (uint32_t r = 0; verbose && r < p->nregions; r++)
+            print_snapshot_region(' ', &snap, &snap.regions[p->first_region + r], NULL);
+    }
+    close_snapshot(&snap);
 }
 
-// Show detailed process memory information
-void show_process_memory(pid_t pid, const char *filter, int verbose) {
-    char path[PATH_MAX];
-    char buffer[BUFFER_SIZE];
-    MemoryRegion regions[1000]; // Assuming max 1000 regions, adjust as needed
-    int region_count = 0;
-    
-    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
-    
-    FILE *file = fopen(path, "r");
-    if (!file) {
-        perror("fopen");
-        exit(EXIT_FAILURE);
-    }
-    
-    printf("Memory maps for PID %d:\n", pid);
+// Compare two snapshots. Processes are merged by PID (a different command
+// name means the PID was reused) and each pair's regions by start address
+// and pathname, so the whole diff is linear in the size of both files.
+void diff_snapshots(const char *old_path, const char *new_path, int verbose) {
+    Snapshot a, b;
+    open_snapshot(old_path, &a);
+    open_snapshot(new_path, &b);
+
+    printf("Snapshot diff %s -> %s (%+lld s):\n", old_path, new_path,
+           (long long)(b.header->created - a.header->created));
     printf("-----------------------------------------------------\n");
-    
-    if (verbose) {
-        printf("%-16s %-8s %-16s %-7s %-8s %s\n", 
-               "Address Range", "Perms", "Size", "Offset", "Inode", "Pathname");
-        printf("-----------------------------------------------------\n");
-    }
-    
-    // Read and process each line
-    while (fgets(buffer, sizeof(buffer), file) && region_count < 1000) {
-        buffer[strcspn(buffer, "\n")] = 0; // Remove newline
-        
-        parse_memory_line(buffer, &regions[region_count]);
-        const char *type = get_region_type(&regions[region_count]);
-        
-        // Apply filter if specified
-        if (filter && strcmp(filter, type) != 0) {
+
+    size_t i = 0, j = 0, started = 0, exited = 0, changed = 0;
+    long long rss_delta = 0;
+    while (i < a.header->nprocs || j < b.header->nprocs) {
+        const SnapshotProcess *p = i < a.header->nprocs ? &a.procs[i] : NULL;
+        const SnapshotProcess *q = j < b.header->nprocs ? &b.procs[j] : NULL;
+        int same = p && q && p->pid == q->pid &&
+                   strcmp(a.strings + p->comm, b.strings + q->comm) == 0;
+
+        if (!same && q && (!p || q->pid <= p->pid)) {
+            printf("+ PID %-7d %-20s rss %llu KB, %u regions\n", q->pid, b.strings + q->comm,
+                   (unsigned long long)q->rss_kb, q->nregions);
+            rss_delta += (long long)q->rss_kb;
+            started++;
+            j++;
+            if (p && q->pid == p->pid) {    // PID reused: the old one exited
+                printf("- PID %-7d %-20s rss %llu KB, %u regions\n", p->pid, a.strings + p->comm,
+                       (unsigned long long)p->rss_kb, p->nregions);
+                rss_delta -= (long long)p->rss_kb;
+                exited++;
+                i++;
+            }
             continue;
         }
-        
-        if (verbose) {
-            printf("%016lx-%016lx %s %8lu KB %8lx %8lu %s [%s]\n", 
-                   regions[region_count].start, regions[region_count].end,
-                   regions[region_count].permissions,
-                   regions[region_count].size / 1024,
-                   regions[region_count].offset,
-                   regions[region_count].inode,
-                   regions[region_count].pathname,
-                   type);
-        } else {
-            printf("%016lx-%016lx %s %8lu KB %s\n", 
-                   regions[region_count].start, regions[region_count].end,
-                   regions[region_count].permissions,
-                   regions[region_count].size / 1024,
-                   regions[region_count].pathname);
+        if (!same) {
+            printf("- PID %-7d %-20s rss %llu KB, %u regions\n", p->pid, a.strings + p->comm,
+                   (unsigned long long)p->rss_kb, p->nregions);
+            rss_delta -= (long long)p->rss_kb;
+            exited++;
+            i++;
+            continue;
         }
-        
-        region_count++;
+
+        // Same process in both: merge the region lists
+        const SnapshotRegion *ra = &a.regions[p->first_region], *rb = &b.regions[q->first_region];
+        size_t x = 0, y = 0, added = 0, removed = 0, resized = 0;
+        long long vsz_change = (long long)q->vsz_kb - (long long)p->vsz_kb;
+        long long rss_change = (long long)q->rss_kb - (long long)p->rss_kb;
+        long long pss_change = (long long)q->pss_kb - (long long)p->pss_kb;
+        long long swap_change = (long long)q->swap_kb - (long long)p->swap_kb;
+
+        // First pass only counts, so the process line can be printed first
+        for (int pass = 0; pass < 2; pass++) {
+            x = y = 0;
+            while (x < p->nregions || y < q->nregions) {
+                const SnapshotRegion *ro = x < p->nregions ? &ra[x] : NULL;
+                const SnapshotRegion *rn = y < q->nregions ? &rb[y] : NULL;
+                int match = ro && rn && ro->start == rn->start &&
+                            strcmp(a.strings + ro->pathname, b.strings + rn->pathname) == 0;
+                if (match) {
+                    if (ro->end != rn->end || memcmp(ro->permissions, rn->permissions, 4) != 0) {
+                        if (pass == 0)
+                            resized++;
+                        else if (verbose)
+                            print_snapshot_region('~', &b, rn, ro);
+                    }
+                    x++;
+                    y++;
+                } else if (rn && (!ro || rn->start <= ro->start)) {
+                    if (pass == 0)
+                        added++;
+                    else if (verbose)
+                        print_snapshot_region('+', &b, rn, NULL);
+                    y++;
+                } else {
+                    if (pass == 0)
+                        removed++;
+                    else if (verbose)
+                        print_snapshot_region('-', &a, ro, NULL);
+                    x++;
+                }
+            }
+            if (pass == 0) {
+                if (!added && !removed && !resized && !vsz_change && !rss_change &&
+                    !pss_change && !swap_change)
+                    break;
+                printf("~ PID %-7d %-20s rss %+lld KB  pss %+lld KB  swap %+lld KB  vsz %+lld KB"
+                       "  regions +%zu -%zu ~%zu\n", q->pid, b.strings + q->comm, rss_change,
+                       pss_change, swap_change, vsz_change, added, removed, resized);
+                changed++;
+                rss_delta += rss_change;
+            }
+        }
+        i++;
+        j++;
     }
-    
-    fclose(file);
-    
-    // Print memory usage summary
-    calculate_memory_summary(regions, region_count, verbose);
-    
-    // Additional process info
-    if (verbose) {
-        // Show status information
-        snprintf(path, sizeof(path), "/proc/%d/status", pid);
-        file = fopen(path, "r");
-        if (file) {
-            printf("\nProcess Status Information:\n");
-            printf("-----------------------------------------------------\n");
-            while (fgets(buffer, sizeof(buffer), file)) {
-                if (strncmp(buffer, "Vm", 2) == 0) { // Show only memory-related status
-                    printf("%s", buffer);
+
+    printf("\n%zu processes started, %zu exited, %zu changed; total rss %+lld KB\n",
+           started, exited, changed, rss_delta);
+    close_snapshot(&a);
+    close_snapshot(&b);
+}
+
+// cgroup v2 tree (--cgroups). The hierarchy is walked by a pool of threads
+// sharing a queue of directories: each worker takes a cgroup, reads its
+// memory.current, memory.max, memory.stat and memory.pressure with openat()
+// relative to the cgroup's dirfd, and queues the child cgroups it finds.
+// The result is ranked by usage or by memory stall time (PSI).
+
+#define PSI_WINDOW_MS 2000      // unprivileged triggers need a multiple of 2 s
+
+enum { CG_SORT_USAGE, CG_SORT_STALL, CG_SORT_FULL, CG_SORT_NAME };
+
+static const char *cgroup_sort_names[] = { "usage", "stall", "full", "name" };
+
+typedef struct {
+    char *path;                 // relative to the root, "." for the root itself
+    int has_current;            // the root cgroup has no memory.current
+    unsigned long current;      // bytes, hierarchical
+    unsigned long max;          // bytes, ULONG_MAX for "max"
+    unsigned long anon;         // from memory.stat, bytes
+    unsigned long file;
+    unsigned long kernel;
+    unsigned long shmem;
+    unsigned long sock;
+    double some_avg10;          // % of time some tasks stalled on memory
+    double full_avg10;          // % of time all tasks stalled
+    unsigned long long some_total;  // stall time in microseconds
+    unsigned long long full_total;
+} CgroupInfo;
+
+typedef struct {
+    int rootfd;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char **queue;               // directories waiting to be read
+    size_t queued;
+    size_t queue_cap;
+    size_t pending;             // queued plus being read
+    CgroupInfo *items;
+    size_t count;
+    size_t cap;
+} CgroupWalk;
+
+// memory.stat key-dispatch table, the same idea as smaps_keys
+typedef struct {
+    const char *key;
+    size_t len;
+    size_t field;               // offsetof() an unsigned long in CgroupInfo
+} CgroupStatKey;
+
+#define CGROUP_STAT_KEY(name, member) { name, sizeof(name) - 1, offsetof(CgroupInfo, member) }
+
+static const CgroupStatKey cgroup_stat_keys[] = {
+    CGROUP_STAT_KEY("anon",   anon),
+    CGROUP_STAT_KEY("file",   file),
+    CGROUP_STAT_KEY("kernel", kernel),
+    CGROUP_STAT_KEY("shmem",  shmem),
+    CGROUP_STAT_KEY("sock",   sock),
+};
+
+// Read a small file relative to dirfd; returns its length or -1
+ssize_t read_at(int dirfd, const char *name, char *buf, size_t size) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+// Parse "some avg10=0.12 avg60=... total=N" / "full ..." lines
+void parse_pressure(const char *buf, CgroupInfo *cg) {
+    for (const char *line = buf; line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+        int full = strncmp(line, "full", 4) == 0;
+        if (!full && strncmp(line, "some", 4) != 0)
+            continue;
+        const char *avg = strstr(line, "avg10=");
+        const char *total = strstr(line, "total=");
+        if (avg)
+            *(full ? &cg->full_avg10 : &cg->some_avg10) = strtod(avg + 6, NULL);
+        if (total)
+            *(full ? &cg->full_total : &cg->some_total) = strtoull(total + 6, NULL, 10);
+    }
+}
+
+// Read the memory files of one cgroup directory
+void read_cgroup(int dirfd, CgroupInfo *cg) {
+    char buf[8192];
+    ssize_t n;
+
+    cg->max = ULONG_MAX;
+    if ((n = read_at(dirfd, "memory.current", buf, sizeof(buf))) > 0) {
+        const char *p = buf;
+        cg->current = parse_dec(&p, buf + n);
+        cg->has_current = 1;
+    }
+    if ((n = read_at(dirfd, "memory.max", buf, sizeof(buf))) > 0 && buf[0] != 'm') {
+        const char *p = buf;
+        cg->max = parse_dec(&p, buf + n);
+    }
+    if ((n = read_at(dirfd, "memory.stat", buf, sizeof(buf))) > 0) {
+        // "key value" per line; keys not in the table are skipped by length
+        const char *p = buf, *end = buf + n;
+        while (p < end) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            const char *stop = nl ? nl : end;
+            const char *sp = memchr(p, ' ', (size_t)(stop - p));
+            if (sp) {
+                size_t len = (size_t)(sp - p);
+                for (size_t i = 0; i < sizeof(cgroup_stat_keys) / sizeof(cgroup_stat_keys[0]); i++) {
+                    if (cgroup_stat_keys[i].len == len && memcmp(cgroup_stat_keys[i].key, p, len) == 0) {
+                        const char *v = sp + 1;
+                        *(unsigned long *)((char *)cg + cgroup_stat_keys[i].field) = parse_dec(&v, stop);
+                        break;
+                    }
                 }
             }
-            fclose(file);
+            p = stop + 1;
         }
     }
+    if (read_at(dirfd, "memory.pressure", buf, sizeof(buf)) > 0)
+        parse_pressure(buf, cg);
 }
 
-// Show system-wide shared memory segments
-void show_shared_memory() {
-    struct shmid_ds shm_info;
-    int id;
-    
-    printf("System Shared Memory Segments:\n");
+void *cgroup_worker(void *arg) {
+    CgroupWalk *walk = arg;
+
+    pthread_mutex_lock(&walk->lock);
+    for (;;) {
+        while (!walk->queued && walk->pending)
+            pthread_cond_wait(&walk->cond, &walk->lock);
+        if (!walk->queued)
+            break;
+        char *path = walk->queue[--walk->queued];
+        pthread_mutex_unlock(&walk->lock);
+
+        CgroupInfo cg;
+        memset(&cg, 0, sizeof(cg));
+        cg.path = path;
+        char **children = NULL;
+        size_t nchildren = 0;
+        int dirfd = openat(walk->rootfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd >= 0) {
+            read_cgroup(dirfd, &cg);
+            DIR *dir = fdopendir(dirfd);
+            struct dirent *entry;
+            while (dir && (entry = readdir(dir))) {
+                if (entry->d_type != DT_DIR || entry->d_name[0] == '.')
+                    continue;
+                size_t len = strlen(path) + strlen(entry->d_name) + 2;
+                char *child = xrealloc(NULL, len);
+                if (strcmp(path, ".") == 0)
+                    snprintf(child, len, "%s", entry->d_name);
+                else
+                    snprintf(child, len, "%s/%s", path, entry->d_name);
+                children = xrealloc(children, (nchildren + 1) * sizeof(*children));
+                children[nchildren++] = child;
+            }
+            if (dir)
+                closedir(dir);
+            else
+                close(dirfd);
+        }
+
+        pthread_mutex_lock(&walk->lock);
+        if (walk->queued + nchildren > walk->queue_cap) {
+            walk->queue_cap = 2 * (walk->queued + nchildren);
+            walk->queue = xrealloc(walk->queue, walk->queue_cap * sizeof(char *));
+        }
+        for (size_t i = 0; i < nchildren; i++)
+            walk->queue[walk->queued++] = children[i];
+        walk->pending += nchildren;
+        free(children);
+        if (walk->count == walk->cap) {
+            walk->cap = walk->cap ? 2 * walk->cap : 256;
+            walk->items = xrealloc(walk->items, walk->cap * sizeof(CgroupInfo));
+        }
+        walk->items[walk->count++] = cg;
+        walk->pending--;
+        pthread_cond_broadcast(&walk->cond);
+    }
+    pthread_mutex_unlock(&walk->lock);
+    return NULL;
+}
+
+// Walk the cgroup tree under root with the given number of threads
+CgroupWalk *walk_cgroups(const char *root, int threads) {
+    CgroupWalk *walk = calloc(1, sizeof(*walk));
+    if (!walk) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    walk->rootfd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walk->rootfd < 0) {
+        fprintf(stderr, "Error: cannot open %s: %s\n", root, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_cond_init(&walk->cond, NULL);
+    walk->queue_cap = 64;
+    walk->queue = xrealloc(NULL, walk->queue_cap * sizeof(char *));
+    walk->queue[walk->queued++] = strdup(".");
+    walk->pending = 1;
+
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > 64)
+        threads = 64;
+    if (threads < 1)
+        threads = 1;
+    pthread_t tids[64];
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, cgroup_worker, walk) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    cgroup_worker(walk);
+    for (int t = 1; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    return walk;
+}
+
+void free_cgroup_walk(CgroupWalk *walk) {
+    for (size_t i = 0; i < walk->count; i++)
+        free(walk->items[i].path);
+    free(walk->items);
+    free(walk->queue);
+    close(walk->rootfd);
+    pthread_mutex_destroy(&walk->lock);
+    pthread_cond_destroy(&walk->cond);
+    free(walk);
+}
+
+// Default to the unified hierarchy, wherever this host mounts it
+const char *default_cgroup_root(void) {
+    if (access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0)
+        return "/sys/fs/cgroup";
+    if (access("/sys/fs/cgroup/unified/cgroup.controllers", F_OK) == 0)
+        return "/sys/fs/cgroup/unified";
+    return "/sys/fs/cgroup";
+}
+
+static int cgroup_qsort_key;
+
+int compare_cgroups(const void *pa, const void *pb) {
+    const CgroupInfo *a = pa, *b = pb;
+    unsigned long long x = 0, y = 0;
+    switch (cgroup_qsort_key) {
+        case CG_SORT_USAGE: x = a->current;    y = b->current;    break;
+        case CG_SORT_STALL: x = a->some_total; y = b->some_total; break;
+        case CG_SORT_FULL:  x = a->full_total; y = b->full_total; break;
+    }
+    if (x != y)
+        return x > y ? -1 : 1;
+    return strcmp(a->path, b->path);
+}
+
+// Show the cgroup tree ranked by memory usage or stall time
+void show_cgroups(const char *root, int sort_key, size_t top, int threads, int timing) {
+    struct timespec t0, t1;
+    char buf[1024];
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    CgroupWalk *walk = walk_cgroups(root, threads);
+    cgroup_qsort_key = sort_key;
+    qsort(walk->items, walk->count, sizeof(CgroupInfo), compare_cgroups);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    CgroupInfo system = {0};
+    if (read_at(AT_FDCWD, "/proc/pressure/memory", buf, sizeof(buf)) > 0) {
+        parse_pressure(buf, &system);
+        printf("System memory pressure: some avg10 %.2f%% (total %llu ms), full avg10 %.2f%% (total %llu ms)\n\n",
+               system.some_avg10, system.some_total / 1000, system.full_avg10, system.full_total / 1000);
+    }
+
+    size_t shown = top && top < walk->count ? top : walk->count;
+    printf("cgroups under %s by %s (%zu of %zu):\n", root, cgroup_sort_names[sort_key], shown, walk->count);
     printf("-----------------------------------------------------\n");
-    printf("%-10s %-10s %-10s %-10s %-10s %s\n",
-           "ID", "Key", "Size (KB)", "Owner", "Perms", "Attached");
-    
-    // Loop through possible shared memory IDs
-    for (id = 0; id < 100; id++) {
-        if (shmctl(id, IPC_STAT, &shm_info) != -1) {
-            printf("%-10d %-10d %-10lu %-10d %-10o %lu\n",
-                   id,
-                   SHM_KEY(shm_info.shm_perm),
-                   (unsigned long)(shm_info.shm_segsz / 1024),
-                   shm_info.shm_perm.uid,
-                   shm_info.shm_perm.mode & 0777,
-                   SHM_NATTCH(shm_info.shm_nattch));
+    printf("%12s %12s %6s %12s %12s %12s %7s %7s %12s  %s\n",
+           "Current (KB)", "Max (KB)", "%Max", "Anon (KB)", "File (KB)", "Kernel (KB)",
+           "Some10", "Full10", "Stall (ms)", "Cgroup");
+    for (size_t i = 0; i < shown; i++) {
+        CgroupInfo *cg = &walk->items[i];
+        char max[24] = "max", pct[8] = "-", current[24] = "-";
+        if (cg->max != ULONG_MAX) {
+            snprintf(max, sizeof(max), "%lu", cg->max / 1024);
+            if (cg->max)
+                snprintf(pct, sizeof(pct), "%.1f", 100.0 * (double)cg->current / (double)cg->max);
+        }
+        if (cg->has_current)
+            snprintf(current, sizeof(current), "%lu", cg->current / 1024);
+        printf("%12s %12s %6s %12lu %12lu %12lu %6.2f%% %6.2f%% %12llu  /%s\n",
+               current, max, pct, cg->anon / 1024, cg->file / 1024, cg->kernel / 1024,
+               cg->some_avg10, cg->full_avg10, cg->some_total / 1000,
+               strcmp(cg->path, ".") == 0 ? "" : cg->path);
+    }
+    size_t with_memory = 0;
+    for (size_t i = 0; i < walk->count; i++)
+        with_memory += walk->items[i].has_current;
+    if (!with_memory)
+        printf("(no memory controller enabled under %s)\n", root);
+    if (timing)
+        fprintf(stderr, "Walked %zu cgroups in %.3f ms\n", walk->count,
+                (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+    free_cgroup_walk(walk);
+}
+
+// Block on PSI triggers for the system and the top cgroups, and report
+// each pressure event as it happens. A trigger fires when tasks stalled on
+// memory for at least stall_ms within a PSI_WINDOW_MS window, so nothing
+// runs between events.
+void watch_pressure(const char *root, int sort_key, size_t top, int threads, unsigned stall_ms,
+                    long count) {
+    CgroupWalk *walk = walk_cgroups(root, threads);
+    cgroup_qsort_key = sort_key;
+    qsort(walk->items, walk->count, sizeof(CgroupInfo), compare_cgroups);
+    size_t ncg = top && top < walk->count ? top : walk->count;
+
+    char trigger[64], path[PATH_MAX];
+    snprintf(trigger, sizeof(trigger), "some %u %u", stall_ms * 1000, PSI_WINDOW_MS * 1000);
+
+    // Slot 0 is the whole system; the rest follow the ranked cgroups
+    struct pollfd *fds = calloc(ncg + 1, sizeof(*fds));
+    const char **names = calloc(ncg + 1, sizeof(*names));
+    if (!fds || !names) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t nfds = 0;
+    for (size_t i = 0; i <= ncg; i++) {
+        int fd;
+        if (i == 0) {
+            fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            names[nfds] = "(system)";
+        } else {
+            snprintf(path, sizeof(path), "%s/memory.pressure", walk->items[i - 1].path);
+            fd = openat(walk->rootfd, path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            names[nfds] = walk->items[i - 1].path;
+        }
+        if (fd < 0)
+            continue;
+        if (write(fd, trigger, strlen(trigger) + 1) < 0) {
+            fprintf(stderr, "Error: cannot set PSI trigger \"%s\" on %s: %s%s\n", trigger,
+                    names[nfds], strerror(errno),
+                    errno == EINVAL ? " (stall must be below the window)" : "");
+            close(fd);
+            continue;
+        }
+        fds[nfds].fd = fd;
+        fds[nfds].events = POLLPRI;
+        nfds++;
+    }
+    if (!nfds) {
+        fprintf(stderr, "Error: no memory.pressure files could be watched\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Watching memory pressure on %zu targets (trigger: %u ms stalled per %u ms)\n",
+           nfds, stall_ms, PSI_WINDOW_MS);
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long events = 0; count == 0 || events < count;) {
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+        for (size_t i = 0; i < nfds; i++) {
+            if (!fds[i].revents)
+                continue;
+            if (fds[i].revents & POLLERR) {
+                printf("[%9.3fs] %s went away\n", elapsed, names[i]);
+                close(fds[i].fd);
+                fds[i].fd = -1;     // poll() ignores negative fds
+                continue;
+            }
+            CgroupInfo cg;
+            memset(&cg, 0, sizeof(cg));
+            ssize_t n = pread(fds[i].fd, path, sizeof(path) - 1, 0);
+            if (n > 0) {
+                path[n] = '\0';
+                parse_pressure(path, &cg);
+            }
+            printf("[%9.3fs] pressure on %s%s: some avg10 %.2f%% full avg10 %.2f%% (stall total %llu ms)\n",
+                   elapsed, names[i][0] == '(' ? "" : "/", strcmp(names[i], ".") == 0 ? "" : names[i],
+                   cg.some_avg10, cg.full_avg10, cg.some_total / 1000);
+            events++;
         }
     }
+
+    for (size_t i = 0; i < nfds; i++)
+        if (fds[i].fd >= 0)
+            close(fds[i].fd);
+    free(fds);
+    free(names);
+    free_cgroup_walk(walk);
 }
 
 // Show system memory information
-void show_system_memory(int verbose) {
+void show_system_memory(int verbose, const ProcessQuery *query) {
     FILE *file = fopen("/proc/meminfo", "r");
     if (!file) {
         perror("fopen /proc/meminfo");
@@ -283,69 +3091,70 @@ void show_system_memory(int verbose) {
     }
     
     if (verbose) {
-        // Show additional memory-related info from /proc
+        // Show the processes using the most memory
         printf("\nMemory Distribution by Process:\n");
         printf("-----------------------------------------------------\n");
-        printf("%-8s %-20s %-12s\n", "PID", "Process", "Memory (KB)");
-        
-        DIR *proc_dir = opendir("/proc");
-        if (proc_dir) {
-            struct dirent *entry;
-            
-            while ((entry = readdir(proc_dir))) {
-                // Check if the entry is a process directory (all digits)
-                int is_pid = 1;
-                for (int i = 0; entry->d_name[i]; i++) {
-                    if (!isdigit(entry->d_name[i])) {
-                        is_pid = 0;
-                        break;
-                    }
-                }
-                
-                if (is_pid) {
-                    char stat_path[PATH_MAX];
-                    char cmd_path[PATH_MAX];
-                    char cmd[256] = "<unknown>";
-                    int proc_pid = atoi(entry->d_name);
-                    unsigned long vm_size = 0;
-                    
-                    // Get process name
-                    snprintf(cmd_path, sizeof(cmd_path), "/proc/%s/comm", entry->d_name);
-                    FILE *cmd_file = fopen(cmd_path, "r");
-                    if (cmd_file) {
-                        if (fgets(cmd, sizeof(cmd), cmd_file)) {
-                            cmd[strcspn(cmd, "\n")] = 0; // Remove newline
-                        }
-                        fclose(cmd_file);
-                    }
-                    
-                    // Get memory usage
-                    snprintf(stat_path, sizeof(stat_path), "/proc/%s/status", entry->d_name);
-                    FILE *stat_file = fopen(stat_path, "r");
-                    if (stat_file) {
-                        char line[256];
-                        while (fgets(line, sizeof(line), stat_file)) {
-                            if (strncmp(line, "VmRSS:", 6) == 0) {
-                                sscanf(line, "VmRSS: %lu", &vm_size);
-                                break;
-                            }
-                        }
-                        fclose(stat_file);
-                        
-                        printf("%-8d %-20s %-12lu\n", proc_pid, cmd, vm_size);
-                    }
-                }
-            }
-            closedir(proc_dir);
-        }
+        show_process_table(query);
+    }
+}
+
+// Parse an interval such as "100ms", "2s" or "0.5" (seconds)
+double parse_interval(const char *arg) {
+    char *end;
+    double v = strtod(arg, &end);
+    if (strcmp(end, "ms") == 0)
+        v /= 1000;
+    else if (*end && strcmp(end, "s") != 0)
+        v = -1;
+    if (end == arg || v <= 0) {
+        fprintf(stderr, "Error: invalid interval '%s'\n", arg);
+        exit(EXIT_FAILURE);
     }
+    return v;
 }
 
+enum { OPT_WATCH = 256, OPT_SAMPLES, OPT_GROW, OPT_PAGES, OPT_NUMA, OPT_CGROUPS, OPT_CGROUP_ROOT, OPT_PSI_WATCH,
+       OPT_SNAPSHOT, OPT_DUMP, OPT_DIFF };
+
+static const struct option long_options[] = {
+    { "watch",   required_argument, NULL, OPT_WATCH },
+    { "samples", required_argument, NULL, OPT_SAMPLES },
+    { "grow",    required_argument, NULL, OPT_GROW },
+    { "pages",   no_argument,       NULL, OPT_PAGES },
+    { "numa",    no_argument,       NULL, OPT_NUMA },
+    { "cgroups", no_argument,       NULL, OPT_CGROUPS },
+    { "cgroup-root", required_argument, NULL, OPT_CGROUP_ROOT },
+    { "psi-watch",   required_argument, NULL, OPT_PSI_WATCH },
+    { "snapshot", required_argument, NULL, OPT_SNAPSHOT },
+    { "dump",     required_argument, NULL, OPT_DUMP },
+    { "diff",     required_argument, NULL, OPT_DIFF },
+    { "help",    no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
 int main(int argc, char *argv[]) {
-    pid_t pid = -1;
+    pid_t *pids = NULL;
+    int npids = 0;
+    double watch_interval = 0;
+    long watch_samples = 0;
+    unsigned grow_threshold = 3;
+    int pages_flag = 0;
+    int numa_flag = 0;
+    int cgroups_flag = 0;
+    const char *cgroup_root = NULL;
+    unsigned psi_stall_ms = 0;
+    const char *sort_arg = NULL;
+    const char *snapshot_path = NULL;
+    const char *dump_path = NULL;
+    const char *diff_old = NULL;
     int system_flag = 0;
     int shared_flag = 0;
     int verbose_flag = 0;
+    int timing_flag = 0;
+    int resident_flag = 0;
+    int totals_flag = 0;
+    int process_flag = 0;
+    ProcessQuery query = { .sort_key = SORT_RSS };
     char *filter = NULL;
     int opt;
     
@@ -354,10 +3163,50 @@ int main(int argc, char *argv[]) {
         exit(EXIT_SUCCESS);
     }
     
-    while ((opt = getopt(argc, argv, "p:smf:vh")) != -1) {
+    while ((opt = getopt_long(argc, argv, "p:smf:vrRPn:o:c:u:j:Th", long_options, NULL)) != -1) {
         switch (opt) {
             case 'p':
-                pid = atoi(optarg);
+                for (char *tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                    pids = xrealloc(pids, (size_t)(npids + 1) * sizeof(*pids));
+                    pids[npids++] = atoi(tok);
+                }
+                break;
+            case OPT_WATCH:
+                watch_interval = parse_interval(optarg);
+                break;
+            case OPT_SAMPLES:
+                watch_samples = atol(optarg);
+                break;
+            case OPT_CGROUPS:
+                cgroups_flag = 1;
+                break;
+            case OPT_CGROUP_ROOT:
+                cgroup_root = optarg;
+                break;
+            case OPT_PSI_WATCH:
+                psi_stall_ms = (unsigned)strtoul(optarg, NULL, 10);
+                if (psi_stall_ms == 0 || psi_stall_ms >= PSI_WINDOW_MS) {
+                    fprintf(stderr, "Error: --psi-watch needs 1-%d ms\n", PSI_WINDOW_MS - 1);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPT_SNAPSHOT:
+                snapshot_path = optarg;
+                break;
+            case OPT_DUMP:
+                dump_path = optarg;
+                break;
+            case OPT_DIFF:
+                diff_old = optarg;
+                break;
+            case OPT_NUMA:
+                numa_flag = 1;
+                break;
+            case OPT_PAGES:
+                pages_flag = 1;
+                break;
+            case OPT_GROW:
+                grow_threshold = (unsigned)strtoul(optarg, NULL, 10);
                 break;
             case 's':
                 system_flag = 1;
@@ -371,6 +3220,45 @@ int main(int argc, char *argv[]) {
             case 'v':
                 verbose_flag = 1;
                 break;
+            case 'r':
+                resident_flag = 1;
+                break;
+            case 'R':
+                totals_flag = 1;
+                break;
+            case 'P':
+                process_flag = 1;
+                break;
+            case 'n':
+                query.top = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                sort_arg = optarg;      // resolved once the mode is known
+                break;
+            case 'c':
+                query.name = optarg;
+                break;
+            case 'u': {
+                struct passwd *pw = getpwnam(optarg);
+                char *end;
+                query.by_user = 1;
+                if (pw) {
+                    query.uid = pw->pw_uid;
+                } else {
+                    query.uid = (uid_t)strtoul(optarg, &end, 10);
+                    if (*end || end == optarg) {
+                        fprintf(stderr, "Error: unknown user '%s'\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+            }
+            case 'j':
+                query.threads = atoi(optarg);
+                break;
+            case 'T':
+                timing_flag = 1;
+                break;
             case 'h':
                 display_help(argv[0]);
                 exit(EXIT_SUCCESS);
@@ -381,17 +3269,73 @@ int main(int argc, char *argv[]) {
         }
     }
     
-    if (pid != -1) {
-        show_process_memory(pid, filter, verbose_flag);
+    query.timing = timing_flag;
+    
+    // Processes and cgroups have different sort keys
+    int cgroup_sort = CG_SORT_USAGE;
+    if (sort_arg) {
+        const char **keys = cgroups_flag ? cgroup_sort_names : sort_names;
+        size_t k, nkeys = cgroups_flag ? sizeof(cgroup_sort_names) / sizeof(cgroup_sort_names[0])
+                                       : sizeof(sort_names) / sizeof(sort_names[0]);
+        for (k = 0; k < nkeys && strcmp(sort_arg, keys[k]) != 0; k++)
+            ;
+        if (k == nkeys) {
+            fprintf(stderr, "Error: unknown sort key '%s'\n", sort_arg);
+            exit(EXIT_FAILURE);
+        }
+        if (cgroups_flag)
+            cgroup_sort = (int)k;
+        else
+            query.sort_key = (int)k;
+    }
+    if (!cgroup_root)
+        cgroup_root = default_cgroup_root();
+    
+    if (diff_old) {
+        if (optind >= argc) {
+            fprintf(stderr, "Error: --diff needs two snapshot files\n");
+            exit(EXIT_FAILURE);
+        }
+        diff_snapshots(diff_old, argv[optind], verbose_flag);
+    } else if (dump_path) {
+        dump_snapshot(dump_path, verbose_flag);
+    } else if (snapshot_path) {
+        write_snapshot(snapshot_path, pids, npids, timing_flag);
+    } else if (cgroups_flag && psi_stall_ms) {
+        watch_pressure(cgroup_root, cgroup_sort, query.top, query.threads, psi_stall_ms, watch_samples);
+    } else if (cgroups_flag) {
+        show_cgroups(cgroup_root, cgroup_sort, query.top, query.threads, timing_flag);
+    } else if (npids && watch_interval > 0) {
+        watch_processes(pids, npids, watch_interval, watch_samples, grow_threshold,
+                        verbose_flag, timing_flag);
+    } else if (npids) {
+        for (int i = 0; i < npids; i++) {
+            if (i)
+                printf("\n");
+            if (numa_flag)
+                show_numa_placement(pids[i], filter, timing_flag);
+            else if (pages_flag)
+                show_page_residency(pids[i], filter, timing_flag);
+            else if (totals_flag && !resident_flag)
+                show_process_totals(pids[i], filter, timing_flag);
+            else
+                show_process_memory(pids[i], filter, verbose_flag, resident_flag, timing_flag);
+        }
     } else if (system_flag) {
-        show_system_memory(verbose_flag);
+        show_system_memory(verbose_flag, &query);
+    } else if (process_flag) {
+        show_process_table(&query);
     } else if (shared_flag) {
-        show_shared_memory();
+        show_shared_memory(timing_flag);
+    } else if (watch_interval > 0) {
+        fprintf(stderr, "Error: --watch needs at least one -p PID\n");
+        exit(EXIT_FAILURE);
     } else {
-        fprintf(stderr, "Please specify -p <pid>, -s for system memory, or -m for shared memory.\n");
+        fprintf(stderr, "Please specify -p <pid>, -s for system memory, -P for processes, or -m for shared memory.\n");
         exit(EXIT_FAILURE);
     }
     
+    free(pids);
     return 0;
 }
 
@@ -399,7 +3343,7 @@ int main(int argc, char *argv[]) {
 /*
 docker run --rm -it -v "$PWD":/src -w /src gcc:13 bash
  apt-get update && apt-get install -y procps 
- gcc -std=c11 -Wall -Wextra -pedantic -D_GNU_SOURCE -o memview memview.c
+ gcc -std=c11 -Wall -Wextra -pedantic -D_GNU_SOURCE -pthread -o memview memview.c
 
 */  
 
@@ -430,7 +3374,7 @@ docker run --rm -it \
   -v "$PWD":/src -w /src \
   gcc:13 bash -c '\
     apt-get update -qq && apt-get install -y procps sudo > /dev/null ;\
-    gcc -O2 -D_GNU_SOURCE -o memview memview.c ;\
+    gcc -O2 -D_GNU_SOURCE -pthread -o memview memview.c ;\
     chmod +x test_memview.sh ;\
     echo "Running tests inside Linux container..." ;\
 
@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+# Maps-parsing benchmark for memview
+#
+# Starts mapstress with an increasing number of mappings, then runs
+# memview -p PID -T against it and prints one CSV row per combination:
+#
+#   mode,regions,distinct_paths,runs,parse_ms,regions_per_s
+#
+# parse_ms is the median of the runs, as reported by memview -T (open, read
+# and parse of /proc/PID/maps only, no printing). mode is "anon" (every
+# region anonymous) or "file" (every region maps the same file, which
+# exercises pathname interning). Counts above vm.max_map_count are clamped.
+#
+# Usage: ./memview_bench.sh [-n "1000 10000 60000"] [-m "anon file"] [-r RUNS]
+
+set -e
+
+COUNTS="1000 10000 60000"
+MODES="anon file"
+RUNS=5
+
+while getopts "n:m:r:h" opt; do
+  case $opt in
+    n) COUNTS=$OPTARG ;;
+    m) MODES=$OPTARG ;;
+    r) RUNS=$OPTARG ;;
+    *) sed -n '2,14s/^# \{0,1\}//p' "$0" >&2; exit 1 ;;
+  esac
+done
+
+for bin in ./memview ./mapstress; do
+  [[ -x $bin ]] || { echo "missing $bin (build it first)" >&2; exit 1; }
+done
+
+# leave room for the libraries and stack mapstress itself needs
+max=$(( $(cat /proc/sys/vm/max_map_count 2>/dev/null || echo 65530) - 100 ))
+
+median() { sort -g | awk '{v[NR]=$1} END {print v[int((NR + 1) / 2)]}'; }
+
+ready=$(mktemp)
+trap 'rm -f "$ready"; if [[ -n $pid ]]; then kill "$pid" 2>/dev/null; fi' EXIT
+
+echo "mode,regions,distinct_paths,runs,parse_ms,regions_per_s"
+
+for mode in $MODES; do
+  for n in $COUNTS; do
+    (( n > max )) && n=$max
+    args=(-n "$n")
+    [[ $mode == file ]] && args+=(-f ./mapstress)
+
+    : > "$ready"
+    ./mapstress "${args[@]}" > "$ready" &
+    pid=$!
+    until [[ -s $ready ]]; do
+      kill -0 "$pid" 2>/dev/null || { echo "mapstress $mode -n $n failed" >&2; exit 1; }
+      sleep 0.05
+    done
+
+    times=()
+    for ((r = 0; r < RUNS; ++r)); do
+      # Parsed N regions (D distinct pathnames) from /proc/PID/maps in X ms
+      read -r regions paths ms < <(./memview -p "$pid" -T 2>&1 > /dev/null |
+                                   awk '/^Parsed/ {gsub(/\(/, ""); print $2, $4, $(NF-1)}')
+      times+=("$ms")
+    done
+    kill "$pid"
+    wait "$pid" 2>/dev/null || true
+    pid=
+
+    ms=$(printf '%s\n' "${times[@]}" | median)
+    awk -v m="$mode" -v n="$regions" -v d="$paths" -v r="$RUNS" -v t="$ms" 'BEGIN {
+      printf "%s,%d,%d,%d,%.3f,%.0f\n", m, n, d, r, t, (t > 0 ? n / (t / 1e3) : 0) }'
+  done
+done
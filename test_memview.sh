@@ -8,6 +8,11 @@ echo "============================================"
 echo "TESTING MEMVIEW COMMAND"
 echo "============================================"
 
+# Tests 8 and up need mapstress for processes with many mappings
+if [ ! -x ./mapstress ] && [ -f mapstress.c ]; then
+    gcc -O2 -D_GNU_SOURCE -o mapstress mapstress.c
+fi
+
 # Test 1: Basic functionality - Process memory information
 echo "Test 1: Process memory info for PID 1"
 sudo ./memview -p 1 | grep -q "\[heap\]"
@@ -71,6 +76,180 @@ else
     echo "✗ FAIL: Did not display usage information"
 fi
 
+# Test 8: Processes with more than 1000 mappings
+echo "Test 8: Process with 5000+ memory regions"
+ready=$(mktemp)
+./mapstress -n 5000 > "$ready" &
+stress_pid=$!
+until [ -s "$ready" ] || ! kill -0 $stress_pid 2>/dev/null; do sleep 0.05; done
+regions=$(./memview -p $stress_pid | grep -c '^[0-9a-f]\{16\}-')
+kill $stress_pid 2>/dev/null
+rm -f "$ready"
+if [ "$regions" -gt 5000 ]; then
+    echo "✓ PASS: Listed all $regions memory regions"
+else
+    echo "✗ FAIL: Listed only $regions memory regions"
+fi
+
+# Test 9: Resident memory from smaps / smaps_rollup
+echo "Test 9: Resident memory accounting"
+rss_rollup=$(./memview -p $$ -R | awk '/^Rss:/ {print $2}')
+rss_smaps=$(./memview -p $$ -r | awk '/^Total/ {print $3}')
+if [ -n "$rss_rollup" ] && [ -n "$rss_smaps" ] && [ "$rss_rollup" -gt 0 ] && [ "$rss_smaps" -gt 0 ]; then
+    echo "✓ PASS: Rss from smaps_rollup ($rss_rollup KB) and smaps ($rss_smaps KB)"
+else
+    echo "✗ FAIL: Could not read resident memory (rollup '$rss_rollup', smaps '$rss_smaps')"
+fi
+
+# Test 10: Parallel process scan, top-N and filters
+echo "Test 10: Process ranking"
+one=$(./memview -P -j 1 -c memview -u "$(id -un)" | grep -c " memview ")
+many=$(./memview -P -j 4 -n 3 -o vsz | tail -n +4 | wc -l)
+if [ "$one" -eq 1 ] && [ "$many" -eq 3 ]; then
+    echo "✓ PASS: Ranked and filtered processes"
+else
+    echo "✗ FAIL: Process ranking (name/user filter: $one, top 3: $many)"
+fi
+
+# Test 11: Continuous sampling
+echo "Test 11: Watch mode"
+sleep 5 &
+watched=$!
+samples=$(./memview -p $$,$watched --watch 50ms --samples 3 | grep -c "^\[.*PID")
+kill $watched 2>/dev/null
+if [ "$samples" -eq 6 ]; then
+    echo "✓ PASS: Took 3 samples of 2 processes"
+else
+    echo "✗ FAIL: Expected 6 sample lines, got $samples"
+fi
+
+# Test 12: Page residency from pagemap
+echo "Test 12: Page residency"
+# An idle mapstress rather than this shell, whose memory moves between reads
+ready=$(mktemp)
+./mapstress -n 100 > "$ready" &
+stress_pid=$!
+until [ -s "$ready" ] || ! kill -0 $stress_pid 2>/dev/null; do sleep 0.05; done
+resident=$(./memview -p $stress_pid --pages | awk '/^total / {print $3}')
+rss=$(./memview -p $stress_pid -R | awk '/^Rss:/ {print $2}')
+kill $stress_pid 2>/dev/null
+rm -f "$ready"
+# pagemap and Rss can differ by the odd special mapping: allow a few pages
+diff=$(( ${resident:-0} - ${rss:-0} ))
+if [ "${resident:-0}" -gt 0 ] && [ "${diff#-}" -le 64 ]; then
+    echo "✓ PASS: $resident KB resident per pagemap (Rss $rss KB)"
+else
+    echo "✗ FAIL: Page residency ($resident KB resident per pagemap, Rss $rss KB)"
+fi
+
+# Test 13: Shared memory objects and the PIDs attaching them
+echo "Test 13: SysV, POSIX and memfd shared memory"
+ready=$(mktemp)
+sysv_ready=$(mktemp)
+./mapstress -n 2 -t posix > "$ready" &
+posix_pid=$!
+./mapstress -n 2 -t memfd > /dev/null &
+memfd_pid=$!
+./mapstress -n 2 -t sysv > "$sysv_ready" &
+sysv_pid=$!
+until [ -s "$ready" ] || ! kill -0 $posix_pid 2>/dev/null; do sleep 0.05; done
+until [ -s "$sysv_ready" ] || ! kill -0 $sysv_pid 2>/dev/null; do sleep 0.05; done
+sleep 0.2
+shm_out=$(./memview -m)
+kill $posix_pid $memfd_pid $sysv_pid 2>/dev/null
+rm -f "$ready" "$sysv_ready"
+posix=$(echo "$shm_out" | grep -c "^mapstress-$posix_pid-.* $posix_pid\$")
+memfd=$(echo "$shm_out" | grep -c "^mapstress-[01] .* $memfd_pid\$")
+# mapstress writes one page of each segment: RSS (KB) is column 7
+page_kb=$(( $(getconf PAGESIZE) / 1024 ))
+sysv=$(echo "$shm_out" | awk -v p=$sysv_pid -v kb=$page_kb '$NF == p && $7 == kb' | wc -l)
+if [ "$posix" -eq 2 ] && [ "$memfd" -eq 2 ] && [ "$sysv" -eq 2 ]; then
+    echo "✓ PASS: Found SysV, /dev/shm and memfd objects with their PIDs"
+else
+    echo "✗ FAIL: Shared memory objects (sysv: $sysv, posix: $posix, memfd: $memfd)"
+fi
+
+# Test 14: cgroup tree ranking (on a fake cgroup v2 tree)
+echo "Test 14: cgroup ranking"
+cg_root=$(mktemp -d)
+make_cgroup() {
+    mkdir -p "$cg_root/$1"
+    echo "$2" > "$cg_root/$1/memory.current"
+    echo max > "$cg_root/$1/memory.max"
+    printf "anon %s\nfile 0\n" "$2" > "$cg_root/$1/memory.stat"
+    printf "some avg10=0.00 avg60=0.00 avg300=0.00 total=%s\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n" "$3" > "$cg_root/$1/memory.pressure"
+}
+make_cgroup pods 3000000 100
+make_cgroup pods/big 2000000 100
+make_cgroup pods/stalled 1000000 90000000
+by_usage=$(./memview --cgroups --cgroup-root "$cg_root" -j 2 -n 1 | tail -1 | awk '{print $NF}')
+by_stall=$(./memview --cgroups --cgroup-root "$cg_root" -o stall -n 1 | tail -1 | awk '{print $NF}')
+rm -rf "$cg_root"
+if [ "$by_usage" = "/pods" ] && [ "$by_stall" = "/pods/stalled" ]; then
+    echo "✓ PASS: Ranked cgroups by usage and stall time"
+else
+    echo "✗ FAIL: cgroup ranking (usage: $by_usage, stall: $by_stall)"
+fi
+
+# Test 15: binary snapshots round-trip and diff
+echo "Test 15: snapshots"
+snap_dir=$(mktemp -d)
+./mapstress -n 200 > "$snap_dir/ready" &
+stress_pid=$!
+until [ -s "$snap_dir/ready" ] || ! kill -0 $stress_pid 2>/dev/null; do sleep 0.05; done
+if [ ! -s "$snap_dir/ready" ]; then
+    echo "✗ FAIL: snapshots (mapstress did not start)"
+else
+    ./memview -p $stress_pid --snapshot "$snap_dir/a" > /dev/null
+    kill $stress_pid; wait $stress_pid 2>/dev/null
+    ./memview --snapshot "$snap_dir/b" > /dev/null
+    dumped=$(./memview --dump "$snap_dir/a" | awk -v p=$stress_pid '$1 == p {print $NF}')
+    exited=$(./memview --diff "$snap_dir/a" "$snap_dir/b" | grep -c "^- PID $stress_pid ")
+    head -c 100 "$snap_dir/a" > "$snap_dir/short"
+    ./memview --dump "$snap_dir/short" > /dev/null 2>&1
+    truncated=$?
+    # Point the first process at 2^30 regions starting at 2^64-2^30, which
+    # wraps back into range if the bounds check adds before comparing
+    cp "$snap_dir/a" "$snap_dir/bad"
+    printf '\000\000\000\100\000\000\000\300\377\377\377\377' |
+        dd of="$snap_dir/bad" bs=1 seek=84 conv=notrunc 2> /dev/null
+    ./memview --dump "$snap_dir/bad" -v > /dev/null 2>&1
+    corrupt=$?
+    if [ "${dumped:-0}" -ge 200 ] && [ "$exited" = "1" ] && [ "$truncated" = "1" ] && [ "$corrupt" = "1" ]; then
+        echo "✓ PASS: Snapshot dumped, diffed and truncated or corrupt files rejected"
+    else
+        echo "✗ FAIL: snapshots (regions: $dumped, exited: $exited, truncated: $truncated, corrupt: $corrupt)"
+    fi
+fi
+rm -rf "$snap_dir"
+
+# Test 16: NUMA node breakdown adds up to the resident set
+echo "Test 16: NUMA placement"
+if [ ! -r /proc/self/numa_maps ]; then
+    echo "✓ PASS: Skipped (kernel built without NUMA support)"
+else
+    numa_dir=$(mktemp -d)
+    ./mapstress -n 500 > "$numa_dir/ready" &
+    stress_pid=$!
+    until [ -s "$numa_dir/ready" ] || ! kill -0 $stress_pid 2>/dev/null; do sleep 0.05; done
+    if [ ! -s "$numa_dir/ready" ]; then
+        echo "✗ FAIL: NUMA placement (mapstress did not start)"
+    else
+        # The total row is "total  <N0> KB  <N1> KB ...  <remote>%": sum every node
+        numa_kb=$(./memview -p $stress_pid --numa |
+                  awk '$1 == "total" {for (i = 3; i <= NF; i++) if ($i == "KB") sum += $(i - 1); print sum}')
+        rss_kb=$(./memview -p $stress_pid -R | awk '$1 == "Rss:" {print $2}')
+        kill $stress_pid; wait $stress_pid 2>/dev/null
+        # numa_maps leaves out the vdso, so allow a few pages of slack
+        if [ -n "$numa_kb" ] && [ $((rss_kb - numa_kb)) -ge 0 ] && [ $((rss_kb - numa_kb)) -le 64 ]; then
+            echo "✓ PASS: $numa_kb KB on NUMA nodes (Rss $rss_kb KB)"
+        else
+            echo "✗ FAIL: NUMA placement ($numa_kb KB on nodes, Rss $rss_kb KB)"
+        fi
+    fi
+    rm -rf "$numa_dir"
+fi
+
 echo "============================================"
 echo "TEST SUMMARY"
 echo "============================================"